@@ -0,0 +1,267 @@
+/*
+ * asynclog.c - asynchronous candump format logger
+ *
+ * See asynclog.h for the interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "asynclog.h"
+
+#define ASYNCLOG_IDLE_NS 5000000 /* writer poll interval when the ring is empty */
+
+struct asynclog_entry {
+	__u64 ts_ns;
+	int mtu;
+	struct canfd_frame cf;
+};
+
+struct asynclog {
+	char path[PATH_MAX];
+	char ifname[IFNAMSIZ];
+	int fd;
+	off_t max_size;
+	int max_age;
+
+	struct asynclog_entry *ring;
+	_Atomic unsigned long head;	/* next slot to fill, producer only */
+	_Atomic unsigned long tail;	/* next slot to write, writer only */
+	_Atomic int stop;
+	pthread_t thread;
+	char *buf;
+
+	/* writer state */
+	off_t size;
+	time_t opened;
+
+	_Atomic unsigned long written;
+	_Atomic unsigned long dropped;
+	_Atomic __u64 lag_max_ns;
+	_Atomic __u64 lag_sum_ns;
+	_Atomic int rotations;
+};
+
+static __u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int open_log(struct asynclog *al)
+{
+	al->fd = open(al->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (al->fd < 0)
+		return -1;
+
+	al->size = 0;
+	al->opened = time(NULL);
+
+	return 0;
+}
+
+static void rotate(struct asynclog *al)
+{
+	char name[PATH_MAX + 16];
+	int n = atomic_load(&al->rotations) + 1;
+
+	close(al->fd);
+	snprintf(name, sizeof(name), "%s.%d", al->path, n);
+	if (rename(al->path, name))
+		perror("[Log] rename");
+	atomic_store(&al->rotations, n);
+
+	if (open_log(al))
+		perror("[Log] open");
+}
+
+static int need_rotate(struct asynclog *al)
+{
+	if (al->max_size && al->size >= al->max_size)
+		return 1;
+
+	return al->max_age && al->size && time(NULL) - al->opened >= al->max_age;
+}
+
+static void write_all(struct asynclog *al, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	if (al->fd < 0)
+		return;
+
+	while (len) {
+		n = write(al->fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("[Log] write");
+			return;
+		}
+		buf += n;
+		len -= n;
+		al->size += n;
+	}
+}
+
+static void *writer(void *arg)
+{
+	struct asynclog *al = arg;
+	struct timespec idle = { 0, ASYNCLOG_IDLE_NS };
+	struct asynclog_entry *e;
+	unsigned long head, tail, i, n;
+	__u64 now, lag, lag_max;
+	size_t len;
+
+	tail = atomic_load_explicit(&al->tail, memory_order_relaxed);
+
+	for (;;) {
+		head = atomic_load_explicit(&al->head, memory_order_acquire);
+		if (head == tail) {
+			if (atomic_load(&al->stop))
+				break;
+			if (need_rotate(al))
+				rotate(al);
+			nanosleep(&idle, NULL);
+			continue;
+		}
+
+		n = head - tail;
+		if (n > ASYNCLOG_BATCH)
+			n = ASYNCLOG_BATCH;
+
+		len = 0;
+		now = now_ns();
+		lag_max = atomic_load_explicit(&al->lag_max_ns, memory_order_relaxed);
+		for (i = 0; i < n; i++) {
+			e = &al->ring[(tail + i) & (ASYNCLOG_RING_SIZE - 1)];
+			len += canlog_sprint_line(al->buf + len, e->ts_ns, al->ifname,
+						  &e->cf, e->mtu);
+			lag = (now > e->ts_ns) ? now - e->ts_ns : 0;
+			if (lag > lag_max)
+				lag_max = lag;
+			atomic_fetch_add_explicit(&al->lag_sum_ns, lag, memory_order_relaxed);
+		}
+		atomic_store_explicit(&al->lag_max_ns, lag_max, memory_order_relaxed);
+
+		/* the slots are formatted, hand them back before the slow part */
+		tail += n;
+		atomic_store_explicit(&al->tail, tail, memory_order_release);
+
+		write_all(al, al->buf, len);
+		atomic_fetch_add_explicit(&al->written, n, memory_order_relaxed);
+
+		if (need_rotate(al))
+			rotate(al);
+	}
+
+	return NULL;
+}
+
+struct asynclog *asynclog_open(const char *path, const char *ifname,
+			       off_t max_size, int max_age)
+{
+	struct asynclog *al;
+	int err;
+
+	al = calloc(1, sizeof(*al));
+	if (!al)
+		return NULL;
+
+	strncpy(al->path, path, sizeof(al->path) - 1);
+	strncpy(al->ifname, ifname, sizeof(al->ifname) - 1);
+	al->max_size = max_size;
+	al->max_age = max_age;
+
+	al->ring = calloc(ASYNCLOG_RING_SIZE, sizeof(*al->ring));
+	al->buf = malloc(ASYNCLOG_BATCH * CANLOG_LINESZ);
+	if (!al->ring || !al->buf || open_log(al))
+		goto err;
+
+	err = pthread_create(&al->thread, NULL, writer, al);
+	if (err) {
+		close(al->fd);
+		errno = err;
+		goto err;
+	}
+
+	return al;
+
+err:
+	err = errno;
+	free(al->ring);
+	free(al->buf);
+	free(al);
+	errno = err;
+	return NULL;
+}
+
+int asynclog_push(struct asynclog *al, struct canfd_frame *cf, int mtu,
+		  __u64 ts_ns)
+{
+	unsigned long head = atomic_load_explicit(&al->head, memory_order_relaxed);
+	unsigned long tail = atomic_load_explicit(&al->tail, memory_order_acquire);
+	struct asynclog_entry *e;
+
+	if (head - tail >= ASYNCLOG_RING_SIZE) {
+		atomic_fetch_add_explicit(&al->dropped, 1, memory_order_relaxed);
+		return -1;
+	}
+
+	e = &al->ring[head & (ASYNCLOG_RING_SIZE - 1)];
+	e->ts_ns = ts_ns;
+	e->mtu = mtu;
+	memcpy(&e->cf, cf, mtu);
+	if (mtu == CAN_MTU)
+		e->cf.flags = 0;
+
+	atomic_store_explicit(&al->head, head + 1, memory_order_release);
+
+	return 0;
+}
+
+void asynclog_get_stats(struct asynclog *al, struct asynclog_stats *st)
+{
+	st->written = atomic_load_explicit(&al->written, memory_order_relaxed);
+	st->dropped = atomic_load_explicit(&al->dropped, memory_order_relaxed);
+	st->pending = atomic_load(&al->head) - atomic_load(&al->tail);
+	st->lag_max_ns = atomic_load_explicit(&al->lag_max_ns, memory_order_relaxed);
+	st->lag_avg_ns = st->written ?
+		atomic_load_explicit(&al->lag_sum_ns, memory_order_relaxed) / st->written : 0;
+	st->rotations = atomic_load(&al->rotations);
+}
+
+void asynclog_close(struct asynclog *al)
+{
+	struct asynclog_stats st;
+
+	atomic_store(&al->stop, 1);
+	pthread_join(al->thread, NULL);
+
+	asynclog_get_stats(al, &st);
+	printf("[Log] %s: %lu frames written, %lu dropped, %d rotations, "
+	       "writer lag avg %llu us max %llu us\n",
+	       al->path, st.written, st.dropped, st.rotations,
+	       (unsigned long long)st.lag_avg_ns / 1000,
+	       (unsigned long long)st.lag_max_ns / 1000);
+
+	if (al->fd >= 0)
+		close(al->fd);
+	free(al->ring);
+	free(al->buf);
+	free(al);
+}
@@ -0,0 +1,66 @@
+/*
+ * asynclog.h - asynchronous candump format logger
+ *
+ * Frames are handed to a background writer thread through a lock-free
+ * single producer / single consumer ring of preallocated slots, so the
+ * receive loop never formats, allocates or blocks on I/O.  The writer
+ * formats whole batches into one buffer with the lib.c formatters and
+ * issues a single write() per batch.
+ *
+ * When the ring is full the frame is dropped and counted instead of
+ * stalling the producer.
+ */
+
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <linux/types.h>
+#include <linux/can.h>
+
+#define ASYNCLOG_RING_SIZE	65536	/* slots, power of two */
+#define ASYNCLOG_BATCH		1024	/* lines per write() */
+
+struct asynclog;
+
+struct asynclog_stats {
+	unsigned long written;	/* frames written to the log */
+	unsigned long dropped;	/* frames dropped because the ring was full */
+	unsigned long pending;	/* frames queued but not yet written */
+	__u64 lag_max_ns;	/* receive timestamp to write, worst case */
+	__u64 lag_avg_ns;
+	int rotations;
+};
+
+struct asynclog *asynclog_open(const char *path, const char *ifname,
+			       off_t max_size, int max_age);
+/*
+ * Creates path and starts the writer thread.  Lines are written with
+ * ifname as interface name.
+ *
+ * The log is rotated when it grows beyond max_size bytes or is older than
+ * max_age seconds (0 disables either limit): path is renamed to path.1,
+ * path.2, ... and a fresh path is started.
+ *
+ * Returns NULL on error (errno set).
+ */
+
+int asynclog_push(struct asynclog *al, struct canfd_frame *cf, int mtu,
+		  __u64 ts_ns);
+/*
+ * Queues a frame received with the given MTU and timestamp (ns since the
+ * epoch).  Must only be called from one thread.  Never blocks.
+ *
+ * Return values: 0 = queued, -1 = ring full, frame dropped
+ */
+
+void asynclog_get_stats(struct asynclog *al, struct asynclog_stats *st);
+
+void asynclog_close(struct asynclog *al);
+/*
+ * Writes out all queued frames, stops the writer thread and prints the
+ * final statistics to stdout.
+ */
+
+#endif
@@ -0,0 +1,407 @@
+/*
+ * cancorr.c - find the CAN signals that follow a reference signal
+ *
+ * Usage: ./cancorr [-n count] [-m frames] <reference> <log>
+ *
+ * The reference is a text file with one "timestamp value" pair per line,
+ * timestamps in seconds since the epoch like in candump logs, e.g. the
+ * speed recorded by ./controls -s.  Every frame of the log is paired with
+ * the reference value interpolated at its timestamp, and every 8 bit byte
+ * and 16 bit little and big endian byte pair of every CAN ID is ranked by
+ * the absolute Pearson correlation with the reference.
+ *
+ * The sums are accumulated for all candidates of a frame at once with
+ * SSE2, or AVX2 when the CPU has it, and one by one on other CPUs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logreader.h"
+#include "idtable.h"
+
+#define DEFAULT_TOP	20
+#define DEFAULT_MIN	10
+
+/* candidate layout: bytes, then LE and BE pairs starting at each byte */
+#define CAND_U8		0
+#define CAND_LE16	CANFD_MAX_DLEN
+#define CAND_BE16	(2 * CANFD_MAX_DLEN)
+#define NCAND		(3 * CANFD_MAX_DLEN)
+
+struct ref {
+	__u64 *ts_ns;
+	double *val;
+	size_t n;
+	size_t cur;		/* interpolation cursor */
+	double mean;
+};
+
+struct corr {
+	__u64 key;		/* (ifindex + 1) << 32 | can_id, 0 = free slot */
+	__u64 n;
+	int width;		/* widest payload */
+
+	/* per candidate: only frames long enough to contain it count */
+	double sn[NCAND] __attribute__((aligned(32)));
+	double sy[NCAND] __attribute__((aligned(32)));
+	double syy[NCAND] __attribute__((aligned(32)));
+	double sx[NCAND] __attribute__((aligned(32)));
+	double sxx[NCAND] __attribute__((aligned(32)));
+	double sxy[NCAND] __attribute__((aligned(32)));
+};
+
+struct match {
+	const struct corr *c;
+	int cand;
+	double r;
+};
+
+static void (*accumulate)(struct corr *c, int cand, const double *x, double y,
+			  int n);
+
+static void usage(char *msg)
+{
+	if (msg)
+		fprintf(stderr, "%s\n", msg);
+	fprintf(stderr, "Usage: cancorr [options] <reference> <log>\n");
+	fprintf(stderr, "\t-n\tmatches to print (default: %d)\n", DEFAULT_TOP);
+	fprintf(stderr, "\t-m\tminimum frames of a CAN ID (default: %d)\n", DEFAULT_MIN);
+	fprintf(stderr, "\t-v\tprint timing to stderr\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* adds a frame to the sums of the n candidates from cand on */
+static void accumulate_scalar(struct corr *c, int cand, const double *x, double y,
+			      int n)
+{
+	int i;
+
+	for (i = cand; i < cand + n; i++) {
+		c->sn[i] += 1;
+		c->sy[i] += y;
+		c->syy[i] += y * y;
+		c->sx[i] += x[i];
+		c->sxx[i] += x[i] * x[i];
+		c->sxy[i] += x[i] * y;
+	}
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_CORR_SIMD
+
+static void accumulate_sse2(struct corr *c, int cand, const double *x, double y,
+			    int n)
+{
+	double *sn = c->sn + cand, *sy = c->sy + cand, *syy = c->syy + cand;
+	double *sx = c->sx + cand, *sxx = c->sxx + cand, *sxy = c->sxy + cand;
+	__m128d vy = _mm_set1_pd(y), vyy = _mm_set1_pd(y * y), one = _mm_set1_pd(1), vx;
+	int i;
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		vx = _mm_load_pd(x + cand + i);
+		_mm_store_pd(sn + i, _mm_add_pd(_mm_load_pd(sn + i), one));
+		_mm_store_pd(sy + i, _mm_add_pd(_mm_load_pd(sy + i), vy));
+		_mm_store_pd(syy + i, _mm_add_pd(_mm_load_pd(syy + i), vyy));
+		_mm_store_pd(sx + i, _mm_add_pd(_mm_load_pd(sx + i), vx));
+		_mm_store_pd(sxx + i, _mm_add_pd(_mm_load_pd(sxx + i), _mm_mul_pd(vx, vx)));
+		_mm_store_pd(sxy + i, _mm_add_pd(_mm_load_pd(sxy + i), _mm_mul_pd(vx, vy)));
+	}
+	accumulate_scalar(c, cand + i, x, y, n - i);
+}
+
+__attribute__((target("avx2")))
+static void accumulate_avx2(struct corr *c, int cand, const double *x, double y,
+			    int n)
+{
+	double *sn = c->sn + cand, *sy = c->sy + cand, *syy = c->syy + cand;
+	double *sx = c->sx + cand, *sxx = c->sxx + cand, *sxy = c->sxy + cand;
+	__m256d vy = _mm256_set1_pd(y), vyy = _mm256_set1_pd(y * y);
+	__m256d one = _mm256_set1_pd(1), vx;
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		vx = _mm256_load_pd(x + cand + i);
+		_mm256_store_pd(sn + i, _mm256_add_pd(_mm256_load_pd(sn + i), one));
+		_mm256_store_pd(sy + i, _mm256_add_pd(_mm256_load_pd(sy + i), vy));
+		_mm256_store_pd(syy + i, _mm256_add_pd(_mm256_load_pd(syy + i), vyy));
+		_mm256_store_pd(sx + i, _mm256_add_pd(_mm256_load_pd(sx + i), vx));
+		_mm256_store_pd(sxx + i, _mm256_add_pd(_mm256_load_pd(sxx + i), _mm256_mul_pd(vx, vx)));
+		_mm256_store_pd(sxy + i, _mm256_add_pd(_mm256_load_pd(sxy + i), _mm256_mul_pd(vx, vy)));
+	}
+	accumulate_scalar(c, cand + i, x, y, n - i);
+}
+#endif
+
+static int load_ref(struct ref *ref, const char *path)
+{
+	char line[256], *end;
+	size_t alloc = 0;
+	double t, v, sum = 0;
+	void *p;
+	FILE *fp;
+
+	memset(ref, 0, sizeof(*ref));
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (*line == '#')
+			continue;
+		t = strtod(line, &end);
+		if (end == line)
+			continue;
+		v = strtod(end + strspn(end, " \t,;"), &end);
+
+		if (ref->n == alloc) {
+			alloc = alloc ? alloc * 2 : 4096;
+			p = realloc(ref->ts_ns, alloc * sizeof(*ref->ts_ns));
+			if (p)
+				ref->ts_ns = p;
+			p = p ? realloc(ref->val, alloc * sizeof(*ref->val)) : NULL;
+			if (!p) {
+				fclose(fp);
+				return -1;
+			}
+			ref->val = p;
+		}
+		ref->ts_ns[ref->n] = t * 1e9;
+		ref->val[ref->n++] = v;
+		sum += v;
+	}
+	fclose(fp);
+
+	if (ref->n)
+		ref->mean = sum / ref->n;
+
+	return 0;
+}
+
+/* reference value at ts_ns, 0 outside of the reference */
+static int ref_value(struct ref *ref, __u64 ts_ns, double *val)
+{
+	size_t lo, hi, mid;
+	double f;
+
+	if (ref->n < 2 || ts_ns < ref->ts_ns[0] || ts_ns > ref->ts_ns[ref->n - 1])
+		return 0;
+
+	/* logs are in time order, so the cursor usually moves a little */
+	if (ts_ns < ref->ts_ns[ref->cur]) {
+		lo = 0;
+		hi = ref->cur;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (ref->ts_ns[mid + 1] <= ts_ns)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		ref->cur = lo;
+	}
+	while (ref->cur + 2 < ref->n && ref->ts_ns[ref->cur + 1] <= ts_ns)
+		ref->cur++;
+
+	f = ref->ts_ns[ref->cur + 1] - ref->ts_ns[ref->cur];
+	f = f > 0 ? (ts_ns - ref->ts_ns[ref->cur]) / f : 0;
+	*val = ref->val[ref->cur] + f * (ref->val[ref->cur + 1] - ref->val[ref->cur]);
+
+	return 1;
+}
+
+static void update(struct corr *c, const struct canlog_rec *rec, double y)
+{
+	static double x[NCAND] __attribute__((aligned(32)));
+	int i, len = rec->len > CANFD_MAX_DLEN ? CANFD_MAX_DLEN : rec->len;
+	const __u8 *d = rec->data;
+
+	for (i = 0; i < len; i++)
+		x[CAND_U8 + i] = d[i];
+	for (i = 0; i + 1 < len; i++) {
+		x[CAND_LE16 + i] = d[i] | d[i + 1] << 8;
+		x[CAND_BE16 + i] = d[i] << 8 | d[i + 1];
+	}
+
+	accumulate(c, CAND_U8, x, y, len);
+	if (len > 1) {
+		accumulate(c, CAND_LE16, x, y, len - 1);
+		accumulate(c, CAND_BE16, x, y, len - 1);
+	}
+
+	c->n++;
+	if (len > c->width)
+		c->width = len;
+}
+
+static double pearson(const struct corr *c, int i)
+{
+	double n = c->sn[i];
+	double vx = n * c->sxx[i] - c->sx[i] * c->sx[i];
+	double vy = n * c->syy[i] - c->sy[i] * c->sy[i];
+
+	if (vx <= 0 || vy <= 0)
+		return 0;
+
+	return (n * c->sxy[i] - c->sx[i] * c->sy[i]) / sqrt(vx * vy);
+}
+
+static int cmp_match(const void *a, const void *b)
+{
+	double ra = fabs(((const struct match *)a)->r);
+	double rb = fabs(((const struct match *)b)->r);
+
+	return (ra < rb) - (ra > rb);
+}
+
+int main(int argc, char **argv)
+{
+	const struct canlog_rec *rec;
+	const char *simd = "scalar";
+	struct logreader lr;
+	struct ref ref;
+	struct idtable tab;
+	struct match *m;
+	struct corr *c;
+	unsigned int i, nm = 0;
+	__u64 frames = 0, used = 0;
+	int top = DEFAULT_TOP, min = DEFAULT_MIN, verbose = 0;
+	int opt, j;
+	double y, start;
+
+	while ((opt = getopt(argc, argv, "n:m:vh?")) != -1) {
+		switch (opt) {
+		case 'n':
+			top = atoi(optarg);
+			break;
+		case 'm':
+			min = atoi(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(NULL);
+			break;
+		}
+	}
+
+	if (optind + 2 > argc)
+		usage("You must specify a reference and a log");
+
+#ifdef HAVE_CORR_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		accumulate = accumulate_avx2;
+		simd = "avx2";
+	} else {
+		accumulate = accumulate_sse2;
+		simd = "sse2";
+	}
+#else
+	accumulate = accumulate_scalar;
+#endif
+	/* the sums are loaded with aligned vector loads */
+	idtable_init(&tab, sizeof(struct corr), 32);
+
+	if (load_ref(&ref, argv[optind])) {
+		perror(argv[optind]);
+		return 1;
+	}
+	if (ref.n < 2) {
+		fprintf(stderr, "%s: need at least two reference values\n", argv[optind]);
+		return 1;
+	}
+
+	if (logreader_open(&lr, argv[optind + 1])) {
+		perror(argv[optind + 1]);
+		return 1;
+	}
+
+	start = now();
+	while ((rec = logreader_next(&lr))) {
+		frames++;
+		if (!ref_value(&ref, rec->ts_ns, &y))
+			continue;
+		c = idtable_get(&tab, idtable_key(rec->ifindex, rec->can_id));
+		if (!c) {
+			perror("cancorr");
+			return 1;
+		}
+		/* centered, keeps the sums small */
+		update(c, rec, y - ref.mean);
+		used++;
+	}
+
+	if (verbose)
+		fprintf(stderr, "%llu frames, %llu within the reference, %u IDs, %.3f s (%s)\n",
+			(unsigned long long)frames, (unsigned long long)used, tab.count,
+			now() - start, simd);
+	if (!used)
+		fprintf(stderr, "no frames within the time range of the reference\n");
+
+	m = malloc((tab.count * NCAND + 1) * sizeof(*m));
+	if (!m) {
+		perror("malloc");
+		return 1;
+	}
+	for (i = 0; i < tab.size; i++) {
+		c = idtable_slot(&tab, i);
+		if (!c->key || c->n < (__u64)min)
+			continue;
+		for (j = 0; j < NCAND; j++) {
+			if (j % CANFD_MAX_DLEN >= c->width - (j >= CAND_LE16) ||
+			    c->sn[j] < min)
+				continue;
+			m[nm].c = c;
+			m[nm].cand = j;
+			m[nm].r = pearson(c, j);
+			if (m[nm].r != 0)
+				nm++;
+		}
+	}
+	qsort(m, nm, sizeof(*m), cmp_match);
+
+	printf("%4s %-8s %8s  %-14s %8s %9s\n", "rank", "iface", "id", "field", "r", "frames");
+	for (i = 0; i < nm && (int)i < top; i++) {
+		char field[32];
+		int pos = m[i].cand % CANFD_MAX_DLEN;
+
+		if (m[i].cand < CAND_LE16)
+			snprintf(field, sizeof(field), "byte %d", pos);
+		else
+			snprintf(field, sizeof(field), "bytes %d-%d %s", pos, pos + 1,
+				 m[i].cand < CAND_BE16 ? "LE" : "BE");
+		printf("%4u %-8s %8X  %-14s %8.4f %9llu\n", i + 1,
+		       logreader_ifname(&lr, (m[i].c->key >> 32) - 1),
+		       (unsigned int)(m[i].c->key & 0xFFFFFFFF), field, m[i].r,
+		       (unsigned long long)m[i].c->sn[m[i].cand]);
+	}
+
+	free(m);
+	idtable_free(&tab);
+	free(ref.ts_ns);
+	free(ref.val);
+	logreader_close(&lr);
+
+	return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * canids.c - timing based intrusion detection
+ *
+ * See canids.h for the interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <net/if.h>
+
+#include <linux/can.h>
+
+#include "canids.h"
+
+#define CANIDS_IDLE_NS 2000000 /* alert thread poll interval when idle */
+
+enum {
+	ALERT_TRAINED,
+	ALERT_EARLY,
+	ALERT_BACK,
+	ALERT_UNKNOWN,
+};
+
+struct canids_alert {
+	int type;
+	canid_t can_id;
+	__u64 ts_ns;
+	__s64 interval, period, dev;	/* ns */
+	unsigned long count;
+};
+
+struct canids_id {
+	_Atomic __u64 last;	/* last frame in time, 0 = never seen */
+	_Atomic __u64 timeout;	/* silence until missing, 0 = not watched */
+	__s64 period, dev;	/* moving averages, ns */
+	__u32 samples;
+	_Atomic int missing;	/* set by the alert thread */
+	unsigned long early, alerted;
+	__u64 next_alert;
+};
+
+struct canids {
+	char ifname[IFNAMSIZ];
+	__u64 train_ns, train_end;
+	_Atomic int armed;	/* training is over */
+	struct canids_id id[CAN_SFF_MASK + 1];
+
+	struct canids_alert *ring;
+	_Atomic unsigned long head;	/* next slot to fill, producer only */
+	_Atomic unsigned long tail;	/* next slot to print, alert thread only */
+	_Atomic int stop;
+	pthread_t thread;
+
+	_Atomic unsigned long frames, untracked, early, missing, unknown, dropped;
+	_Atomic int watched;
+};
+
+static __u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* counters with a single writer need no atomic read-modify-write */
+static inline void bump(_Atomic unsigned long *c)
+{
+	atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1,
+			      memory_order_relaxed);
+}
+
+static void push(struct canids *ids, int type, canid_t can_id, __u64 ts_ns,
+		 __s64 interval, const struct canids_id *e, unsigned long count)
+{
+	unsigned long head = atomic_load_explicit(&ids->head, memory_order_relaxed);
+	unsigned long tail = atomic_load_explicit(&ids->tail, memory_order_acquire);
+	struct canids_alert *a;
+
+	if (head - tail >= CANIDS_RING_SIZE) {
+		bump(&ids->dropped);
+		return;
+	}
+
+	a = &ids->ring[head & (CANIDS_RING_SIZE - 1)];
+	a->type = type;
+	a->can_id = can_id;
+	a->ts_ns = ts_ns;
+	a->interval = interval;
+	a->period = e ? e->period : 0;
+	a->dev = e ? e->dev : 0;
+	a->count = count;
+
+	atomic_store_explicit(&ids->head, head + 1, memory_order_release);
+}
+
+static void learn(struct canids_id *e, __s64 interval)
+{
+	__s64 err;
+
+	if (!e->samples) {
+		e->period = interval;
+		e->dev = interval / 2;
+	} else {
+		err = interval - e->period;
+		e->period += err / 8;
+		e->dev += ((err < 0 ? -err : err) - e->dev) / 4;
+	}
+	e->samples++;
+}
+
+/* ends the training: IDs with enough samples are watched from now on */
+static void arm(struct canids *ids, __u64 ts_ns)
+{
+	struct canids_id *e;
+	canid_t id;
+	int n = 0;
+
+	for (id = 0; id <= CAN_SFF_MASK; id++) {
+		e = &ids->id[id];
+		if (e->samples < CANIDS_MIN_SAMPLES)
+			continue;
+		atomic_store_explicit(&e->timeout,
+				      CANIDS_MISSING * e->period + CANIDS_DEV_K * e->dev,
+				      memory_order_relaxed);
+		n++;
+	}
+	atomic_store(&ids->watched, n);
+	atomic_store_explicit(&ids->armed, 1, memory_order_release);
+	push(ids, ALERT_TRAINED, 0, ts_ns, 0, NULL, n);
+}
+
+void canids_frame(struct canids *ids, canid_t can_id, __u64 ts_ns)
+{
+	struct canids_id *e;
+	__s64 interval, err, tol;
+	__u64 last;
+
+	if (can_id & (CAN_EFF_FLAG | CAN_ERR_FLAG)) {
+		bump(&ids->untracked);
+		return;
+	}
+	bump(&ids->frames);
+
+	if (!ids->train_end)
+		ids->train_end = ts_ns + ids->train_ns;
+	else if (!atomic_load_explicit(&ids->armed, memory_order_relaxed) &&
+		 ts_ns >= ids->train_end)
+		arm(ids, ts_ns);
+
+	e = &ids->id[can_id & CAN_SFF_MASK];
+	last = atomic_load_explicit(&e->last, memory_order_relaxed);
+	if (!last || ts_ns <= last) {
+		if (!last && atomic_load_explicit(&ids->armed, memory_order_relaxed)) {
+			bump(&ids->unknown);
+			push(ids, ALERT_UNKNOWN, can_id, ts_ns, 0, NULL, 0);
+		}
+		atomic_store_explicit(&e->last, ts_ns, memory_order_relaxed);
+		return;
+	}
+	interval = ts_ns - last;
+
+	if (!atomic_load_explicit(&e->timeout, memory_order_relaxed)) {
+		/* still training, or not periodic enough to be watched */
+		if (!atomic_load_explicit(&ids->armed, memory_order_relaxed))
+			learn(e, interval);
+		atomic_store_explicit(&e->last, ts_ns, memory_order_relaxed);
+		return;
+	}
+
+	if (atomic_load_explicit(&e->missing, memory_order_relaxed)) {
+		atomic_store_explicit(&e->missing, 0, memory_order_relaxed);
+		push(ids, ALERT_BACK, can_id, ts_ns, interval, e, 0);
+		atomic_store_explicit(&e->last, ts_ns, memory_order_relaxed);
+		return;
+	}
+
+	err = interval - e->period;
+	tol = CANIDS_DEV_K * e->dev;
+	if (tol < e->period / 8)
+		tol = e->period / 8;
+
+	if (err < -tol) {
+		/* neither last nor the averages learn from an injected frame */
+		e->early++;
+		bump(&ids->early);
+		if (ts_ns >= e->next_alert) {
+			push(ids, ALERT_EARLY, can_id, ts_ns, interval, e, e->early - e->alerted);
+			e->alerted = e->early;
+			e->next_alert = ts_ns + CANIDS_ALERT_NS;
+		}
+		return;
+	}
+
+	/* follow slow drifts, but not the gaps of lost frames */
+	if (err <= tol) {
+		learn(e, interval);
+		atomic_store_explicit(&e->timeout,
+				      CANIDS_MISSING * e->period + CANIDS_DEV_K * e->dev,
+				      memory_order_relaxed);
+	}
+	atomic_store_explicit(&e->last, ts_ns, memory_order_relaxed);
+}
+
+static void print_alert(struct canids *ids, const struct canids_alert *a)
+{
+	switch (a->type) {
+	case ALERT_TRAINED:
+		printf("[IDS] %s: training done, watching %lu periodic IDs\n",
+		       ids->ifname, a->count);
+		break;
+	case ALERT_EARLY:
+		printf("[IDS] %s: %03X early, %lu frame(s) within %.2f ms, period %.2f ms +- %.2f ms (injection?)\n",
+		       ids->ifname, a->can_id, a->count, a->interval / 1e6,
+		       a->period / 1e6, a->dev / 1e6);
+		break;
+	case ALERT_BACK:
+		printf("[IDS] %s: %03X back after %.1f ms\n",
+		       ids->ifname, a->can_id, a->interval / 1e6);
+		break;
+	case ALERT_UNKNOWN:
+		printf("[IDS] %s: %03X unknown, not seen during training\n",
+		       ids->ifname, a->can_id);
+		break;
+	}
+}
+
+/* flags watched IDs that have been silent for too long */
+static void scan(struct canids *ids, __u64 now)
+{
+	struct canids_id *e;
+	__u64 last, timeout;
+	canid_t id;
+
+	for (id = 0; id <= CAN_SFF_MASK; id++) {
+		e = &ids->id[id];
+		timeout = atomic_load_explicit(&e->timeout, memory_order_relaxed);
+		if (!timeout || atomic_load_explicit(&e->missing, memory_order_relaxed))
+			continue;
+		last = atomic_load_explicit(&e->last, memory_order_relaxed);
+		if (now <= last + timeout)
+			continue;
+
+		atomic_store_explicit(&e->missing, 1, memory_order_relaxed);
+		bump(&ids->missing);
+		printf("[IDS] %s: %03X missing, no frame for %.1f ms (limit %.1f ms)\n",
+		       ids->ifname, id, (now - last) / 1e6, timeout / 1e6);
+	}
+}
+
+static void *monitor(void *arg)
+{
+	struct canids *ids = arg;
+	struct timespec idle = { 0, CANIDS_IDLE_NS };
+	unsigned long head, tail;
+	__u64 now, next_scan = 0;
+	int stop;
+
+	tail = atomic_load_explicit(&ids->tail, memory_order_relaxed);
+
+	for (;;) {
+		/* after stop is set nothing is pushed, print what is left */
+		stop = atomic_load(&ids->stop);
+		head = atomic_load_explicit(&ids->head, memory_order_acquire);
+		for (; tail != head; tail++)
+			print_alert(ids, &ids->ring[tail & (CANIDS_RING_SIZE - 1)]);
+		atomic_store_explicit(&ids->tail, tail, memory_order_release);
+
+		if (stop)
+			break;
+
+		now = now_ns();
+		if (atomic_load_explicit(&ids->armed, memory_order_acquire) && now >= next_scan) {
+			scan(ids, now);
+			next_scan = now + CANIDS_SCAN_NS;
+		}
+		fflush(stdout);
+		nanosleep(&idle, NULL);
+	}
+
+	fflush(stdout);
+	return NULL;
+}
+
+struct canids *canids_open(const char *ifname, int train_sec)
+{
+	struct canids *ids;
+	int err;
+
+	ids = calloc(1, sizeof(*ids));
+	if (!ids)
+		return NULL;
+
+	strncpy(ids->ifname, ifname, sizeof(ids->ifname) - 1);
+	ids->train_ns = train_sec * 1000000000ULL;
+
+	ids->ring = calloc(CANIDS_RING_SIZE, sizeof(*ids->ring));
+	if (!ids->ring)
+		goto err;
+
+	err = pthread_create(&ids->thread, NULL, monitor, ids);
+	if (err) {
+		errno = err;
+		goto err;
+	}
+
+	return ids;
+
+err:
+	err = errno;
+	free(ids->ring);
+	free(ids);
+	errno = err;
+	return NULL;
+}
+
+void canids_get_stats(struct canids *ids, struct canids_stats *st)
+{
+	st->frames = atomic_load_explicit(&ids->frames, memory_order_relaxed);
+	st->untracked = atomic_load_explicit(&ids->untracked, memory_order_relaxed);
+	st->watched = atomic_load(&ids->watched);
+	st->early = atomic_load_explicit(&ids->early, memory_order_relaxed);
+	st->missing = atomic_load_explicit(&ids->missing, memory_order_relaxed);
+	st->unknown = atomic_load_explicit(&ids->unknown, memory_order_relaxed);
+	st->dropped = atomic_load_explicit(&ids->dropped, memory_order_relaxed);
+}
+
+void canids_close(struct canids *ids)
+{
+	struct canids_stats st;
+
+	atomic_store(&ids->stop, 1);
+	pthread_join(ids->thread, NULL);
+
+	canids_get_stats(ids, &st);
+	printf("[IDS] %s: %lu frames checked (%lu untracked), %d IDs watched, "
+	       "%lu early, %lu missing, %lu unknown, %lu alerts dropped\n",
+	       ids->ifname, st.frames, st.untracked, st.watched, st.early,
+	       st.missing, st.unknown, st.dropped);
+
+	free(ids->ring);
+	free(ids);
+}
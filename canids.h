@@ -0,0 +1,78 @@
+/*
+ * canids.h - timing based intrusion detection
+ *
+ * Most CAN IDs are sent periodically, and a frame injected by an attacker
+ * has to compete with the real sender: the ID suddenly comes twice as
+ * often, or the real sender is silenced and the ID goes missing.  The
+ * detector learns the period of every standard ID during a training
+ * window and then reports
+ *
+ *	early	 a frame clearly earlier than the period allows (injection)
+ *	missing	 no frame for CANIDS_MISSING periods
+ *	back	 the first frame of a missing ID
+ *	unknown	 an ID not seen during training
+ *
+ * Period and jitter are exponential moving averages kept in integer ns as
+ * for TCP round trip times (RFC 6298): period += (interval - period) / 8,
+ * dev += (|interval - period| - dev) / 4.  A frame is early when its
+ * interval is shorter than the period by more than CANIDS_DEV_K times
+ * dev, or an eighth of the period for IDs without jitter.  Early frames
+ * do not update the statistics, so an attack cannot train them away.
+ * Only IDs with CANIDS_MIN_SAMPLES intervals in the training window are
+ * watched, 29 bit IDs are not tracked.
+ *
+ * The state of an ID is one entry of an array indexed by the ID, so a
+ * frame costs an array access and a few integer operations without locks
+ * or syscalls.  Alerts are handed to a background thread through a
+ * lock-free single producer / single consumer ring and printed there; the
+ * same thread looks for missing IDs every CANIDS_SCAN_NS.  When the ring
+ * is full the alert is dropped and counted.
+ */
+
+#ifndef CANIDS_H
+#define CANIDS_H
+
+#include <linux/types.h>
+#include <linux/can.h>
+
+#define CANIDS_TRAIN_SEC	10	/* default training window */
+#define CANIDS_RING_SIZE	4096	/* alerts, power of two */
+#define CANIDS_MIN_SAMPLES	8	/* intervals before an ID is watched */
+#define CANIDS_DEV_K		4	/* deviations an interval may be short */
+#define CANIDS_MISSING		3	/* periods without a frame until missing */
+#define CANIDS_SCAN_NS		10000000	/* missing ID check interval */
+#define CANIDS_ALERT_NS		1000000000ULL	/* early alerts per ID at most */
+
+struct canids;
+
+struct canids_stats {
+	unsigned long frames;	/* standard frames checked */
+	unsigned long untracked;	/* 29 bit and error frames */
+	int watched;		/* IDs learned, 0 while training */
+	unsigned long early, missing, unknown;
+	unsigned long dropped;	/* alerts dropped because the ring was full */
+};
+
+struct canids *canids_open(const char *ifname, int train_sec);
+/*
+ * Starts the alert thread.  Training starts with the first frame and lasts
+ * train_sec seconds, alerts are printed with ifname.
+ *
+ * Returns NULL on error (errno set).
+ */
+
+void canids_frame(struct canids *ids, canid_t can_id, __u64 ts_ns);
+/*
+ * Checks a frame received at ts_ns (ns since the epoch, receive order).
+ * Must only be called from one thread.  Never blocks.
+ */
+
+void canids_get_stats(struct canids *ids, struct canids_stats *st);
+
+void canids_close(struct canids *ids);
+/*
+ * Prints the remaining alerts, stops the alert thread and prints the
+ * final statistics to stdout.
+ */
+
+#endif
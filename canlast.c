@@ -0,0 +1,187 @@
+/*
+ * canlast.c - show the last frame of every CAN ID from icsim's shared table
+ *
+ * Usage: ./canlast [-i id] [-w ms] [-B] <ifname>
+ *
+ * Reads the last value table that icsim --shm keeps in shared memory (see
+ * canshm.h) instead of opening a socket: one snapshot, a refresh every -w
+ * milliseconds like a sniffer, or a single CAN ID with -i.  -B measures
+ * how fast the table can be polled.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <linux/can.h>
+
+#include "canshm.h"
+
+#define BENCH_ROUNDS	10000
+
+static void usage(char *msg)
+{
+	if (msg)
+		fprintf(stderr, "%s\n", msg);
+	fprintf(stderr, "Usage: canlast [options] <ifname>\n");
+	fprintf(stderr, "\t-i\tonly show this CAN ID (hex)\n");
+	fprintf(stderr, "\t-w\trefresh every MS milliseconds until interrupted\n");
+	fprintf(stderr, "\t-B\tbenchmark reading the table\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static __u64 realtime_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_entry(const void *a, const void *b)
+{
+	const struct canshm_entry *ea = a, *eb = b;
+
+	return (ea->can_id > eb->can_id) - (ea->can_id < eb->can_id);
+}
+
+static void print_entry(const struct canshm_entry *e, __u64 now_ns)
+{
+	char id[16];
+	int i;
+
+	if (e->can_id & CAN_EFF_FLAG)
+		snprintf(id, sizeof(id), "%08X", e->can_id & CAN_EFF_MASK);
+	else
+		snprintf(id, sizeof(id), "%03X", e->can_id & CAN_SFF_MASK);
+
+	printf("%-8s %10llu %10llu %9.1f %3d ", id,
+	       (unsigned long long)e->count, (unsigned long long)e->changes,
+	       now_ns > e->ts_ns ? (now_ns - e->ts_ns) / 1e6 : 0.0, e->len);
+	if (e->can_id & CAN_RTR_FLAG)
+		printf(" remote request");
+	for (i = 0; i < e->len; i++)
+		printf(" %02X", e->data[i]);
+	printf("\n");
+}
+
+static void show(const struct canshm *shm)
+{
+	static struct canshm_entry ent[CANSHM_SLOTS];
+	unsigned int i, n = 0;
+	__u64 t = realtime_ns();
+
+	for (i = 0; i < CANSHM_SLOTS; i++)
+		n += canshm_read(shm, i, &ent[n]);
+	qsort(ent, n, sizeof(*ent), cmp_entry);
+
+	printf("%s: %llu frames, %u CAN IDs", shm->hdr->ifname,
+	       (unsigned long long)atomic_load(&shm->hdr->frames), n);
+	if (atomic_load(&shm->hdr->full))
+		printf(", %u frames of new IDs dropped (table full)",
+		       atomic_load(&shm->hdr->full));
+	printf("\n%-8s %10s %10s %9s %3s  data\n", "ID", "frames", "changes", "age ms", "len");
+	for (i = 0; i < n; i++)
+		print_entry(&ent[i], t);
+}
+
+static void bench(const struct canshm *shm)
+{
+	struct canshm_entry e;
+	canid_t can_id = 0;
+	unsigned int i, r;
+	double start, scan, lookup;
+
+	start = now();
+	for (r = 0; r < BENCH_ROUNDS; r++)
+		for (i = 0; i < CANSHM_SLOTS; i++)
+			if (canshm_read(shm, i, &e))
+				can_id = e.can_id;
+	scan = (now() - start) / BENCH_ROUNDS;
+
+	start = now();
+	for (r = 0; r < BENCH_ROUNDS * 100; r++)
+		canshm_lookup(shm, can_id, &e);
+	lookup = (now() - start) / (BENCH_ROUNDS * 100);
+
+	printf("full table snapshot %.1f us, single CAN ID lookup %.1f ns\n",
+	       scan * 1e6, lookup * 1e9);
+}
+
+int main(int argc, char **argv)
+{
+	struct canshm shm;
+	struct canshm_entry e;
+	canid_t can_id = 0;
+	int one = 0, interval = 0, benchmark = 0;
+	char *end;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:w:Bh?")) != -1) {
+		switch (opt) {
+		case 'i':
+			can_id = strtoul(optarg, &end, 16);
+			if (end == optarg || *end)
+				usage("Invalid CAN ID");
+			/* 29 bit IDs are stored with CAN_EFF_FLAG */
+			if (can_id > CAN_SFF_MASK || end - optarg > 3)
+				can_id |= CAN_EFF_FLAG;
+			one = 1;
+			break;
+		case 'w':
+			interval = atoi(optarg);
+			if (interval <= 0)
+				usage("Invalid refresh interval");
+			break;
+		case 'B':
+			benchmark = 1;
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(NULL);
+			break;
+		}
+	}
+
+	if (optind != argc - 1)
+		usage("You must specify an interface");
+
+	if (canshm_attach(&shm, argv[optind])) {
+		perror("/icsim-<ifname> (is icsim running with --shm?)");
+		return 1;
+	}
+
+	if (benchmark) {
+		bench(&shm);
+	} else if (one) {
+		do {
+			if (canshm_lookup(&shm, can_id, &e))
+				print_entry(&e, realtime_ns());
+			else
+				printf("%X not seen\n", can_id & CAN_EFF_MASK);
+			fflush(stdout);
+		} while (interval && !usleep(interval * 1000));
+	} else {
+		do {
+			if (interval)
+				printf("\033[H\033[2J");
+			show(&shm);
+			fflush(stdout);
+		} while (interval && !usleep(interval * 1000));
+	}
+
+	canshm_close(&shm);
+
+	return 0;
+}
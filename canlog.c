@@ -0,0 +1,251 @@
+/*
+ * canlog.c - compact binary CAN log format
+ *
+ * See canlog.h for the file layout.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+
+int canlog_create(struct canlog *log, const char *path, int canfd)
+{
+	memset(log, 0, sizeof(*log));
+	memcpy(log->hdr.magic, CANLOG_MAGIC, sizeof(log->hdr.magic));
+	log->hdr.version = CANLOG_VERSION;
+	log->hdr.rec_size = canfd ? CANLOG_REC_CANFD : CANLOG_REC_CAN;
+	log->writing = 1;
+
+	log->fp = fopen(path, "w+b");
+	if (!log->fp)
+		return -1;
+
+	/* placeholder, rewritten by canlog_close() */
+	if (fwrite(&log->hdr, sizeof(log->hdr), 1, log->fp) != 1) {
+		fclose(log->fp);
+		return -1;
+	}
+
+	return 0;
+}
+
+int canlog_open(struct canlog *log, const char *path)
+{
+	memset(log, 0, sizeof(*log));
+
+	log->fp = fopen(path, "rb");
+	if (!log->fp)
+		return -1;
+
+	if (fread(&log->hdr, sizeof(log->hdr), 1, log->fp) != 1 ||
+	    memcmp(log->hdr.magic, CANLOG_MAGIC, sizeof(log->hdr.magic)) ||
+	    log->hdr.version != CANLOG_VERSION ||
+	    (log->hdr.rec_size != CANLOG_REC_CAN &&
+	     log->hdr.rec_size != CANLOG_REC_CANFD) ||
+	    log->hdr.n_ifaces > CANLOG_MAX_IFACES) {
+		fclose(log->fp);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+int canlog_read(struct canlog *log, struct canlog_rec *rec)
+{
+	if (fread(rec, log->hdr.rec_size, 1, log->fp) == 1)
+		return 1;
+
+	return ferror(log->fp) ? -1 : 0;
+}
+
+int canlog_write(struct canlog *log, const struct canlog_rec *rec)
+{
+	if (sizeof(*rec) + rec->len > log->hdr.rec_size) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	if (fwrite(rec, log->hdr.rec_size, 1, log->fp) != 1)
+		return -1;
+
+	log->hdr.n_recs++;
+	return 0;
+}
+
+int canlog_close(struct canlog *log)
+{
+	int ret = 0;
+
+	if (log->writing) {
+		if (fseek(log->fp, 0, SEEK_SET) ||
+		    fwrite(&log->hdr, sizeof(log->hdr), 1, log->fp) != 1)
+			ret = -1;
+	}
+
+	if (fclose(log->fp))
+		ret = -1;
+
+	return ret;
+}
+
+int canlog_ifindex(struct canlog_header *hdr, const char *ifname)
+{
+	int i;
+
+	for (i = 0; i < hdr->n_ifaces; i++)
+		if (!strncmp(hdr->ifname[i], ifname, IFNAMSIZ))
+			return i;
+
+	if (hdr->n_ifaces >= CANLOG_MAX_IFACES)
+		return -1;
+
+	strncpy(hdr->ifname[i], ifname, IFNAMSIZ - 1);
+	hdr->n_ifaces++;
+
+	return i;
+}
+
+int canlog_is_binary(const char *path)
+{
+	char magic[sizeof(((struct canlog_header *)0)->magic)];
+	FILE *fp = fopen(path, "rb");
+	int ret;
+
+	if (!fp)
+		return -1;
+
+	ret = fread(magic, sizeof(magic), 1, fp) == 1 &&
+	      !memcmp(magic, CANLOG_MAGIC, sizeof(magic));
+	fclose(fp);
+
+	return ret;
+}
+
+int canlog_rec2frame(const struct canlog_rec *rec, struct canfd_frame *cf)
+{
+	int fd = rec->flags & CANLOG_FLAG_FD;
+	int maxdlen = fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+
+	cf->can_id = rec->can_id;
+	cf->len = (rec->len > maxdlen) ? maxdlen : rec->len;
+	cf->flags = rec->flags & 0x0F;
+	cf->__res0 = 0;
+	cf->__res1 = 0;
+	memcpy(cf->data, rec->data, cf->len);
+
+	return fd ? CANFD_MTU : CAN_MTU;
+}
+
+void canlog_frame2rec(struct canlog_rec *rec, struct canfd_frame *cf, int mtu,
+		      __u64 ts_ns, int ifindex)
+{
+	int maxdlen = (mtu == CANFD_MTU) ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+	int len = (cf->len > maxdlen) ? maxdlen : cf->len;
+
+	rec->ts_ns = ts_ns;
+	rec->can_id = cf->can_id;
+	rec->ifindex = ifindex;
+	rec->flags = cf->flags & 0x0F;
+	if (mtu == CANFD_MTU)
+		rec->flags |= CANLOG_FLAG_FD;
+	rec->len = len;
+	rec->__res = 0;
+	memcpy(rec->data, cf->data, len);
+	if (len < CAN_MAX_DLEN)
+		memset(rec->data + len, 0, CAN_MAX_DLEN - len);
+}
+
+int canlog_parse_line(const char *line, int len, __u64 *ts_ns, char *ifname,
+		      struct canfd_frame *cf)
+{
+	const char *p = line, *end = line + len, *name, *frame;
+	__u64 sec = 0, frac = 0;
+	int digits = 0;
+
+	if (p == end || *p++ != '(')
+		return 0;
+
+	while (p < end && *p >= '0' && *p <= '9')
+		sec = sec * 10 + (*p++ - '0');
+
+	if (p == end || *p++ != '.')
+		return 0;
+
+	/* scale the fraction to nanoseconds, whatever its precision */
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (digits++ < 9)
+			frac = frac * 10 + (*p - '0');
+		p++;
+	}
+	for (; digits < 9; digits++)
+		frac *= 10;
+
+	if (end - p < 2 || *p++ != ')' || *p++ != ' ')
+		return 0;
+
+	name = p;
+	while (p < end && *p != ' ')
+		p++;
+	if (p == end || p == name || p - name >= IFNAMSIZ)
+		return 0;
+	memcpy(ifname, name, p - name);
+	ifname[p - name] = 0;
+
+	frame = ++p;
+	while (p < end && *p != ' ' && *p != '\n' && *p != '\r')
+		p++;
+
+	*ts_ns = sec * 1000000000ULL + frac;
+
+	return parse_canframe_len(frame, p - frame, cf);
+}
+
+/* unsigned decimal, zero padded to at least width digits */
+static char *put_dec(char *p, unsigned long long v, int width)
+{
+	char tmp[20];
+	int n = 0;
+
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+	while (n < width)
+		tmp[n++] = '0';
+	while (n)
+		*p++ = tmp[--n];
+
+	return p;
+}
+
+int canlog_sprint_line(char *buf, __u64 ts_ns, const char *ifname,
+		       struct canfd_frame *cf, int mtu)
+{
+	char *p = buf;
+	size_t len;
+
+	/* "(%010llu.%06llu) %s " */
+	*p++ = '(';
+	p = put_dec(p, ts_ns / 1000000000ULL, 10);
+	*p++ = '.';
+	p = put_dec(p, (ts_ns % 1000000000ULL) / 1000, 6);
+	*p++ = ')';
+	*p++ = ' ';
+	len = strnlen(ifname, IFNAMSIZ);
+	memcpy(p, ifname, len);
+	p += len;
+	*p++ = ' ';
+
+	p += sprint_canframe(p, cf, 0,
+			     (mtu == CANFD_MTU) ? CANFD_MAX_DLEN : CAN_MAX_DLEN);
+	*p++ = '\n';
+	*p = 0;
+
+	return p - buf;
+}
@@ -0,0 +1,144 @@
+/*
+ * canlog.h - compact binary CAN log format
+ *
+ * candump text logs ("(1398128223.803317) can0 166#D0320009") are easy to
+ * read but bulky and slow to parse.  A binary log is a struct canlog_header
+ * followed by fixed-size, 8 byte aligned records.  Record n lives at
+ * sizeof(struct canlog_header) + n * rec_size, so readers never scan for
+ * line ends or decode hex.
+ *
+ * rec_size is fixed per file: CANLOG_REC_CAN (24 bytes) when no payload
+ * exceeds 8 bytes, CANLOG_REC_CANFD (80 bytes) when CAN FD payloads may
+ * appear.  All fields are stored in little-endian (host) byte order.
+ */
+
+#ifndef CANLOG_H
+#define CANLOG_H
+
+#include <stdio.h>
+#include <linux/types.h>
+#include <linux/can.h>
+#include <net/if.h>
+
+#define CANLOG_MAGIC		"ICSIMLOG"
+#define CANLOG_VERSION		1
+#define CANLOG_MAX_IFACES	16
+
+/* canlog_rec.flags: the low nibble holds canfd_frame.flags */
+#define CANLOG_FLAG_FD		0x80 /* frame was received as CANFD_MTU */
+
+struct canlog_header {
+	char magic[8];		/* CANLOG_MAGIC, not terminated */
+	__u16 version;		/* CANLOG_VERSION */
+	__u16 rec_size;		/* CANLOG_REC_CAN or CANLOG_REC_CANFD */
+	__u16 n_ifaces;		/* used entries in ifname[] */
+	__u16 __res0;
+	__u64 n_recs;		/* number of records following the header */
+	__u64 reserved[5];	/* zero */
+	char ifname[CANLOG_MAX_IFACES][IFNAMSIZ];
+};
+
+struct canlog_rec {
+	__u64 ts_ns;		/* receive time, ns since the epoch */
+	canid_t can_id;		/* including CAN_*_FLAG bits */
+	__u8 ifindex;		/* index into canlog_header.ifname[] */
+	__u8 flags;		/* CANLOG_FLAG_FD | canfd_frame.flags */
+	__u8 len;		/* payload length */
+	__u8 __res;
+	__u8 data[];		/* CAN_MAX_DLEN or CANFD_MAX_DLEN bytes */
+};
+
+#define CANLOG_REC_CAN		(sizeof(struct canlog_rec) + CAN_MAX_DLEN)
+#define CANLOG_REC_CANFD	(sizeof(struct canlog_rec) + CANFD_MAX_DLEN)
+
+/* room for the longest candump line: timestamp, ifname and CAN FD frame */
+#define CANLOG_LINESZ		(sizeof("(0000000000.000000) ") + IFNAMSIZ + CL_CFSZ + 1)
+
+struct canlog {
+	FILE *fp;
+	struct canlog_header hdr;
+	int writing;
+};
+
+int canlog_create(struct canlog *log, const char *path, int canfd);
+/*
+ * Creates a binary log for writing.  With canfd != 0 the file uses
+ * CANLOG_REC_CANFD records, otherwise CANLOG_REC_CAN records that can
+ * only hold payloads of up to 8 bytes.  The header is finalized by
+ * canlog_close().
+ *
+ * Return values: 0 = success, -1 = error (errno set)
+ */
+
+int canlog_open(struct canlog *log, const char *path);
+/*
+ * Opens an existing binary log for reading and loads its header.
+ *
+ * Return values: 0 = success, -1 = error (errno set, EINVAL on a bad header)
+ */
+
+int canlog_read(struct canlog *log, struct canlog_rec *rec);
+/*
+ * Reads the next record into rec, which must provide hdr.rec_size bytes.
+ *
+ * Return values: 1 = record read, 0 = end of log, -1 = error
+ */
+
+int canlog_write(struct canlog *log, const struct canlog_rec *rec);
+/*
+ * Appends a record.  Frames longer than the file's record payload are
+ * rejected with EMSGSIZE.
+ *
+ * Return values: 0 = success, -1 = error (errno set)
+ */
+
+int canlog_close(struct canlog *log);
+/*
+ * Closes the log.  For logs opened with canlog_create() the header is
+ * rewritten with the final record count and interface table.
+ */
+
+int canlog_ifindex(struct canlog_header *hdr, const char *ifname);
+/*
+ * Returns the index of ifname in the interface table, adding it when it
+ * is not yet known.  Returns -1 when the table is full.
+ */
+
+int canlog_is_binary(const char *path);
+/*
+ * Returns 1 when path starts with CANLOG_MAGIC, 0 when it does not and
+ * -1 when it can not be read.
+ */
+
+int canlog_rec2frame(const struct canlog_rec *rec, struct canfd_frame *cf);
+/*
+ * Fills cf from rec and returns the MTU the frame was received with
+ * (CAN_MTU or CANFD_MTU).
+ */
+
+void canlog_frame2rec(struct canlog_rec *rec, struct canfd_frame *cf, int mtu,
+		      __u64 ts_ns, int ifindex);
+/*
+ * Fills rec from a frame of the given MTU.  Only cf->len payload bytes are
+ * copied, the remainder of a CAN 2.0 payload is zeroed.
+ */
+
+int canlog_parse_line(const char *line, int len, __u64 *ts_ns, char *ifname,
+		      struct canfd_frame *cf);
+/*
+ * Parses the first len characters of a candump log line
+ * "(<sec>.<usec>) <ifname> <frame>".  The line does not need to be
+ * terminated, so it can be parsed straight from a mapped file.
+ * ifname must provide IFNAMSIZ bytes.
+ *
+ * Return values: CAN_MTU / CANFD_MTU on success, 0 on a malformed line
+ */
+
+int canlog_sprint_line(char *buf, __u64 ts_ns, const char *ifname,
+		       struct canfd_frame *cf, int mtu);
+/*
+ * Creates a candump log line including the trailing newline in buf,
+ * which must provide CANLOG_LINESZ bytes.  Returns the line length.
+ */
+
+#endif
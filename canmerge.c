@@ -0,0 +1,159 @@
+/*
+ * canmerge.c - merge CAN logs into one time ordered log
+ *
+ * Usage: ./canmerge [-b] [-f] [-o outfile] <log> <log> [...]
+ *
+ * Reads candump text and binary logs (see canlog.h), e.g. one capture
+ * per interface of the gateway setup, and writes a single candump text
+ * log (default, to stdout) or binary log (-b) with the original interface
+ * names.  See logmerge.h for how the merge works.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logreader.h"
+#include "logmerge.h"
+
+static void usage(char *msg)
+{
+	if (msg)
+		fprintf(stderr, "%s\n", msg);
+	fprintf(stderr, "Usage: canmerge [options] <log> <log> [...]\n");
+	fprintf(stderr, "\t-o\twrite to a file instead of stdout\n");
+	fprintf(stderr, "\t-b\twrite a binary log (needs -o)\n");
+	fprintf(stderr, "\t-f\twrite CAN FD sized records (needed for logs with CAN FD frames)\n");
+	exit(1);
+}
+
+static int write_text(struct logmerge *m, const char *out)
+{
+	static char buf[1 << 16];
+	const struct canlog_rec *rec;
+	struct canfd_frame cf;
+	size_t n = 0;
+	int mtu, ret = 0;
+	FILE *fp;
+
+	fp = out ? fopen(out, "w") : stdout;
+	if (!fp) {
+		perror(out);
+		return 1;
+	}
+
+	while ((rec = logmerge_next(m))) {
+		mtu = canlog_rec2frame(rec, &cf);
+		n += canlog_sprint_line(buf + n, rec->ts_ns,
+					logmerge_ifname(m, rec->ifindex), &cf, mtu);
+		if (n > sizeof(buf) - CANLOG_LINESZ) {
+			if (fwrite(buf, 1, n, fp) != n) {
+				ret = 1;
+				break;
+			}
+			n = 0;
+		}
+	}
+	if (!ret && fwrite(buf, 1, n, fp) != n)
+		ret = 1;
+
+	if (fflush(fp) || (fp != stdout && fclose(fp)) || ret) {
+		perror(out ? out : "stdout");
+		ret = 1;
+	}
+
+	return ret;
+}
+
+static int write_bin(struct logmerge *m, const char *out, int canfd)
+{
+	const struct canlog_rec *rec;
+	struct canlog log;
+	int i;
+
+	if (canlog_create(&log, out, canfd)) {
+		perror(out);
+		return 1;
+	}
+
+	while ((rec = logmerge_next(m))) {
+		if (rec->len > CAN_MAX_DLEN && !canfd) {
+			fprintf(stderr, "CAN FD payload at %llu ns, merge with -f\n",
+				(unsigned long long)rec->ts_ns);
+			break;
+		}
+		if (canlog_write(&log, rec)) {
+			perror(out);
+			break;
+		}
+	}
+
+	/* the merged interface table becomes the table of the new log */
+	for (i = 0; i < m->hdr.n_ifaces; i++)
+		canlog_ifindex(&log.hdr, m->hdr.ifname[i]);
+
+	if (canlog_close(&log)) {
+		perror(out);
+		return 1;
+	}
+	fprintf(stderr, "%s: %llu frames, %d interfaces\n", out,
+		(unsigned long long)log.hdr.n_recs, log.hdr.n_ifaces);
+
+	return rec != NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct logmerge m;
+	const char *out = NULL;
+	int binary = 0, canfd = 0, opt, ret;
+
+	while ((opt = getopt(argc, argv, "o:bfh?")) != -1) {
+		switch (opt) {
+		case 'o':
+			out = optarg;
+			break;
+		case 'b':
+			binary = 1;
+			break;
+		case 'f':
+			canfd = 1;
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(NULL);
+			break;
+		}
+	}
+
+	if (optind >= argc)
+		usage("You must specify at least one log");
+	if (binary && !out)
+		usage("Binary output needs -o");
+
+	logmerge_init(&m);
+	for (; optind < argc; optind++) {
+		if (logmerge_add(&m, argv[optind])) {
+			perror(argv[optind]);
+			logmerge_close(&m);
+			return 1;
+		}
+	}
+
+	if (binary)
+		ret = write_bin(&m, out, canfd);
+	else
+		ret = write_text(&m, out);
+
+	if (logmerge_bad_lines(&m))
+		fprintf(stderr, "skipped %lu malformed lines\n", logmerge_bad_lines(&m));
+	logmerge_close(&m);
+
+	return ret;
+}
@@ -0,0 +1,472 @@
+/*
+ * canpcap.c - pcap and pcapng files with SocketCAN frames
+ *
+ * See canpcap.h for the interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <byteswap.h>
+#include <arpa/inet.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "canpcap.h"
+
+#define PCAP_MAGIC_US		0xa1b2c3d4
+#define PCAP_MAGIC_NS		0xa1b23c4d
+
+#define PCAPNG_SHB		0x0A0D0D0A
+#define PCAPNG_IDB		0x00000001
+#define PCAPNG_EPB		0x00000006
+#define PCAPNG_BYTE_ORDER	0x1A2B3C4D
+
+#define PCAPNG_OPT_END		0
+#define PCAPNG_IF_NAME		2
+#define PCAPNG_IF_TSRESOL	9
+
+#define STDIO_BUFSZ		(1 << 20)
+
+/* room for the largest packet we write: block headers and a CAN FD frame */
+#define PKT_BUFSZ		(32 + CANFD_MTU + 4)
+
+#define DEFAULT_IFNAME		"can0"
+
+struct pcap_file_header {
+	__u32 magic;
+	__u16 version_major;
+	__u16 version_minor;
+	__s32 thiszone;
+	__u32 sigfigs;
+	__u32 snaplen;
+	__u32 linktype;
+};
+
+struct pcap_pkt_header {
+	__u32 ts_sec;
+	__u32 ts_frac;		/* us or ns, depending on the magic */
+	__u32 caplen;
+	__u32 len;
+};
+
+static inline __u32 get32(struct canpcap *p, const void *src)
+{
+	__u32 v;
+
+	memcpy(&v, src, sizeof(v));
+	return p->swap ? bswap_32(v) : v;
+}
+
+static inline __u16 get16(struct canpcap *p, const void *src)
+{
+	__u16 v;
+
+	memcpy(&v, src, sizeof(v));
+	return p->swap ? bswap_16(v) : v;
+}
+
+static inline __u64 ts2ns(__u64 ts, __u64 units)
+{
+	if (units == 1000000000ULL)
+		return ts;
+	return (ts / units) * 1000000000ULL +
+	       (unsigned __int128)(ts % units) * 1000000000ULL / units;
+}
+
+int canpcap_detect(const char *path)
+{
+	__u32 magic;
+	FILE *fp;
+	int ret = 0;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		return -1;
+
+	if (fread(&magic, sizeof(magic), 1, fp) == 1) {
+		if (magic == PCAPNG_SHB)
+			ret = CANPCAP_PCAPNG;
+		else if (magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS ||
+			 magic == bswap_32(PCAP_MAGIC_US) ||
+			 magic == bswap_32(PCAP_MAGIC_NS))
+			ret = CANPCAP_PCAP;
+	}
+	fclose(fp);
+
+	return ret;
+}
+
+/* writes a frame as it is captured from a SocketCAN interface */
+static int put_frame(__u8 *pkt, const struct canlog_rec *rec)
+{
+	int mtu = (rec->flags & CANLOG_FLAG_FD) ? CANFD_MTU : CAN_MTU;
+	int len = rec->len > mtu - 8 ? mtu - 8 : rec->len;
+	__u32 id = htonl(rec->can_id);
+
+	memset(pkt, 0, mtu);
+	memcpy(pkt, &id, sizeof(id));
+	pkt[4] = len;
+	if (mtu == CANFD_MTU)
+		pkt[5] = (rec->flags & (CANFD_BRS | CANFD_ESI)) | CANFD_FDF;
+	memcpy(pkt + 8, rec->data, len);
+
+	return mtu;
+}
+
+/* the opposite of put_frame(), returns -1 for runt packets */
+static int get_frame(struct canlog_rec *rec, const __u8 *pkt, __u32 caplen)
+{
+	__u32 id;
+	int len;
+
+	if (caplen < 8)
+		return -1;
+
+	memcpy(&id, pkt, sizeof(id));
+	rec->can_id = ntohl(id);
+	rec->flags = 0;
+	if (caplen > CAN_MTU || (pkt[5] & CANFD_FDF) || pkt[4] > CAN_MAX_DLEN)
+		rec->flags = CANLOG_FLAG_FD | (pkt[5] & (CANFD_BRS | CANFD_ESI));
+
+	len = pkt[4];
+	if (len > CANFD_MAX_DLEN)
+		len = CANFD_MAX_DLEN;
+	if (len > (int)caplen - 8)
+		len = caplen - 8;
+	rec->len = len;
+	rec->__res = 0;
+	memcpy(rec->data, pkt + 8, len);
+
+	return 0;
+}
+
+static int write_shb(struct canpcap *p)
+{
+	__u32 blk[7] = { PCAPNG_SHB, sizeof(blk), PCAPNG_BYTE_ORDER,
+			 1 /* major 1, minor 0 */, 0xFFFFFFFF, 0xFFFFFFFF, sizeof(blk) };
+
+	return fwrite(blk, sizeof(blk), 1, p->fp) == 1 ? 0 : -1;
+}
+
+static int write_idb(struct canpcap *p, const char *ifname)
+{
+	__u8 blk[20 + 4 + IFNAMSIZ + 4 + 4 + 4 + 4];
+	__u32 v, off = 8;
+	int len = strnlen(ifname, IFNAMSIZ - 1);
+
+	v = LINKTYPE_CAN_SOCKETCAN;		/* linktype, reserved */
+	memcpy(blk + off, &v, 4);
+	v = CANFD_MTU;				/* snaplen */
+	memcpy(blk + off + 4, &v, 4);
+	off += 8;
+
+	v = PCAPNG_IF_NAME | len << 16;
+	memcpy(blk + off, &v, 4);
+	memset(blk + off + 4, 0, (len + 3) & ~3);
+	memcpy(blk + off + 4, ifname, len);
+	off += 4 + ((len + 3) & ~3);
+
+	v = PCAPNG_IF_TSRESOL | 1 << 16;	/* 10^-9 */
+	memcpy(blk + off, &v, 4);
+	v = 9;
+	memcpy(blk + off + 4, &v, 4);
+	off += 8;
+
+	v = PCAPNG_OPT_END;
+	memcpy(blk + off, &v, 4);
+	off += 4;
+
+	v = off + 4;
+	memcpy(blk + off, &v, 4);
+	memcpy(blk + 4, &v, 4);
+	v = PCAPNG_IDB;
+	memcpy(blk, &v, 4);
+
+	return fwrite(blk, off + 4, 1, p->fp) == 1 ? 0 : -1;
+}
+
+int canpcap_create(struct canpcap *p, const char *path, int ng)
+{
+	struct pcap_file_header fh = {
+		.magic = PCAP_MAGIC_NS,
+		.version_major = 2,
+		.version_minor = 4,
+		.snaplen = CANFD_MTU,
+		.linktype = LINKTYPE_CAN_SOCKETCAN,
+	};
+	int ret;
+
+	memset(p, 0, sizeof(*p));
+	p->ng = ng;
+	p->writing = 1;
+
+	p->fp = fopen(path, "wb");
+	if (!p->fp)
+		return -1;
+	setvbuf(p->fp, NULL, _IOFBF, STDIO_BUFSZ);
+
+	if (ng)
+		ret = write_shb(p);
+	else
+		ret = fwrite(&fh, sizeof(fh), 1, p->fp) == 1 ? 0 : -1;
+	if (ret) {
+		fclose(p->fp);
+		return -1;
+	}
+
+	return 0;
+}
+
+int canpcap_write(struct canpcap *p, const struct canlog_rec *rec,
+		  const char *ifname)
+{
+	__u8 pkt[PKT_BUFSZ];
+	__u32 v, caplen;
+	int idx;
+
+	if (!p->ng) {
+		struct pcap_pkt_header ph = {
+			.ts_sec = rec->ts_ns / 1000000000ULL,
+			.ts_frac = rec->ts_ns % 1000000000ULL,
+		};
+
+		caplen = put_frame(pkt + sizeof(ph), rec);
+		ph.caplen = ph.len = caplen;
+		memcpy(pkt, &ph, sizeof(ph));
+		return fwrite(pkt, sizeof(ph) + caplen, 1, p->fp) == 1 ? 0 : -1;
+	}
+
+	idx = canlog_ifindex(&p->hdr, ifname);
+	if (idx < 0) {
+		errno = ENOSPC;
+		return -1;
+	}
+	if (idx == p->n_idb) {
+		if (write_idb(p, ifname))
+			return -1;
+		p->n_idb++;
+	}
+
+	/* CAN_MTU and CANFD_MTU are multiples of 4, no padding needed */
+	caplen = put_frame(pkt + 28, rec);
+	v = PCAPNG_EPB;
+	memcpy(pkt, &v, 4);
+	v = 32 + caplen;
+	memcpy(pkt + 4, &v, 4);
+	memcpy(pkt + 28 + caplen, &v, 4);
+	v = idx;
+	memcpy(pkt + 8, &v, 4);
+	v = rec->ts_ns >> 32;
+	memcpy(pkt + 12, &v, 4);
+	v = rec->ts_ns;
+	memcpy(pkt + 16, &v, 4);
+	memcpy(pkt + 20, &caplen, 4);
+	memcpy(pkt + 24, &caplen, 4);
+
+	return fwrite(pkt, 32 + caplen, 1, p->fp) == 1 ? 0 : -1;
+}
+
+int canpcap_open(struct canpcap *p, const char *path)
+{
+	struct pcap_file_header fh;
+	__u32 magic;
+
+	memset(p, 0, sizeof(*p));
+
+	p->fp = fopen(path, "rb");
+	if (!p->fp)
+		return -1;
+	setvbuf(p->fp, NULL, _IOFBF, STDIO_BUFSZ);
+
+	if (fread(&magic, sizeof(magic), 1, p->fp) != 1)
+		goto inval;
+
+	if (magic == PCAPNG_SHB) {
+		/* the section header is parsed by canpcap_read() */
+		p->ng = 1;
+		rewind(p->fp);
+		return 0;
+	}
+
+	rewind(p->fp);
+	if (fread(&fh, sizeof(fh), 1, p->fp) != 1)
+		goto inval;
+	if (fh.magic == bswap_32(PCAP_MAGIC_US) || fh.magic == bswap_32(PCAP_MAGIC_NS)) {
+		p->swap = 1;
+		fh.magic = bswap_32(fh.magic);
+	}
+	if (fh.magic != PCAP_MAGIC_US && fh.magic != PCAP_MAGIC_NS)
+		goto inval;
+	if (get32(p, &fh.linktype) != LINKTYPE_CAN_SOCKETCAN) {
+		errno = EPROTONOSUPPORT;
+		fclose(p->fp);
+		return -1;
+	}
+
+	p->n_idb = 1;
+	p->units[0] = fh.magic == PCAP_MAGIC_NS ? 1000000000ULL : 1000000ULL;
+	p->ifmap[0] = canlog_ifindex(&p->hdr, DEFAULT_IFNAME);
+
+	return 0;
+
+inval:
+	fclose(p->fp);
+	errno = EINVAL;
+	return -1;
+}
+
+static int read_pcap(struct canpcap *p, struct canlog_rec *rec)
+{
+	struct pcap_pkt_header ph;
+	__u32 caplen;
+
+	for (;;) {
+		if (fread(&ph, sizeof(ph), 1, p->fp) != 1)
+			return ferror(p->fp) ? -1 : 0;
+
+		caplen = get32(p, &ph.caplen);
+		if (caplen > sizeof(p->buf) || fread(p->buf, caplen, 1, p->fp) != 1) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (get_frame(rec, p->buf, caplen)) {
+			p->skipped++;
+			continue;
+		}
+
+		rec->ts_ns = get32(p, &ph.ts_sec) * 1000000000ULL +
+			     ts2ns(get32(p, &ph.ts_frac), p->units[0]);
+		rec->ifindex = p->ifmap[0];
+		return 1;
+	}
+}
+
+/* parses the options of an interface description block body */
+static void parse_idb(struct canpcap *p, const __u8 *body, __u32 len)
+{
+	char ifname[IFNAMSIZ];
+	__u32 off = 8, code, olen;
+	int idb = p->n_idb++;
+	__u8 res;
+
+	if (idb >= CANPCAP_MAX_IDB)
+		return;
+
+	p->ifmap[idb] = -1;
+	p->units[idb] = 1000000;	/* default if_tsresol 6 */
+	if (len < 8 || get16(p, body) != LINKTYPE_CAN_SOCKETCAN)
+		return;
+
+	snprintf(ifname, sizeof(ifname), "can%d", idb);
+	while (off + 4 <= len) {
+		code = get16(p, body + off);
+		olen = get16(p, body + off + 2);
+		off += 4;
+		if (code == PCAPNG_OPT_END || off + olen > len)
+			break;
+
+		if (code == PCAPNG_IF_NAME) {
+			olen = olen < IFNAMSIZ - 1 ? olen : IFNAMSIZ - 1;
+			memcpy(ifname, body + off, olen);
+			ifname[olen] = 0;
+		} else if (code == PCAPNG_IF_TSRESOL && olen >= 1) {
+			res = body[off];
+			if (res & 0x80)
+				p->units[idb] = 1ULL << (res & 0x7F);
+			else
+				for (p->units[idb] = 1; res--; )
+					p->units[idb] *= 10;
+		}
+		off += (olen + 3) & ~3;
+	}
+
+	p->ifmap[idb] = canlog_ifindex(&p->hdr, ifname);
+}
+
+static int read_pcapng(struct canpcap *p, struct canlog_rec *rec)
+{
+	__u32 bh[2], type, len, body, idb, caplen;
+	__u64 ts;
+
+	for (;;) {
+		if (fread(bh, sizeof(bh), 1, p->fp) != 1)
+			return ferror(p->fp) ? -1 : 0;
+
+		if (bh[0] == PCAPNG_SHB) {
+			/* a new section, possibly in the other byte order */
+			if (fread(p->buf, 4, 1, p->fp) != 1)
+				goto inval;
+			p->swap = *(__u32 *)p->buf != PCAPNG_BYTE_ORDER;
+			if (p->swap && *(__u32 *)p->buf != bswap_32(PCAPNG_BYTE_ORDER))
+				goto inval;
+			p->n_idb = 0;
+			len = get32(p, &bh[1]);
+			if (len < 16 || len % 4 || fseek(p->fp, len - 12, SEEK_CUR))
+				goto inval;
+			continue;
+		}
+
+		type = get32(p, &bh[0]);
+		len = get32(p, &bh[1]);
+		if (len < 12 || len % 4)
+			goto inval;
+		body = len - 12;
+
+		if (body > sizeof(p->buf) ||
+		    (type != PCAPNG_IDB && type != PCAPNG_EPB)) {
+			/* skip the body and the trailing length */
+			if (fseek(p->fp, body + 4, SEEK_CUR))
+				goto inval;
+			continue;
+		}
+		if (fread(p->buf, body + 4, 1, p->fp) != 1)
+			goto inval;
+
+		if (type == PCAPNG_IDB) {
+			parse_idb(p, p->buf, body);
+			continue;
+		}
+
+		/* enhanced packet block */
+		if (body < 20)
+			goto inval;
+		idb = get32(p, p->buf);
+		caplen = get32(p, p->buf + 12);
+		if (idb >= (__u32)p->n_idb || idb >= CANPCAP_MAX_IDB ||
+		    p->ifmap[idb] < 0 || caplen > body - 20 ||
+		    get_frame(rec, p->buf + 20, caplen)) {
+			p->skipped++;
+			continue;
+		}
+
+		ts = (__u64)get32(p, p->buf + 4) << 32 | get32(p, p->buf + 8);
+		rec->ts_ns = ts2ns(ts, p->units[idb]);
+		rec->ifindex = p->ifmap[idb];
+		return 1;
+	}
+
+inval:
+	errno = EINVAL;
+	return -1;
+}
+
+int canpcap_read(struct canpcap *p, struct canlog_rec *rec)
+{
+	return p->ng ? read_pcapng(p, rec) : read_pcap(p, rec);
+}
+
+int canpcap_close(struct canpcap *p)
+{
+	int ret = 0;
+
+	if (p->writing && fflush(p->fp))
+		ret = -1;
+	if (fclose(p->fp))
+		ret = -1;
+
+	return ret;
+}
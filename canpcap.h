@@ -0,0 +1,93 @@
+/*
+ * canpcap.h - pcap and pcapng files with SocketCAN frames
+ *
+ * Reads and writes the capture formats of Wireshark and tcpdump with link
+ * type LINKTYPE_CAN_SOCKETCAN.  Each packet is a struct can_frame or
+ * struct canfd_frame as the kernel hands it out, except that can_id is in
+ * network byte order.  CAN FD frames are marked with CANFD_FDF and keep
+ * their BRS/ESI flags.
+ *
+ * pcap files are written with nanosecond timestamps (magic 0xa1b23c4d),
+ * pcapng files with an if_tsresol of 10^-9 and one interface description
+ * block per interface name.  Reading accepts both byte orders, microsecond
+ * and nanosecond pcap, and any pcapng timestamp resolution; packets of
+ * other link types are skipped and counted.
+ *
+ * Frames are exchanged as struct canlog_rec, so the converters built on
+ * canlog.h and logreader.h can use these files directly.  All I/O goes
+ * through large stdio buffers.
+ */
+
+#ifndef CANPCAP_H
+#define CANPCAP_H
+
+#include <stdio.h>
+#include <linux/types.h>
+
+#include "canlog.h"
+
+#define LINKTYPE_CAN_SOCKETCAN	227
+
+#define CANPCAP_PCAP		1
+#define CANPCAP_PCAPNG		2
+
+#define CANPCAP_MAX_IDB		64	/* pcapng interfaces per section */
+#define CANPCAP_BUFSZ		65536	/* largest pcapng block read */
+
+struct canpcap {
+	FILE *fp;
+	int ng;			/* pcapng instead of pcap */
+	int swap;		/* file byte order differs from ours */
+	int writing;
+
+	/* pcap: one interface; pcapng: per interface description block */
+	int n_idb;
+	int ifmap[CANPCAP_MAX_IDB];	/* IDB -> hdr.ifname[], -1 = not SocketCAN */
+	__u64 units[CANPCAP_MAX_IDB];	/* timestamp units per second */
+
+	struct canlog_header hdr;	/* interface names */
+	unsigned long skipped;		/* packets of other link types */
+
+	__u8 buf[CANPCAP_BUFSZ];
+};
+
+int canpcap_detect(const char *path);
+/*
+ * Return values: CANPCAP_PCAP, CANPCAP_PCAPNG, 0 = neither, -1 = error
+ */
+
+int canpcap_create(struct canpcap *p, const char *path, int ng);
+/*
+ * Creates a pcap file, or a pcapng file with ng != 0.
+ * Return values: 0 = success, -1 = error (errno set)
+ */
+
+int canpcap_open(struct canpcap *p, const char *path);
+/*
+ * Opens a pcap or pcapng file for reading.
+ * Return values: 0 = success, -1 = error (errno set, EINVAL on a bad header)
+ */
+
+int canpcap_read(struct canpcap *p, struct canlog_rec *rec);
+/*
+ * Reads the next SocketCAN frame into rec, which must have room for
+ * CANLOG_REC_CANFD bytes.  rec->ifindex indexes p->hdr.ifname[].
+ *
+ * Return values: 1 = frame read, 0 = end of file, -1 = error (errno set,
+ * EINVAL on a corrupt file)
+ */
+
+int canpcap_write(struct canpcap *p, const struct canlog_rec *rec,
+		  const char *ifname);
+/*
+ * Appends a frame.  pcap files have no interface names, pcapng files get
+ * an interface description block when ifname first appears.
+ * Return values: 0 = success, -1 = error (errno set)
+ */
+
+int canpcap_close(struct canpcap *p);
+/*
+ * Flushes and closes the file.  Return values: 0 = success, -1 = error
+ */
+
+#endif
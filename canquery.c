@@ -0,0 +1,397 @@
+/*
+ * canquery.c - query a columnar CAN log
+ *
+ * Usage: ./canquery [-i ids] [-s time] [-e time] [-m byte=value[/mask]]...
+ *                   [-t] [-c] [-v] <log.col>
+ *
+ * Prints the frames of the selected CAN IDs within a time range whose
+ * payload bytes match all -m conditions, from a column store written by
+ * "logconv -o col" (see logcol.h).  Only the timestamps of the selected
+ * IDs and the byte columns named by -m are scanned, 16 or 32 frames at a
+ * time with SSE2 or AVX2 on x86, a frame at a time elsewhere.  Frames are printed ID by ID, or merged in
+ * timestamp order with -t.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logcol.h"
+
+#define MAX_IDS		64
+#define MAX_CONDS	16
+
+struct id_range {
+	canid_t lo, hi;
+};
+
+struct cond {
+	int byte;
+	__u8 value, mask;
+};
+
+struct hit {
+	__u64 ts;
+	const struct logcol_id *id;
+	__u64 row;
+};
+
+static struct id_range ids[MAX_IDS];
+static int n_ids;
+static struct cond conds[MAX_CONDS];
+static int n_conds;
+
+static void (*match_byte)(__u8 *ok, const __u8 *col, const __u8 *len,
+			  __u64 n, const struct cond *c);
+
+static void usage(char *msg)
+{
+	if (msg)
+		fprintf(stderr, "%s\n", msg);
+	fprintf(stderr, "Usage: canquery [options] <log.col>\n");
+	fprintf(stderr, "\t-i\tCAN IDs in hex, e.g. 244,19B,400-4FF (default: all)\n");
+	fprintf(stderr, "\t-s\tstart at TIME, seconds since the epoch or +SECONDS from the log start\n");
+	fprintf(stderr, "\t-e\tend before TIME, like -s\n");
+	fprintf(stderr, "\t-m\tpayload byte BYTE must equal VALUE, only the bits in MASK when given (repeatable)\n");
+	fprintf(stderr, "\t-t\tprint in timestamp order instead of ID by ID\n");
+	fprintf(stderr, "\t-c\tonly count the matching frames of each ID\n");
+	fprintf(stderr, "\t-v\tverbose\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* parses "244,19B,400-4FF" */
+static int parse_ids(char *s)
+{
+	char *tok, *end;
+
+	for (tok = strtok(s, ","); tok; tok = strtok(NULL, ",")) {
+		if (n_ids == MAX_IDS)
+			return -1;
+		ids[n_ids].lo = strtoul(tok, &end, 16);
+		ids[n_ids].hi = ids[n_ids].lo;
+		if (*end == '-')
+			ids[n_ids].hi = strtoul(end + 1, &end, 16);
+		if (end == tok || *end || ids[n_ids].hi < ids[n_ids].lo)
+			return -1;
+		n_ids++;
+	}
+
+	return 0;
+}
+
+/* parses "BYTE=VALUE" or "BYTE=VALUE/MASK", numbers in C notation */
+static int parse_cond(const char *s)
+{
+	unsigned long byte, value, mask = 0xFF;
+	char *end;
+
+	if (n_conds == MAX_CONDS)
+		return -1;
+
+	byte = strtoul(s, &end, 0);
+	if (end == s || *end != '=' || byte >= CANFD_MAX_DLEN)
+		return -1;
+	s = end + 1;
+	value = strtoul(s, &end, 0);
+	if (end == s)
+		return -1;
+	if (*end == '/') {
+		s = end + 1;
+		mask = strtoul(s, &end, 0);
+		if (end == s)
+			return -1;
+	}
+	if (*end || value > 0xFF || mask > 0xFF)
+		return -1;
+
+	conds[n_conds].byte = byte;
+	conds[n_conds].value = value & mask;
+	conds[n_conds].mask = mask;
+	n_conds++;
+
+	return 0;
+}
+
+/* parses "+SECONDS" relative to first_ns or "SECONDS" since the epoch */
+static int parse_time(const char *s, __u64 first_ns, __u64 *ts_ns)
+{
+	char *end;
+	double t;
+
+	t = strtod(s + (*s == '+'), &end);
+	if (end == s || *end || t < 0)
+		return -1;
+
+	*ts_ns = (__u64)(t * 1e9);
+	if (*s == '+')
+		*ts_ns += first_ns;
+
+	return 0;
+}
+
+static int selected(canid_t can_id)
+{
+	int i;
+
+	if (!n_ids)
+		return 1;
+
+	can_id &= (can_id & CAN_EFF_FLAG) ? CAN_EFF_MASK : CAN_SFF_MASK;
+	for (i = 0; i < n_ids; i++)
+		if (can_id >= ids[i].lo && can_id <= ids[i].hi)
+			return 1;
+
+	return 0;
+}
+
+/*
+ * ok[i] &= (col[i] & mask) == value && len[i] > byte.  Bytes past the
+ * payload are 0 in the store, the length test keeps them from matching a
+ * value of 0.
+ */
+static void match_byte_scalar(__u8 *ok, const __u8 *col, const __u8 *len,
+			      __u64 n, const struct cond *c)
+{
+	__u64 i;
+
+	for (i = 0; i < n; i++)
+		ok[i] &= ((col[i] & c->mask) == c->value && len[i] > c->byte) ? 0xFF : 0;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_MATCH_SIMD
+
+static void match_byte_sse2(__u8 *ok, const __u8 *col, const __u8 *len,
+			    __u64 n, const struct cond *c)
+{
+	__m128i mask = _mm_set1_epi8(c->mask);
+	__m128i value = _mm_set1_epi8(c->value);
+	__m128i byte = _mm_set1_epi8(c->byte);
+	__m128i m;
+	__u64 i;
+
+	/* lengths are at most 64, so signed compares are fine */
+	for (i = 0; i + 16 <= n; i += 16) {
+		m = _mm_cmpeq_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i *)(col + i)), mask), value);
+		m = _mm_and_si128(m, _mm_cmpgt_epi8(_mm_loadu_si128((const __m128i *)(len + i)), byte));
+		m = _mm_and_si128(m, _mm_loadu_si128((const __m128i *)(ok + i)));
+		_mm_storeu_si128((__m128i *)(ok + i), m);
+	}
+	match_byte_scalar(ok + i, col + i, len + i, n - i, c);
+}
+
+__attribute__((target("avx2")))
+static void match_byte_avx2(__u8 *ok, const __u8 *col, const __u8 *len,
+			    __u64 n, const struct cond *c)
+{
+	__m256i mask = _mm256_set1_epi8(c->mask);
+	__m256i value = _mm256_set1_epi8(c->value);
+	__m256i byte = _mm256_set1_epi8(c->byte);
+	__m256i m;
+	__u64 i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		m = _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)(col + i)), mask), value);
+		m = _mm256_and_si256(m, _mm256_cmpgt_epi8(_mm256_loadu_si256((const __m256i *)(len + i)), byte));
+		m = _mm256_and_si256(m, _mm256_loadu_si256((const __m256i *)(ok + i)));
+		_mm256_storeu_si256((__m256i *)(ok + i), m);
+	}
+	match_byte_scalar(ok + i, col + i, len + i, n - i, c);
+}
+#endif
+
+static void print_frame(const struct logcol *c, const struct logcol_id *id,
+			__u64 row)
+{
+	char line[CANLOG_LINESZ];
+	struct canfd_frame cf;
+	__u8 flags = logcol_flags(c, id)[row];
+	int b;
+
+	memset(&cf, 0, sizeof(cf));
+	cf.can_id = id->can_id;
+	cf.len = logcol_len(c, id)[row];
+	cf.flags = flags & 0x0F;
+	for (b = 0; b < cf.len; b++)
+		cf.data[b] = logcol_byte(c, id, b)[row];
+
+	canlog_sprint_line(line, logcol_ts(c, id)[row], c->hdr->ifname[id->ifindex],
+			   &cf, (flags & CANLOG_FLAG_FD) ? CANFD_MTU : CAN_MTU);
+	fputs(line, stdout);
+}
+
+static int cmp_hit(const void *a, const void *b)
+{
+	const struct hit *ha = a, *hb = b;
+
+	if (ha->ts != hb->ts)
+		return ha->ts < hb->ts ? -1 : 1;
+	/* IDs and rows are in file order, keeps the sort stable */
+	if (ha->id != hb->id)
+		return ha->id < hb->id ? -1 : 1;
+	return (ha->row > hb->row) - (ha->row < hb->row);
+}
+
+int main(int argc, char **argv)
+{
+	struct logcol c;
+	const struct logcol_id *id;
+	const char *start_time = NULL, *end_time = NULL;
+	int by_time = 0, count_only = 0, verbose = 0;
+	__u64 from = 0, to = ~0ULL, lo, hi, row, n;
+	__u64 scanned = 0, matched = 0, n_hits = 0, alloc_hits = 0;
+	__u8 *ok = NULL;
+	size_t ok_size = 0;
+	struct hit *hits = NULL, *p;
+	unsigned int i;
+	int opt, k;
+	double start;
+
+	while ((opt = getopt(argc, argv, "i:s:e:m:tcvh?")) != -1) {
+		switch (opt) {
+		case 'i':
+			if (parse_ids(optarg))
+				usage("Invalid CAN ID list");
+			break;
+		case 's':
+			start_time = optarg;
+			break;
+		case 'e':
+			end_time = optarg;
+			break;
+		case 'm':
+			if (parse_cond(optarg))
+				usage("Invalid byte match");
+			break;
+		case 't':
+			by_time = 1;
+			break;
+		case 'c':
+			count_only = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(NULL);
+			break;
+		}
+	}
+
+	if (optind != argc - 1)
+		usage("You must specify a column store");
+
+	if (logcol_open(&c, argv[optind])) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	if (start_time && parse_time(start_time, c.hdr->first_ts, &from))
+		usage("Invalid start time");
+	if (end_time && parse_time(end_time, c.hdr->first_ts, &to))
+		usage("Invalid end time");
+
+#ifdef HAVE_MATCH_SIMD
+	match_byte = __builtin_cpu_supports("avx2") ? match_byte_avx2 : match_byte_sse2;
+#else
+	match_byte = match_byte_scalar;
+#endif
+
+	start = now();
+	for (i = 0; i < c.hdr->n_ids; i++) {
+		id = &c.ids[i];
+		if (!selected(id->can_id))
+			continue;
+
+		logcol_range(&c, id, from, to, &lo, &hi);
+		n = hi - lo;
+		scanned += n;
+		if (!n)
+			continue;
+
+		if (n > ok_size) {
+			free(ok);
+			ok_size = n;
+			ok = malloc(ok_size);
+			if (!ok) {
+				perror("malloc");
+				return 1;
+			}
+		}
+		memset(ok, 0xFF, n);
+
+		for (k = 0; k < n_conds; k++) {
+			if (conds[k].byte >= id->width) {
+				memset(ok, 0, n);
+				break;
+			}
+			match_byte(ok, logcol_byte(&c, id, conds[k].byte) + lo,
+				   logcol_len(&c, id) + lo, n, &conds[k]);
+		}
+
+		n = 0;
+		for (row = lo; row < hi; row++) {
+			if (!ok[row - lo])
+				continue;
+			n++;
+			if (count_only)
+				continue;
+			if (!by_time) {
+				print_frame(&c, id, row);
+				continue;
+			}
+			if (n_hits == alloc_hits) {
+				alloc_hits = alloc_hits ? 2 * alloc_hits : 1024;
+				p = realloc(hits, alloc_hits * sizeof(*hits));
+				if (!p) {
+					perror("realloc");
+					return 1;
+				}
+				hits = p;
+			}
+			hits[n_hits].ts = logcol_ts(&c, id)[row];
+			hits[n_hits].id = id;
+			hits[n_hits++].row = row;
+		}
+		matched += n;
+
+		if (count_only && n)
+			printf("%s %0*X %llu\n", c.hdr->ifname[id->ifindex],
+			       (id->can_id & CAN_EFF_FLAG) ? 8 : 3,
+			       id->can_id & CAN_EFF_MASK, (unsigned long long)n);
+	}
+
+	if (by_time) {
+		qsort(hits, n_hits, sizeof(*hits), cmp_hit);
+		for (row = 0; row < n_hits; row++)
+			print_frame(&c, hits[row].id, hits[row].row);
+	}
+
+	if (verbose)
+		fprintf(stderr, "%llu of %llu frames in range matched, %llu frames in the log, %.3f s\n",
+			(unsigned long long)matched, (unsigned long long)scanned,
+			(unsigned long long)c.hdr->n_frames, now() - start);
+
+	free(ok);
+	free(hits);
+	logcol_close(&c);
+
+	return 0;
+}
@@ -0,0 +1,447 @@
+/*
+ * canreplay.c - replay a CAN log in real time, optionally from any point
+ *
+ * Usage: ./canreplay [-t time] [-k] [-s speed | -a | -r rate] [-d ifname] [-n]
+ *                    [-X] [-v] <log> [log...]
+ *
+ * Reads candump text logs and binary logs (see canlog.h).  Several logs,
+ * e.g. one per interface, are merged in timestamp order (see logmerge.h).
+ * With -t the replay starts at the given time: the sparse index of each
+ * log (see logindex.h) is used to jump close to it, and the last frame of
+ * every CAN ID seen before that point is sent first so receivers start out
+ * in the right state.
+ *
+ * Frames are sent with their recorded timing, scaled by -s, as fast as the
+ * socket takes them with -a, or re-timed to a fixed rate with -r.  The
+ * achieved frame rate and percentiles of the send time error (how late
+ * each frame went out, or how long the socket blocked with -a) are printed
+ * at the end.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logreader.h"
+#include "logindex.h"
+#include "logmerge.h"
+#include "loghist.h"
+
+#define MODE_TIMED	0	/* recorded timing times speed */
+#define MODE_FAST	1	/* as fast as possible */
+#define MODE_RATE	2	/* fixed frame rate */
+
+static int sockets[CANLOG_MAX_IFACES];
+static char *devname;
+static int dry_run, verbose;
+static __u64 hist[LOGHIST_BUCKETS];
+
+static void usage(char *msg)
+{
+	if (msg)
+		fprintf(stderr, "%s\n", msg);
+	fprintf(stderr, "Usage: canreplay [options] <log> [log...]\n");
+	fprintf(stderr, "\t-t\tstart at TIME, seconds since the epoch or +SECONDS from the log start\n");
+	fprintf(stderr, "\t-k\tdo not send the last known frame of every CAN ID before starting\n");
+	fprintf(stderr, "\t-s\treplay SPEED times faster, 0.1 to 100 (default: 1)\n");
+	fprintf(stderr, "\t-a\treplay as fast as the interface takes the frames\n");
+	fprintf(stderr, "\t-r\treplay at RATE frames per second, ignoring the recorded timing\n");
+	fprintf(stderr, "\t-d\tsend everything to this interface instead of the logged ones\n");
+	fprintf(stderr, "\t-n\tdry run, print frames instead of sending them\n");
+	fprintf(stderr, "\t-X\tdo not write the <log>.idx index file\n");
+	fprintf(stderr, "\t-v\tverbose\n");
+	exit(1);
+}
+
+static __u64 mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(__u64 ns)
+{
+	struct timespec ts = { ns / 1000000000ULL, ns % 1000000000ULL };
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+static int open_socket(const char *ifname)
+{
+	struct sockaddr_can addr;
+	struct ifreq ifr;
+	int s, enable_canfd = 1;
+
+	if ((s = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+		perror(ifname);
+		close(s);
+		return -1;
+	}
+
+	/* CAN FD frames are sent as they are, fails on CAN 2.0 only kernels */
+	setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable_canfd, sizeof(enable_canfd));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifr.ifr_ifindex;
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("bind");
+		close(s);
+		return -1;
+	}
+
+	return s;
+}
+
+static int send_rec(struct logmerge *m, const struct canlog_rec *rec)
+{
+	char line[CANLOG_LINESZ];
+	struct canfd_frame cf;
+	const char *ifname;
+	int mtu, i;
+
+	mtu = canlog_rec2frame(rec, &cf);
+	ifname = devname ? devname : logmerge_ifname(m, rec->ifindex);
+
+	if (dry_run) {
+		canlog_sprint_line(line, rec->ts_ns, ifname, &cf, mtu);
+		fputs(line, stdout);
+		return 0;
+	}
+
+	i = devname ? 0 : rec->ifindex;
+	if (!sockets[i]) {
+		sockets[i] = open_socket(ifname);
+		if (sockets[i] < 0)
+			return -1;
+	}
+
+	while (write(sockets[i], &cf, mtu) != mtu) {
+		if (errno == ENOBUFS) {
+			/* tx queue full, wait until the driver has room again */
+			struct pollfd pfd = { .fd = sockets[i], .events = POLLOUT };
+
+			poll(&pfd, 1, 1);
+			continue;
+		}
+		perror("write");
+		return -1;
+	}
+
+	return 0;
+}
+
+/* parses "+SECONDS" relative to first_ns or "SECONDS" since the epoch */
+static int parse_time(const char *s, __u64 first_ns, __u64 *ts_ns)
+{
+	char *end;
+	double t;
+
+	t = strtod(s + (*s == '+'), &end);
+	if (end == s || *end || t < 0)
+		return -1;
+
+	*ts_ns = (__u64)(t * 1e9);
+	if (*s == '+')
+		*ts_ns += first_ns;
+
+	return 0;
+}
+
+struct state_frame {
+	const struct canlog_rec *rec;
+	int src;
+};
+
+static int cmp_state(const void *a, const void *b)
+{
+	const struct state_frame *fa = a, *fb = b;
+
+	return (fa->rec->ts_ns > fb->rec->ts_ns) - (fa->rec->ts_ns < fb->rec->ts_ns);
+}
+
+/* sends the last frame of every ID of all logs in timestamp order */
+static int send_state(struct logmerge *m, struct logstate *state)
+{
+	union {
+		struct canlog_rec rec;
+		__u8 buf[CANLOG_REC_CANFD];
+	} u;
+	const struct canlog_rec **list;
+	struct state_frame *all;
+	unsigned int i, n = 0;
+	int src, idx, ret = 0;
+
+	for (src = 0; src < m->n; src++)
+		n += state[src].tab.count;
+	all = malloc((n + 1) * sizeof(*all));
+	if (!all) {
+		perror("malloc");
+		return -1;
+	}
+
+	for (n = 0, src = 0; src < m->n; src++) {
+		list = logstate_list(&state[src]);
+		if (!list) {
+			perror("malloc");
+			free(all);
+			return -1;
+		}
+		for (i = 0; i < state[src].tab.count; i++) {
+			all[n].rec = list[i];
+			all[n++].src = src;
+		}
+		free(list);
+	}
+	qsort(all, n, sizeof(*all), cmp_state);
+
+	for (i = 0; i < n && !ret; i++) {
+		memcpy(&u.rec, all[i].rec, sizeof(u.rec) + all[i].rec->len);
+		idx = logmerge_ifindex(m, all[i].src, all[i].rec->ifindex);
+		if (idx < 0)
+			continue;
+		u.rec.ifindex = idx;
+		ret = send_rec(m, &u.rec);
+	}
+	if (verbose)
+		fprintf(stderr, "sent the last frame of %u CAN IDs\n", n);
+	free(all);
+
+	return ret;
+}
+
+/* positions every log at ts, see parse_time() */
+static int seek_logs(struct logmerge *m, char **paths, const char *start_time,
+		     int save_index, struct logstate *state)
+{
+	const struct canlog_rec *rec;
+	struct logreader *lr;
+	struct logindex idx;
+	__u64 first = ~0ULL, ts_ns;
+	int i, ret;
+
+	for (i = 0; i < m->n; i++) {
+		lr = logmerge_reader(m, i);
+		rec = logreader_next(lr);
+		if (rec && rec->ts_ns < first)
+			first = rec->ts_ns;
+	}
+	if (first == ~0ULL) {
+		fprintf(stderr, "no frames to replay\n");
+		return -1;
+	}
+	if (parse_time(start_time, first, &ts_ns))
+		usage("Invalid start time");
+
+	for (i = 0; i < m->n; i++) {
+		lr = logmerge_reader(m, i);
+		ret = logindex_open(&idx, lr, paths[i], save_index);
+		if (ret < 0) {
+			perror(paths[i]);
+			return -1;
+		}
+		if (verbose)
+			fprintf(stderr, "%s: %s index with %llu entries\n", paths[i],
+				ret ? "built" : "loaded",
+				(unsigned long long)idx.hdr.n_entries);
+
+		ret = logindex_seek(&idx, lr, ts_ns, state ? &state[i] : NULL);
+		logindex_free(&idx);
+		if (ret) {
+			perror(paths[i]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void print_stats(int mode, __u64 frames, __u64 elapsed, __u64 max)
+{
+	static const double pct[] = { 50, 90, 99, 99.9 };
+	unsigned int i;
+
+	fprintf(stderr, "replayed %llu frames in %.3f s, %.0f frames/s\n",
+		(unsigned long long)frames, elapsed / 1e9,
+		elapsed ? frames * 1e9 / elapsed : 0.0);
+	if (!frames)
+		return;
+
+	fprintf(stderr, "%s:", mode == MODE_FAST ? "send time" : "timing error");
+	for (i = 0; i < sizeof(pct) / sizeof(pct[0]); i++)
+		fprintf(stderr, " p%g %.1f us", pct[i],
+			loghist_percentile(hist, frames, pct[i]) / 1e3);
+	fprintf(stderr, " max %.1f us\n", max / 1e3);
+}
+
+/*
+ * Sends every frame at its target time: the recorded offset from the first
+ * frame divided by speed, or i / rate for a fixed rate.  The error is how
+ * late the frame was handed to the socket; with -a it is the time the
+ * socket took, which shows the back-pressure of the interface.
+ */
+static int replay(struct logmerge *m, int mode, double speed, double rate)
+{
+	const struct canlog_rec *rec;
+	__u64 start = 0, log_start = 0, frames = 0, target = 0, t, err, max = 0;
+
+	memset(hist, 0, sizeof(hist));
+
+	/* the default 50 us timer slack would dominate the timing error */
+	prctl(PR_SET_TIMERSLACK, 1UL);
+
+	while ((rec = logmerge_next(m))) {
+		if (!frames) {
+			start = mono_ns();
+			log_start = rec->ts_ns;
+		}
+
+		if (mode == MODE_TIMED)
+			target = start + (rec->ts_ns > log_start ?
+					  (__u64)((rec->ts_ns - log_start) / speed) : 0);
+		else if (mode == MODE_RATE)
+			target = start + (__u64)(frames * 1e9 / rate);
+
+		t = mono_ns();
+		if (mode != MODE_FAST && target > t) {
+			sleep_until(target);
+			t = mono_ns();
+		}
+		if (mode == MODE_FAST)
+			target = t;
+
+		if (send_rec(m, rec))
+			return 1;
+
+		err = (mode == MODE_FAST ? mono_ns() : t) - target;
+		hist[loghist_bucket(err)]++;
+		if (err > max)
+			max = err;
+		frames++;
+	}
+
+	print_stats(mode, frames, frames ? mono_ns() - start : 0, max);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct logmerge m;
+	struct logstate *state = NULL;
+	char *start_time = NULL, *end;
+	int send_snapshot = 1, save_index = 1, mode = MODE_TIMED;
+	double speed = 1.0, rate = 0;
+	int opt, ret = 1, i;
+
+	while ((opt = getopt(argc, argv, "t:ks:ar:d:nXvh?")) != -1) {
+		switch (opt) {
+		case 't':
+			start_time = optarg;
+			break;
+		case 'k':
+			send_snapshot = 0;
+			break;
+		case 's':
+			speed = strtod(optarg, &end);
+			if (end == optarg || *end || speed < 0.1 || speed > 100)
+				usage("Speed must be between 0.1 and 100");
+			mode = MODE_TIMED;
+			break;
+		case 'a':
+			mode = MODE_FAST;
+			break;
+		case 'r':
+			rate = strtod(optarg, &end);
+			if (end == optarg || *end || rate <= 0)
+				usage("Invalid frame rate");
+			mode = MODE_RATE;
+			break;
+		case 'd':
+			devname = optarg;
+			break;
+		case 'n':
+			dry_run = 1;
+			break;
+		case 'X':
+			save_index = 0;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(NULL);
+			break;
+		}
+	}
+
+	if (optind >= argc)
+		usage("You must specify a log");
+
+	logmerge_init(&m);
+	for (i = optind; i < argc; i++) {
+		if (logmerge_add(&m, argv[i])) {
+			perror(argv[i]);
+			goto out;
+		}
+	}
+
+	if (start_time) {
+		if (send_snapshot) {
+			state = calloc(m.n, sizeof(*state));
+			if (!state) {
+				perror("calloc");
+				goto out;
+			}
+			for (i = 0; i < m.n; i++)
+				logstate_init(&state[i]);
+		}
+		if (seek_logs(&m, argv + optind, start_time, save_index, state))
+			goto out;
+		if (state && send_state(&m, state))
+			goto out;
+	}
+
+	ret = replay(&m, mode, speed, rate);
+
+	if (logmerge_bad_lines(&m))
+		fprintf(stderr, "skipped %lu malformed lines\n", logmerge_bad_lines(&m));
+
+out:
+	for (i = 0; i < CANLOG_MAX_IFACES; i++)
+		if (sockets[i] > 0)
+			close(sockets[i]);
+	if (state) {
+		for (i = 0; i < m.n; i++)
+			logstate_free(&state[i]);
+		free(state);
+	}
+	logmerge_close(&m);
+
+	return ret;
+}
@@ -0,0 +1,217 @@
+/*
+ * canshm.c - last value per CAN ID in shared memory
+ *
+ * See canshm.h for the interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/can.h>
+
+#include "canshm.h"
+
+static inline unsigned int slot_of(canid_t can_id)
+{
+	return ((__u64)can_id * 0x9E3779B97F4A7C15ULL >> 32) & (CANSHM_SLOTS - 1);
+}
+
+static size_t shm_size(void)
+{
+	return sizeof(struct canshm_header) +
+	       CANSHM_SLOTS * sizeof(struct canshm_entry);
+}
+
+static void shm_name(struct canshm *shm, const char *ifname)
+{
+	snprintf(shm->name, sizeof(shm->name), "/icsim-%s", ifname);
+}
+
+int canshm_create(struct canshm *shm, const char *ifname)
+{
+	void *map;
+	int fd;
+
+	memset(shm, 0, sizeof(*shm));
+	shm_name(shm, ifname);
+	shm->size = shm_size();
+	shm->writer = 1;
+
+	/* a segment left over by a crashed writer is started afresh */
+	shm_unlink(shm->name);
+	fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		return -1;
+	if (ftruncate(fd, shm->size)) {
+		close(fd);
+		shm_unlink(shm->name);
+		return -1;
+	}
+
+	map = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		shm_unlink(shm->name);
+		return -1;
+	}
+
+	shm->hdr = map;
+	shm->ent = (struct canshm_entry *)(shm->hdr + 1);
+
+	/* the segment is zero filled, only the header needs values */
+	shm->hdr->version = CANSHM_VERSION;
+	shm->hdr->n_slots = CANSHM_SLOTS;
+	shm->hdr->entry_size = sizeof(struct canshm_entry);
+	shm->hdr->writer_pid = getpid();
+	strncpy(shm->hdr->ifname, ifname, IFNAMSIZ - 1);
+	atomic_thread_fence(memory_order_release);
+	memcpy(shm->hdr->magic, CANSHM_MAGIC, sizeof(shm->hdr->magic));
+
+	return 0;
+}
+
+int canshm_attach(struct canshm *shm, const char *ifname)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	memset(shm, 0, sizeof(*shm));
+	shm_name(shm, ifname);
+	shm->size = shm_size();
+
+	fd = shm_open(shm->name, O_RDONLY, 0);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	if ((size_t)st.st_size != shm->size) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+
+	map = mmap(NULL, shm->size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+
+	shm->hdr = map;
+	shm->ent = (struct canshm_entry *)(shm->hdr + 1);
+
+	if (memcmp(shm->hdr->magic, CANSHM_MAGIC, sizeof(shm->hdr->magic)) ||
+	    shm->hdr->version != CANSHM_VERSION ||
+	    shm->hdr->n_slots != CANSHM_SLOTS ||
+	    shm->hdr->entry_size != sizeof(struct canshm_entry)) {
+		canshm_close(shm);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+void canshm_update(struct canshm *shm, const struct canfd_frame *cf, int mtu,
+		   __u64 ts_ns)
+{
+	unsigned int i = slot_of(cf->can_id), n;
+	struct canshm_entry *e;
+	__u8 flags = mtu == CANFD_MTU ? cf->flags | CANFD_FDF : 0;
+	__u32 seq;
+
+	atomic_fetch_add_explicit(&shm->hdr->frames, 1, memory_order_relaxed);
+
+	for (n = 0; n < CANSHM_SLOTS; n++, i = (i + 1) & (CANSHM_SLOTS - 1)) {
+		e = &shm->ent[i];
+		if (!atomic_load_explicit(&e->used, memory_order_relaxed)) {
+			/* readers only look at the entry once used is set */
+			e->can_id = cf->can_id;
+			e->len = cf->len;
+			e->flags = flags;
+			e->ts_ns = ts_ns;
+			e->count = 1;
+			memcpy(e->data, cf->data, cf->len);
+			atomic_store_explicit(&e->used, 1, memory_order_release);
+			atomic_fetch_add_explicit(&shm->hdr->n_ids, 1, memory_order_relaxed);
+			return;
+		}
+		if (e->can_id == cf->can_id)
+			break;
+	}
+	if (n == CANSHM_SLOTS) {
+		atomic_fetch_add_explicit(&shm->hdr->full, 1, memory_order_relaxed);
+		return;
+	}
+
+	seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+	atomic_store_explicit(&e->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	if (e->len != cf->len || e->flags != flags ||
+	    memcmp(e->data, cf->data, cf->len))
+		e->changes++;
+	e->len = cf->len;
+	e->flags = flags;
+	e->ts_ns = ts_ns;
+	e->count++;
+	memcpy(e->data, cf->data, cf->len);
+
+	atomic_store_explicit(&e->seq, seq + 2, memory_order_release);
+}
+
+int canshm_read(const struct canshm *shm, unsigned int slot,
+		struct canshm_entry *e)
+{
+	struct canshm_entry *src = &shm->ent[slot];
+	__u32 s1, s2;
+
+	if (!atomic_load_explicit(&src->used, memory_order_acquire))
+		return 0;
+
+	do {
+		s1 = atomic_load_explicit(&src->seq, memory_order_acquire);
+		if (s1 & 1)
+			continue;
+		memcpy(e, src, sizeof(*e));
+		atomic_thread_fence(memory_order_acquire);
+		s2 = atomic_load_explicit(&src->seq, memory_order_relaxed);
+		if (s1 == s2)
+			break;
+	} while (1);
+
+	return 1;
+}
+
+int canshm_lookup(const struct canshm *shm, canid_t can_id,
+		  struct canshm_entry *e)
+{
+	unsigned int i = slot_of(can_id), n;
+
+	for (n = 0; n < CANSHM_SLOTS; n++, i = (i + 1) & (CANSHM_SLOTS - 1)) {
+		if (!canshm_read(shm, i, e))
+			return 0;
+		if (e->can_id == can_id)
+			return 1;
+	}
+
+	return 0;
+}
+
+void canshm_close(struct canshm *shm)
+{
+	if (!shm->hdr)
+		return;
+
+	munmap(shm->hdr, shm->size);
+	if (shm->writer)
+		shm_unlink(shm->name);
+	shm->hdr = NULL;
+}
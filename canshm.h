@@ -0,0 +1,103 @@
+/*
+ * canshm.h - last value per CAN ID in shared memory
+ *
+ * The receiver of an interface keeps, for every CAN ID it has seen, the
+ * last payload, its receive time, the number of frames and the number of
+ * payload changes in a POSIX shared memory segment "/icsim-<ifname>".
+ * Any number of local readers map it read-only and poll the current bus
+ * state without syscalls and without opening sockets of their own.
+ *
+ * Entries live in an open addressing table of CANSHM_SLOTS slots that is
+ * never shrunk: once an ID got a slot it keeps it, so readers can remember
+ * where an ID is.  Every entry is guarded by its own seqlock: the writer
+ * makes seq odd, updates the entry and makes seq even again, a reader
+ * copies the entry and retries when seq was odd or changed meanwhile.
+ * There is exactly one writer per segment.
+ */
+
+#ifndef CANSHM_H
+#define CANSHM_H
+
+#include <stdatomic.h>
+#include <linux/types.h>
+#include <linux/can.h>
+#include <net/if.h>
+
+#define CANSHM_MAGIC		"ICSIMSHM"
+#define CANSHM_VERSION		1
+#define CANSHM_SLOTS		4096	/* power of two */
+#define CANSHM_NAMESZ		(IFNAMSIZ + 8)
+
+struct canshm_entry {
+	_Atomic __u32 seq;	/* odd while the writer updates the entry */
+	_Atomic __u32 used;	/* set once, after can_id is valid */
+	canid_t can_id;		/* including CAN_*_FLAG bits */
+	__u8 len;
+	__u8 flags;		/* canfd_frame.flags, CANFD_FDF for CAN FD */
+	__u16 __res;
+	__u64 ts_ns;		/* last receive time, ns since the epoch */
+	__u64 count;		/* frames received */
+	__u64 changes;		/* frames whose payload differed from the last */
+	__u8 data[CANFD_MAX_DLEN];
+} __attribute__((aligned(64)));
+
+struct canshm_header {
+	char magic[8];		/* CANSHM_MAGIC, not terminated */
+	__u16 version;		/* CANSHM_VERSION */
+	__u16 __res0;
+	__u32 n_slots;		/* CANSHM_SLOTS */
+	__u32 entry_size;	/* sizeof(struct canshm_entry) */
+	__u32 writer_pid;
+	char ifname[IFNAMSIZ];
+	_Atomic __u64 frames;	/* all frames received */
+	_Atomic __u32 n_ids;	/* slots in use */
+	_Atomic __u32 full;	/* frames of new IDs dropped, table full */
+} __attribute__((aligned(64)));
+
+struct canshm {
+	char name[CANSHM_NAMESZ];
+	struct canshm_header *hdr;
+	struct canshm_entry *ent;
+	size_t size;
+	int writer;
+};
+
+int canshm_create(struct canshm *shm, const char *ifname);
+/*
+ * Creates (or takes over) the segment of ifname for writing.
+ * Return values: 0 = success, -1 = error (errno set)
+ */
+
+int canshm_attach(struct canshm *shm, const char *ifname);
+/*
+ * Maps the segment of ifname read-only.
+ * Return values: 0 = success, -1 = error (errno set, EINVAL on a segment
+ * of another version)
+ */
+
+void canshm_update(struct canshm *shm, const struct canfd_frame *cf, int mtu,
+		   __u64 ts_ns);
+/*
+ * Records a frame received with the given MTU.  Writer only.
+ */
+
+int canshm_read(const struct canshm *shm, unsigned int slot,
+		struct canshm_entry *e);
+/*
+ * Copies a consistent snapshot of slot (0 .. CANSHM_SLOTS - 1) into e.
+ * Return values: 1 = copied, 0 = slot unused
+ */
+
+int canshm_lookup(const struct canshm *shm, canid_t can_id,
+		  struct canshm_entry *e);
+/*
+ * Copies a consistent snapshot of the entry of can_id into e.
+ * Return values: 1 = found, 0 = not seen yet
+ */
+
+void canshm_close(struct canshm *shm);
+/*
+ * Unmaps the segment, the writer also removes it.
+ */
+
+#endif
@@ -0,0 +1,471 @@
+/*
+ * canstat.c - per CAN ID statistics over large captures
+ *
+ * Usage: ./canstat [-c] [-j threads] [-o outfile] [-v] <log>
+ *
+ * Reports for every (interface, CAN ID) of a candump text log or binary
+ * log (see canlog.h) the frame count, the period with its jitter, the
+ * payload length histogram and how often each byte and bit changed.
+ *
+ * The log is split into one slice per thread (see logreader_split()).
+ * Every thread fills its own table, the tables are merged in log order
+ * afterwards, so no locking is needed and the work scales with the cores.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logreader.h"
+#include "idtable.h"
+
+#define MAX_THREADS	64
+
+struct idstat {
+	__u64 key;		/* (ifindex + 1) << 32 | can_id, 0 = free slot */
+	__u64 count;
+	__u64 first_ts, last_ts;
+
+	/* period between frames in ns, Welford mean / sum of squares */
+	__u64 n_per, min_per, max_per;
+	double mean, m2;
+
+	__u32 len_hist[CANFD_MAX_DLEN + 1];
+	__u32 byte_chg[CANFD_MAX_DLEN];
+	__u32 bit_chg[CANFD_MAX_DLEN * 8]; /* bit 7 of byte 0 first */
+
+	__u8 first_len, last_len;
+	__u8 first[CANFD_MAX_DLEN];
+	__u8 last[CANFD_MAX_DLEN];
+};
+
+struct worker {
+	pthread_t thread;
+	struct logreader *lr;
+	struct idtable tab;	/* of struct idstat */
+	__u64 frames;
+	int err;
+};
+
+static int verbose;
+
+static void usage(char *msg)
+{
+	if (msg)
+		fprintf(stderr, "%s\n", msg);
+	fprintf(stderr, "Usage: canstat [options] <log>\n");
+	fprintf(stderr, "\t-c\twrite CSV instead of the text report\n");
+	fprintf(stderr, "\t-j\tworker threads (default: number of CPUs)\n");
+	fprintf(stderr, "\t-o\twrite the report to a file instead of stdout\n");
+	fprintf(stderr, "\t-v\tprint timing to stderr\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_period(struct idstat *s, __u64 per)
+{
+	double d = per - s->mean;
+
+	if (!s->n_per || per < s->min_per)
+		s->min_per = per;
+	if (per > s->max_per)
+		s->max_per = per;
+	s->n_per++;
+	s->mean += d / s->n_per;
+	s->m2 += d * (per - s->mean);
+}
+
+static void add_changes(struct idstat *s, const __u8 *old, int old_len,
+			const __u8 *data, int len)
+{
+	int i, n = old_len < len ? old_len : len;
+	unsigned int x;
+
+	for (i = 0; i < n; i++) {
+		x = old[i] ^ data[i];
+		if (!x)
+			continue;
+		s->byte_chg[i]++;
+		while (x) {
+			s->bit_chg[i * 8 + 7 - __builtin_ctz(x)]++;
+			x &= x - 1;
+		}
+	}
+}
+
+static void update(struct idstat *s, const struct canlog_rec *rec)
+{
+	int len = rec->len > CANFD_MAX_DLEN ? CANFD_MAX_DLEN : rec->len;
+
+	if (!s->count) {
+		s->first_ts = rec->ts_ns;
+		s->first_len = len;
+		memcpy(s->first, rec->data, len);
+	} else {
+		add_period(s, rec->ts_ns > s->last_ts ? rec->ts_ns - s->last_ts : 0);
+		add_changes(s, s->last, s->last_len, rec->data, len);
+	}
+
+	s->count++;
+	s->last_ts = rec->ts_ns;
+	s->len_hist[len]++;
+	s->last_len = len;
+	memcpy(s->last, rec->data, len);
+}
+
+static void *work(void *arg)
+{
+	struct worker *w = arg;
+	const struct canlog_rec *rec;
+	struct idstat *s;
+
+	while ((rec = logreader_next(w->lr))) {
+		s = idtable_get(&w->tab, idtable_key(rec->ifindex, rec->can_id));
+		if (!s) {
+			w->err = ENOMEM;
+			break;
+		}
+		update(s, rec);
+		w->frames++;
+	}
+
+	return NULL;
+}
+
+/* appends b, which directly follows a in the log, to a */
+static void merge(struct idstat *a, const struct idstat *b)
+{
+	double d, n;
+	int i;
+
+	if (!a->count) {
+		__u64 key = a->key;
+
+		*a = *b;
+		a->key = key;
+		return;
+	}
+
+	/* the frame pair across the slice border */
+	add_period(a, b->first_ts > a->last_ts ? b->first_ts - a->last_ts : 0);
+	add_changes(a, a->last, a->last_len, b->first, b->first_len);
+
+	if (b->n_per) {
+		n = a->n_per + b->n_per;
+		d = b->mean - a->mean;
+		a->m2 += b->m2 + d * d * a->n_per * b->n_per / n;
+		a->mean += d * b->n_per / n;
+		a->n_per += b->n_per;
+		if (b->min_per < a->min_per)
+			a->min_per = b->min_per;
+		if (b->max_per > a->max_per)
+			a->max_per = b->max_per;
+	}
+
+	for (i = 0; i <= CANFD_MAX_DLEN; i++)
+		a->len_hist[i] += b->len_hist[i];
+	for (i = 0; i < CANFD_MAX_DLEN; i++)
+		a->byte_chg[i] += b->byte_chg[i];
+	for (i = 0; i < CANFD_MAX_DLEN * 8; i++)
+		a->bit_chg[i] += b->bit_chg[i];
+
+	a->count += b->count;
+	a->last_ts = b->last_ts;
+	a->last_len = b->last_len;
+	memcpy(a->last, b->last, b->last_len);
+}
+
+static int cmp_name(const void *a, const void *b)
+{
+	return strncmp(a, b, IFNAMSIZ);
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+	const struct idstat *sa = *(const struct idstat **)a;
+	const struct idstat *sb = *(const struct idstat **)b;
+
+	return (sa->key > sb->key) - (sa->key < sb->key);
+}
+
+static inline double ms(double ns)
+{
+	return ns / 1e6;
+}
+
+static double jitter(const struct idstat *s)
+{
+	return s->n_per > 1 ? sqrt(s->m2 / (s->n_per - 1)) : 0.0;
+}
+
+/* widest payload seen */
+static int max_len(const struct idstat *s)
+{
+	int i;
+
+	for (i = CANFD_MAX_DLEN; i > 0; i--)
+		if (s->len_hist[i])
+			break;
+	return i;
+}
+
+/*
+ * One character per byte: '.' never changed, '1'..'9' changed in up to
+ * 10%..90% of the frames, '*' in more than that.
+ */
+static void sprint_bytes(char *buf, const struct idstat *s, int len)
+{
+	double r;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		r = s->count > 1 ? (double)s->byte_chg[i] / (s->count - 1) : 0.0;
+		if (!s->byte_chg[i])
+			buf[i] = '.';
+		else if (r > 0.9)
+			buf[i] = '*';
+		else
+			buf[i] = '1' + (int)(r * 10);
+	}
+	buf[i] = 0;
+}
+
+static void print_text(FILE *fp, struct canlog_header *ifs, struct idstat **list,
+		       unsigned int n)
+{
+	char bytes[CANFD_MAX_DLEN + 1];
+	const struct idstat *s;
+	unsigned int i;
+	int j, len;
+
+	fprintf(fp, "%-8s %8s %9s %10s %10s %10s %10s  %-12s %s\n",
+		"iface", "id", "frames", "period ms", "jitter ms", "min ms",
+		"max ms", "lengths", "changes/bits");
+	for (i = 0; i < n; i++) {
+		s = list[i];
+		len = max_len(s);
+		fprintf(fp, "%-8s %8X %9llu %10.3f %10.3f %10.3f %10.3f  ",
+			ifs->ifname[(s->key >> 32) - 1], (unsigned int)(s->key & 0xFFFFFFFF),
+			(unsigned long long)s->count, ms(s->mean), ms(jitter(s)),
+			ms(s->min_per), ms(s->max_per));
+
+		/* the dominant length, '+' when there are others */
+		for (j = 0; j <= CANFD_MAX_DLEN; j++)
+			if (s->len_hist[j] > s->len_hist[len])
+				len = j;
+		fprintf(fp, "%2d%-10s  ", len, s->len_hist[len] == s->count ? "" : "+");
+
+		len = max_len(s);
+		sprint_bytes(bytes, s, len);
+		fprintf(fp, "%s ", bytes);
+		for (j = 0; j < len * 8; j++) {
+			if (!(j % 8))
+				fputc(' ', fp);
+			fputc(s->bit_chg[j] ? 'x' : '.', fp);
+		}
+		fputc('\n', fp);
+	}
+}
+
+static void print_csv(FILE *fp, struct canlog_header *ifs, struct idstat **list,
+		      unsigned int n)
+{
+	const struct idstat *s;
+	unsigned int i;
+	int j, len, sep;
+
+	fprintf(fp, "iface,id,frames,first_ts,last_ts,period_ms,jitter_ms,min_ms,max_ms,"
+		"lengths,byte_changes,bit_changes\n");
+	for (i = 0; i < n; i++) {
+		s = list[i];
+		len = max_len(s);
+		fprintf(fp, "%s,%X,%llu,%llu.%09llu,%llu.%09llu,%.6f,%.6f,%.6f,%.6f,",
+			ifs->ifname[(s->key >> 32) - 1], (unsigned int)(s->key & 0xFFFFFFFF),
+			(unsigned long long)s->count,
+			(unsigned long long)s->first_ts / 1000000000,
+			(unsigned long long)s->first_ts % 1000000000,
+			(unsigned long long)s->last_ts / 1000000000,
+			(unsigned long long)s->last_ts % 1000000000,
+			ms(s->mean), ms(jitter(s)), ms(s->min_per), ms(s->max_per));
+
+		/* "len:frames" pairs, then counts per byte and per bit */
+		for (j = 0, sep = 0; j <= CANFD_MAX_DLEN; j++)
+			if (s->len_hist[j])
+				fprintf(fp, "%s%d:%u", sep++ ? ";" : "", j, s->len_hist[j]);
+		fputc(',', fp);
+		for (j = 0; j < len; j++)
+			fprintf(fp, "%s%u", j ? ";" : "", s->byte_chg[j]);
+		fputc(',', fp);
+		for (j = 0; j < len * 8; j++)
+			fprintf(fp, "%s%u", j ? ";" : "", s->bit_chg[j]);
+		fputc('\n', fp);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static struct worker w[MAX_THREADS];
+	static struct logreader parts[MAX_THREADS];
+	struct canlog_header ifs;
+	struct logreader lr;
+	struct idtable all;
+	struct idstat **list, *s;
+	const char *outfile = NULL;
+	unsigned long bad_lines = 0;
+	__u64 frames = 0;
+	int csv = 0, threads = 0, n, i, opt, idx, ret = 0;
+	unsigned int j, k;
+	double start;
+	FILE *fp;
+
+	while ((opt = getopt(argc, argv, "cj:o:vh?")) != -1) {
+		switch (opt) {
+		case 'c':
+			csv = 1;
+			break;
+		case 'j':
+			threads = atoi(optarg);
+			if (threads < 1 || threads > MAX_THREADS)
+				usage("Invalid number of threads");
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(NULL);
+			break;
+		}
+	}
+
+	if (optind >= argc)
+		usage("You must specify a log");
+
+	if (!threads) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads < 1)
+			threads = 1;
+		if (threads > MAX_THREADS)
+			threads = MAX_THREADS;
+	}
+
+	if (logreader_open(&lr, argv[optind])) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	start = now();
+	idtable_init(&all, sizeof(struct idstat), 0);
+	n = logreader_split(&lr, parts, threads);
+	for (i = 0; i < n; i++) {
+		w[i].lr = &parts[i];
+		idtable_init(&w[i].tab, sizeof(struct idstat), 0);
+		errno = pthread_create(&w[i].thread, NULL, work, &w[i]);
+		if (errno) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	for (i = 0; i < n; i++)
+		pthread_join(w[i].thread, NULL);
+
+	/*
+	 * Interface indexes in name order, the parts see the interfaces in
+	 * another order for every -j and the rows are sorted by index.
+	 */
+	memset(&ifs, 0, sizeof(ifs));
+	for (i = 0; i < n; i++)
+		for (idx = 0; idx < w[i].lr->hdr->n_ifaces; idx++)
+			canlog_ifindex(&ifs, w[i].lr->hdr->ifname[idx]);
+	qsort(ifs.ifname, ifs.n_ifaces, sizeof(ifs.ifname[0]), cmp_name);
+
+	/* merge in log order, keyed by interface name */
+	for (i = 0; i < n && !ret; i++) {
+		if (w[i].err) {
+			errno = w[i].err;
+			perror("canstat");
+			ret = 1;
+			break;
+		}
+		frames += w[i].frames;
+		bad_lines += w[i].lr->bad_lines;
+		for (j = 0; j < w[i].tab.size; j++) {
+			const struct idstat *p = idtable_slot(&w[i].tab, j);
+
+			if (!p->key)
+				continue;
+			idx = canlog_ifindex(&ifs, logreader_ifname(w[i].lr, (p->key >> 32) - 1));
+			s = idx < 0 ? NULL : idtable_get(&all, idtable_key(idx, p->key & 0xFFFFFFFF));
+			if (!s) {
+				fprintf(stderr, "out of memory or more than %d interfaces\n",
+					CANLOG_MAX_IFACES);
+				ret = 1;
+				break;
+			}
+			merge(s, p);
+		}
+		idtable_free(&w[i].tab);
+	}
+
+	if (verbose)
+		fprintf(stderr, "%llu frames, %u IDs, %d threads, %.3f s\n",
+			(unsigned long long)frames, all.count, n, now() - start);
+	if (bad_lines)
+		fprintf(stderr, "skipped %lu malformed lines\n", bad_lines);
+
+	list = malloc((all.count + 1) * sizeof(*list));
+	if (!ret && !list) {
+		perror("malloc");
+		ret = 1;
+	}
+
+	if (!ret) {
+		for (j = 0, k = 0; j < all.size; j++) {
+			s = idtable_slot(&all, j);
+			if (s->key)
+				list[k++] = s;
+		}
+		qsort(list, k, sizeof(*list), cmp_key);
+
+		fp = outfile ? fopen(outfile, "w") : stdout;
+		if (!fp) {
+			perror(outfile);
+			ret = 1;
+		} else {
+			if (csv)
+				print_csv(fp, &ifs, list, k);
+			else
+				print_text(fp, &ifs, list, k);
+			if (fp != stdout && fclose(fp)) {
+				perror(outfile);
+				ret = 1;
+			}
+		}
+	}
+
+	free(list);
+	idtable_free(&all);
+	logreader_close(&lr);
+
+	return ret;
+}
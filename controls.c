@@ -105,6 +105,7 @@ SDL_Renderer *renderer = NULL;
 SDL_Texture *baseTexture = NULL;
 
 FILE *fptr;
+FILE *speedRecord = NULL; // reference for cancorr, see -s
 
 // Adds data dir to file name
 // Uses a single pointer so not to have a memory leak
@@ -252,6 +253,11 @@ void sendSpeed() {
 	cf.len = speedLen;
 	cf.data[speedPos+1] = (char)kph & 0xff;
 	cf.data[speedPos] = (char)(kph >> 8) & 0xff;
+	if (speedRecord) {
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		fprintf(speedRecord, "%ld.%06ld %d\n", (long)now.tv_sec, now.tv_nsec / 1000, kph);
+	}
 	if(kph == 0) { // IDLE
 		cf.data[speedPos] = 1;
 		cf.data[speedPos+1] = rand() % 255+100;
@@ -378,6 +384,7 @@ void usage(char *msg) {
   printf("\t-t\ttraffic file to use for bg CAN traffic\n");
   printf("\t-l\tdifficulty level. 1-2 (default: %d)\n", DEFAULT_DIFFICULTY);
   printf("\t-X\tDisable background CAN traffic.  Cheating if doing RE but needed if playing on a real CANbus\n");
+  printf("\t-s\trecord the speed sent (kph * 100) with timestamps to a file, a reference for cancorr\n");
   exit(1);
 }
 
@@ -393,7 +400,7 @@ int main(int argc, char *argv[]) {
   struct stat st;
   SDL_Event event;
 
-  while ((opt = getopt(argc, argv, "Xl:t:h?")) != -1) {
+  while ((opt = getopt(argc, argv, "Xl:t:s:h?")) != -1) {
     switch(opt) {
 	case 't':
 		trafficLog = optarg;
@@ -404,6 +411,13 @@ int main(int argc, char *argv[]) {
 	case 'X':
 		play_traffic = 0;
 		break;
+	case 's':
+		speedRecord = fopen(optarg, "w");
+		if (!speedRecord) {
+			perror(optarg);
+			return 1;
+		}
+		break;
 	case 'h':
 	case '?':
 	default:
@@ -651,6 +665,7 @@ int main(int argc, char *argv[]) {
   }
 
   close(s);
+  if (speedRecord) fclose(speedRecord);
   SDL_DestroyTexture(baseTexture);
   SDL_FreeSurface(image);
   SDL_DestroyRenderer(renderer);
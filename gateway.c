@@ -1,134 +1,1697 @@
-/* gateway.c - Minimal two-way bridging
+/*
+ * gateway.c - CAN gateway between any number of interfaces
  *
- * Usage: ./gateway vcan0 vcan1
+ * Usage: ./gateway [-c routes.conf] [-r rules.conf] [-l limits.conf] [-k]
+ *                  [-d|-D ms] [-b batch] [-t] [-p cpus] [-s sec] [-q depth]
+ *                  [-m file] [-n] [-v] [-B sec] [-R] [srcIf dstIf]
  *
- * Relays door bitmask frames:
- *   0x123 from vcan0 -> vcan1
- *   0x124 from vcan1 -> vcan0
+ * Forwards frames between interfaces according to a routing table (see
+ * gwroute.h for the config format).  Without -c it relays the door
+ * bitmask frames between two interfaces as it always did:
+ *   0x123 from srcIf -> dstIf
+ *   0x124 from dstIf -> srcIf
+ *
+ * All sockets are watched with one epoll instance, the routing table is
+ * compiled at startup so a frame costs one table lookup.  Every wakeup
+ * receives up to -b frames from a socket with one recvmmsg() and sends
+ * them on with one sendmmsg() per destination.  Frames the destination
+ * does not take (ENOBUFS) are dropped and counted.  The counters are
+ * printed every -s seconds and at exit, -v prints every frame forwarded
+ * and -n only prints the routes.
+ *
+ * -r loads rules that rewrite the ID and payload of matching frames on the
+ * way (see gwrewrite.h), -R measures what the rules cost per frame.  -l
+ * loads rate limits per ID and per interface (see gwlimit.h), routed
+ * frames over a limit are dropped before they are rewritten or queued.
+ *
+ * With several gateways between the same buses a frame may come back to an
+ * interface it was forwarded from or to.  -d counts and reports routed
+ * frames received on an interface within the given milliseconds after the
+ * same frame was received from or sent to it (see gwdedup.h), -D also
+ * drops them instead of forwarding them again.
+ *
+ * With -q frames are not sent in arrival order but go through a priority
+ * queue per destination (see gwqueue.h) that emulates CAN arbitration:
+ * when the interface does not take everything, the lowest IDs go first,
+ * the rest waits in the queue instead of being dropped, and a full queue
+ * drops its highest ID.  CAN_RAW sockets report POLLOUT while the driver
+ * queue is full, so a backlog is retried every millisecond.
+ *
+ * With -t every interface gets a worker thread of its own, pinned to the
+ * CPUs given with -p in turn.  A worker receives the frames of its
+ * interface and queues them for the workers of the destinations through
+ * one lock-free ring per pair of interfaces (see gwring.h), and sends
+ * what the other workers queued for its interface.  An idle worker sleeps
+ * in epoll on its socket and an eventfd the producers signal.
+ *
+ * With -k the routes are handed to the kernel's can-gw module (see
+ * gwkernel.h) as far as it can forward them on its own, the rest stays in
+ * userspace.  A kernel rule matches one filter for one source and one
+ * destination, so a route that shares IDs with another route of the same
+ * interfaces stays in userspace, the kernel would forward those frames
+ * once per rule.  So do routes whose frames a rewrite rule may change or
+ * a rate limit applies to, and all routes with -d or -D.  The kernel
+ * echoes what it forwards to the local sockets of the destination, the
+ * gateway's included, so a route and a route that sends the same IDs
+ * back both stay in userspace, too: the gateway would return every
+ * frame the kernel forwards and the two would loop.  Which path every
+ * route and destination takes is printed at startup, the kernel rules are
+ * removed again at exit.
+ *
+ * With -m the gateway keeps latency and throughput metrics per route and
+ * destination (see gwstats.h) and appends them to a file as one line of
+ * JSON every -s seconds (default 10), at exit and on SIGUSR1.  Latency is
+ * measured from the kernel receive timestamp of a frame to the return of
+ * the send call, so it covers the socket queues, the rings and the
+ * gateway itself but not the transmit queue of the driver.
+ *
+ * -B runs a benchmark instead: the first route of every source interface
+ * is flooded for the given time, then loaded with 2000 frames per second
+ * for one second, while the gateway forwards with batch size 1, with
+ * batches and threaded.  Frames per second and CPU time per frame of the
+ * flood and the forwarding latency at the lower rate are printed.
  */
 
+#define _GNU_SOURCE	/* recvmmsg(), sendmmsg(), pthread_setaffinity_np() */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/ioctl.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <net/if.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
 #include <linux/can.h>
 #include <linux/can/raw.h>
 
-// IDs we want to forward
+#include "gwroute.h"
+#include "gwring.h"
+#include "gwkernel.h"
+#include "gwstats.h"
+#include "gwqueue.h"
+#include "gwrewrite.h"
+#include "gwlimit.h"
+#include "gwdedup.h"
+
+// IDs forwarded without a config
 #define BCM_CMD_ID   0x123
 #define BCM_STAT_ID  0x124
 
+#define MAX_EVENTS	GW_MAX_IFACES
+#define GW_BATCH	64	/* frames per recvmmsg() / sendmmsg() */
+#define DUMP_INTERVAL	10	/* seconds between metrics without -s */
+
+#define BENCH_RATE	2000	/* frames per second and route for latency */
+#define BENCH_SAMPLES	(1 << 20)
+#define BENCH_FRAMES	4096	/* frames in the rewrite benchmark mix */
+
+struct gw_stats {
+	unsigned long rx, rx_calls;	/* frames received, recvmmsg() calls */
+	unsigned long unrouted;		/* received frames without a route */
+	unsigned long tx, tx_calls;	/* frames sent, sendmmsg() calls */
+	unsigned long dropped;		/* frames the interface did not take */
+	unsigned long rewritten;	/* received frames changed by a rule */
+};
+
+struct gw_port {
+	int s;
+	struct gw_stats st;
+
+	/* receive batch */
+	struct canfd_frame rx_frame[GW_BATCH];
+	struct mmsghdr rx_msg[GW_BATCH];
+	struct iovec rx_iov[GW_BATCH];
+	char rx_cmsg[GW_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+
+	/* send batch */
+	int n_tx;
+	struct mmsghdr tx_msg[GW_BATCH];
+	struct iovec tx_iov[GW_BATCH];
+	struct gw_path_stats *tx_path[GW_BATCH];	/* metrics of each frame */
+	__u64 tx_rx_ns[GW_BATCH];			/* and its receive time */
+	int tx_slot[GW_BATCH];				/* queue slot of each frame */
+	struct gw_queue queue;				/* with -q */
+
+	/* frames seen on the interface, with -d and -D */
+	struct gw_dedup dedup;
+
+	/* threaded mode */
+	pthread_t thread;
+	int efd;			/* signalled when a ring got frames */
+	_Atomic int idle;		/* worker is about to sleep */
+	struct gw_ring *in[GW_MAX_IFACES];	/* rings from each source */
+	int next_in;			/* ring to send from first */
+	double cpu;			/* CPU time used, at exit */
+};
+
+static struct gw_table table;
+static struct gw_port port[GW_MAX_IFACES];
+static int batch = GW_BATCH;
+static int depth;
+static int verbose;
+static int interval;
+static int dedup;		/* 1 = -d, 2 = -D */
+static double dedup_ms;
+static int cpus[CPU_SETSIZE], n_cpus;
+static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t dump_requested;
+static struct gw_kernel kernel;
+static struct gw_rewrite rewrite;
+static struct gw_limiter limiter;
+static struct gw_metrics metrics;
+static FILE *metrics_file;
+static char *metrics_name;
+static double next_stats, next_dump;
+
+static void usage(char *msg)
+{
+	if (msg)
+		fprintf(stderr, "%s\n", msg);
+	fprintf(stderr, "Usage: gateway [options] [srcIf dstIf]\n");
+	fprintf(stderr, "\t-c\trouting config (see gwroute.h), instead of srcIf dstIf\n");
+	fprintf(stderr, "\t-r\trewrite rules (see gwrewrite.h)\n");
+	fprintf(stderr, "\t-l\trate limits (see gwlimit.h)\n");
+	fprintf(stderr, "\t-k\tforward in the kernel (can-gw) where possible\n");
+	fprintf(stderr, "\t-d\treport frames seen again on an interface within MS ms (loops)\n");
+	fprintf(stderr, "\t-D\tlike -d, and do not forward them\n");
+	fprintf(stderr, "\t-b\tframes per receive and send call (1 - %d, default %d)\n",
+		GW_BATCH, GW_BATCH);
+	fprintf(stderr, "\t-t\tone worker thread per interface\n");
+	fprintf(stderr, "\t-p\tpin the workers to these CPUs, e.g. 2,3,4 (implies -t)\n");
+	fprintf(stderr, "\t-q\tqueue up to DEPTH frames per interface, lowest CAN ID first\n");
+	fprintf(stderr, "\t-s\tprint the counters every SEC seconds\n");
+	fprintf(stderr, "\t-m\tappend per route metrics to FILE every -s seconds (default %d)\n",
+		DUMP_INTERVAL);
+	fprintf(stderr, "\t-v\tprint every frame forwarded\n");
+	fprintf(stderr, "\t-n\tprint the routes and exit\n");
+	fprintf(stderr, "\t-B\tbenchmark forwarding for SEC seconds\n");
+	fprintf(stderr, "\t-R\tbenchmark the rewrite rules\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static __u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* CLOCK_REALTIME, like the receive timestamps */
+static __u64 wall_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void stop(int sig)
+{
+	(void)sig;
+	running = 0;
+}
+
+static void request_dump(int sig)
+{
+	(void)sig;
+	dump_requested = 1;
+}
+
+static int open_socket(const char *ifname)
+{
+	struct sockaddr_can addr;
+	struct ifreq ifr;
+	int s, enable_canfd = 1;
+
+	if ((s = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+		perror("socket");
+		return -1;
+	}
+
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+		perror(ifname);
+		close(s);
+		return -1;
+	}
+
+	/* CAN FD frames are forwarded as they are, fails on CAN 2.0 only kernels */
+	setsockopt(s, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable_canfd, sizeof(enable_canfd));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifr.ifr_ifindex;
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("bind");
+		close(s);
+		return -1;
+	}
+
+	return s;
+}
+
+static void init_batches(struct gw_port *p)
+{
+	int i;
+
+	for (i = 0; i < GW_BATCH; i++) {
+		p->rx_iov[i].iov_base = &p->rx_frame[i];
+		p->rx_iov[i].iov_len = sizeof(p->rx_frame[i]);
+		p->rx_msg[i].msg_hdr.msg_iov = &p->rx_iov[i];
+		p->rx_msg[i].msg_hdr.msg_iovlen = 1;
+		if (metrics.path)
+			p->rx_msg[i].msg_hdr.msg_control = p->rx_cmsg[i];
+		p->tx_msg[i].msg_hdr.msg_iov = &p->tx_iov[i];
+		p->tx_msg[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+static int open_ports(void)
+{
+	int i, on = 1;
+
+	memset(port, 0, sizeof(port));
+	for (i = 0; i < table.n_ifaces; i++) {
+		init_batches(&port[i]);
+		port[i].s = open_socket(table.iface[i].name);
+		if (port[i].s < 0)
+			return -1;
+		if (metrics.path &&
+		    setsockopt(port[i].s, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+			perror("SO_TIMESTAMPNS");
+		if (depth && gw_queue_init(&port[i].queue, depth)) {
+			fprintf(stderr, "Out of memory\n");
+			return -1;
+		}
+		if (dedup && gw_dedup_init(&port[i].dedup, dedup_ms * 1e6)) {
+			fprintf(stderr, "Out of memory\n");
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void close_ports(void)
+{
+	int i, s;
+
+	for (i = 0; i < table.n_ifaces; i++) {
+		if (port[i].s > 0)
+			close(port[i].s);
+		gw_queue_free(&port[i].queue);
+		gw_dedup_free(&port[i].dedup);
+		for (s = 0; s < table.n_ifaces; s++) {
+			free(port[i].in[s]);
+			port[i].in[s] = NULL;
+		}
+	}
+}
+
+/* receives a batch into port[src], returns the number of frames */
+static int receive(int src)
+{
+	struct gw_port *p = &port[src];
+	int n, i;
+
+	/* the kernel shortens msg_controllen to what it wrote */
+	if (metrics.path)
+		for (i = 0; i < batch; i++)
+			p->rx_msg[i].msg_hdr.msg_controllen = sizeof(p->rx_cmsg[i]);
+
+	n = recvmmsg(p->s, p->rx_msg, batch, MSG_DONTWAIT, NULL);
+	if (n < 0) {
+		if (errno != EAGAIN && errno != EINTR)
+			perror(table.iface[src].name);
+		return 0;
+	}
+	p->st.rx += n;
+	p->st.rx_calls++;
+
+	return n;
+}
+
+/* kernel receive time of frame i of the batch, now if there is none */
+static __u64 rx_time(struct gw_port *p, int i)
+{
+	struct msghdr *mh = &p->rx_msg[i].msg_hdr;
+	struct cmsghdr *cmsg;
+	struct timespec ts;
+
+	for (cmsg = CMSG_FIRSTHDR(mh); cmsg; cmsg = CMSG_NXTHDR(mh, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		}
+	}
+
+	return wall_ns();
+}
+
+/* adds a send batch to the metrics, the first sent frames went out */
+static void account(struct gw_port *p, int sent, int lost)
+{
+	struct canfd_frame *cf;
+	__u64 t = wall_ns();
+	int i;
+
+	for (i = 0; i < p->n_tx; i++) {
+		if (!p->tx_path[i])
+			continue;
+		if (i >= sent) {
+			p->tx_path[i]->dropped += lost;
+			continue;
+		}
+		cf = p->tx_iov[i].iov_base;
+		gw_metrics_add(p->tx_path[i], cf->len,
+			       t > p->tx_rx_ns[i] ? t - p->tx_rx_ns[i] : 0);
+	}
+}
+
+/* sends the batch of d until the interface is full, returns the frames sent */
+static int send_batch(int d)
+{
+	struct gw_port *p = &port[d];
+	int sent = 0, n, i;
+	__u64 t;
+
+	while (sent < p->n_tx) {
+		n = sendmmsg(p->s, p->tx_msg + sent, p->n_tx - sent, 0);
+		p->st.tx_calls++;
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != ENOBUFS && errno != EAGAIN)
+				perror(table.iface[d].name);
+			break;
+		}
+		sent += n;
+	}
+	p->st.tx += sent;
+
+	/* these are on the bus now, the same frames coming back are duplicates */
+	if (dedup) {
+		t = now_ns();
+		for (i = 0; i < sent; i++)
+			gw_dedup_seen(&p->dedup, gw_fingerprint(p->tx_iov[i].iov_base), t, 1);
+	}
+
+	return sent;
+}
+
+static void flush(int d)
+{
+	struct gw_port *p = &port[d];
+	int sent = send_batch(d);
+
+	/* tx queue full: what is left of this batch is lost */
+	p->st.dropped += p->n_tx - sent;
+	if (metrics.path)
+		account(p, sent, 1);
+	p->n_tx = 0;
+}
+
+static void enqueue(int d, const struct canfd_frame *cf, int len, int route,
+		    __u64 rx_ns)
+{
+	int lost;
+
+	if (gw_queue_push(&port[d].queue, cf, len, route, rx_ns, now_ns(), &lost) &&
+	    gw_metrics_path(&metrics, lost, d))
+		gw_metrics_path(&metrics, lost, d)->dropped++;
+}
+
+/* sends queued frames of d in priority order while the interface takes them */
+static void drain(int d)
+{
+	struct gw_port *p = &port[d];
+	struct gw_qentry *e;
+	int sent, i, n;
+	__u64 t;
+
+	while (p->queue.n) {
+		for (n = 0; n < batch && (i = gw_queue_pop(&p->queue)) >= 0; n++) {
+			e = &p->queue.slot[i];
+			p->tx_slot[n] = i;
+			p->tx_iov[n].iov_base = &e->cf;
+			p->tx_iov[n].iov_len = e->len;
+			if (metrics.path) {
+				p->tx_path[n] = gw_metrics_path(&metrics, e->route, d);
+				p->tx_rx_ns[n] = e->rx_ns;
+			}
+		}
+		p->n_tx = n;
+
+		sent = send_batch(d);
+		t = now_ns();
+		for (i = 0; i < n; i++) {
+			if (i < sent)
+				gw_queue_done(&p->queue, p->tx_slot[i], t);
+			else
+				gw_queue_requeue(&p->queue, p->tx_slot[i]);
+		}
+		if (metrics.path)
+			account(p, sent, 0);
+		p->n_tx = 0;
+
+		if (sent < n)
+			break;
+	}
+}
+
+static void print_forward(int src, int d, canid_t can_id)
+{
+	printf("[Gateway] %s->%s: Forwarded ID=0x%03X\n", table.iface[src].name,
+	       table.iface[d].name, can_id & CAN_EFF_MASK);
+}
+
+/* cf was seen on src shortly before, return values: 1 = do not forward it */
+static int duplicate(int src, const struct canfd_frame *cf, __u64 now)
+{
+	struct gw_dedup *dd = &port[src].dedup;
+
+	if (!gw_dedup_seen(dd, gw_fingerprint(cf), now, 0))
+		return 0;
+
+	dd->duplicates++;
+	if (now >= dd->next_alert)
+		gw_dedup_alert(dd, table.iface[src].name, cf->can_id, dedup == 2, now);
+
+	return dedup == 2;
+}
+
+static void forward(int src)
+{
+	struct gw_port *p = &port[src], *q;
+	int n, i, d, len, route = -1;
+	__u32 dst, busy = 0;
+	__u64 rx_ns = 0, t;
+	canid_t can_id;
+
+	n = receive(src);
+	t = limiter.n_limits || dedup ? now_ns() : 0;
+	for (i = 0; i < n; i++) {
+		len = p->rx_msg[i].msg_len;
+		if (len != CAN_MTU && len != CANFD_MTU)
+			continue;
+
+		can_id = p->rx_frame[i].can_id;
+		dst = gw_lookup(&table, src, can_id);
+		if (!dst) {
+			p->st.unrouted++;
+			continue;
+		}
+		if (dedup && duplicate(src, &p->rx_frame[i], t))
+			continue;
+		if (!gw_limiter_pass(&limiter, &table, src, can_id, t))
+			continue;
+		busy |= dst;
+		if (metrics.path)
+			rx_ns = rx_time(p, i);
+		p->st.rewritten += gw_rewrite_frame(&rewrite, src, &p->rx_frame[i]);
+
+		for (d = 0; dst; d++, dst >>= 1) {
+			if (!(dst & 1))
+				continue;
+			if (metrics.path)
+				route = gw_lookup_route(&table, src, can_id, d);
+			if (verbose)
+				print_forward(src, d, p->rx_frame[i].can_id);
+			if (depth) {
+				enqueue(d, &p->rx_frame[i], len, route, rx_ns);
+				continue;
+			}
+			q = &port[d];
+			q->tx_iov[q->n_tx].iov_base = &p->rx_frame[i];
+			q->tx_iov[q->n_tx].iov_len = len;
+			q->tx_path[q->n_tx] = gw_metrics_path(&metrics, route, d);
+			q->tx_rx_ns[q->n_tx] = rx_ns;
+			q->n_tx++;
+		}
+	}
+
+	for (d = 0; busy; d++, busy >>= 1)
+		if (busy & 1)
+			depth ? drain(d) : flush(d);
+}
+
+/* frames for interface i lost, by the interface, in a full ring or queue */
+static unsigned long dropped(int i)
+{
+	unsigned long n = port[i].st.dropped + port[i].queue.dropped;
+	int s;
+
+	for (s = 0; s < table.n_ifaces; s++)
+		if (port[i].in[s])
+			n += port[i].in[s]->dropped;
+
+	return n;
+}
+
+static void print_queue(int i)
+{
+	struct gw_queue *q = &port[i].queue;
+
+	printf("[Gateway] %s: queued %d (max %d of %d, %lu dropped) delay p50 %.1f us p99 %.1f us max %.1f us\n",
+	       table.iface[i].name, q->n, q->max_n, q->depth, q->dropped,
+	       loghist_percentile(q->delay_hist, q->sent, 50) / 1e3,
+	       loghist_percentile(q->delay_hist, q->sent, 99) / 1e3,
+	       q->delay_max_ns / 1e3);
+}
+
+static void print_stats(void)
+{
+	struct gw_stats *st;
+	int i;
+
+	for (i = 0; i < table.n_ifaces; i++) {
+		st = &port[i].st;
+		printf("[Gateway] %s: rx %lu (%.1f per call, %lu unrouted) tx %lu (%.1f per call) dropped %lu",
+		       table.iface[i].name, st->rx,
+		       st->rx_calls ? (double)st->rx / st->rx_calls : 0.0, st->unrouted,
+		       st->tx, st->tx_calls ? (double)st->tx / st->tx_calls : 0.0,
+		       dropped(i));
+		if (rewrite.n_rules)
+			printf(" rewritten %lu", st->rewritten);
+		if (limiter.n_limits)
+			printf(" limited %lu", gw_limiter_dropped(&limiter, i));
+		if (dedup)
+			printf(" duplicates %lu", port[i].dedup.duplicates);
+		printf("\n");
+		if (depth)
+			print_queue(i);
+	}
+	fflush(stdout);
+}
+
+/*
+ * Appends one line of JSON to the metrics file: the interface counters and
+ * the metrics of every path.  In threaded mode the workers go on counting
+ * while it is written.
+ */
+static void dump_metrics(void)
+{
+	struct gw_stats *st;
+	struct gw_queue *q;
+	double t = wall_ns() / 1e9;
+	int i;
+
+	fprintf(metrics_file, "{\"time\":%.3f,\"interfaces\":[", t);
+	for (i = 0; i < table.n_ifaces; i++) {
+		st = &port[i].st;
+		q = &port[i].queue;
+		fprintf(metrics_file, "%s{\"name\":\"%s\",\"rx\":%lu,\"unrouted\":%lu,\"rewritten\":%lu,\"limited\":%lu,\"tx\":%lu,\"dropped\":%lu",
+			i ? "," : "", table.iface[i].name, st->rx, st->unrouted,
+			st->rewritten, gw_limiter_dropped(&limiter, i), st->tx, dropped(i));
+		if (dedup)
+			fprintf(metrics_file, ",\"duplicates\":%lu,\"dedup_evicted\":%lu",
+				port[i].dedup.duplicates, port[i].dedup.evicted);
+		if (depth)
+			fprintf(metrics_file, ",\"queued\":%d,\"queue_max\":%d,\"queue_dropped\":%lu,\"queue_delay_us\":{\"p50\":%.1f,\"p99\":%.1f,\"max\":%.1f}",
+				q->n, q->max_n, q->dropped,
+				loghist_percentile(q->delay_hist, q->sent, 50) / 1e3,
+				loghist_percentile(q->delay_hist, q->sent, 99) / 1e3,
+				q->delay_max_ns / 1e3);
+		fprintf(metrics_file, "}");
+	}
+	fprintf(metrics_file, "],\"routes\":[");
+	gw_metrics_dump(&metrics, &table, metrics_file, t);
+	fprintf(metrics_file, "]}\n");
+	if (fflush(metrics_file))
+		perror(metrics_name);
+}
+
+/* prints the counters and writes the metrics when they are due */
+static void periodic(void)
+{
+	double t = now();
+
+	if (interval && t >= next_stats) {
+		print_stats();
+		next_stats += interval;
+	}
+
+	if (dump_requested) {
+		dump_requested = 0;
+		if (metrics_file)
+			dump_metrics();
+		else
+			print_stats();
+	} else if (metrics_file && t >= next_dump) {
+		dump_metrics();
+		next_dump += interval ? interval : DUMP_INTERVAL;
+	}
+}
+
+/* some queue has frames the interface did not take yet */
+static int backlog(void)
+{
+	int i;
+
+	for (i = 0; depth && i < table.n_ifaces; i++)
+		if (port[i].queue.n)
+			return 1;
+
+	return 0;
+}
+
+/* forwards until running is cleared */
+static int run(void)
+{
+	struct epoll_event ev, events[MAX_EVENTS];
+	int ep, n, i;
+
+	ep = epoll_create1(0);
+	if (ep < 0) {
+		perror("epoll_create1");
+		return -1;
+	}
+
+	for (i = 0; i < table.n_ifaces; i++) {
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if (epoll_ctl(ep, EPOLL_CTL_ADD, port[i].s, &ev)) {
+			perror("epoll_ctl");
+			close(ep);
+			return -1;
+		}
+	}
+
+	while (running) {
+		n = epoll_wait(ep, events, MAX_EVENTS, backlog() ? 1 : 100);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			break;
+		}
+		for (i = 0; i < n; i++)
+			forward(events[i].data.u32);
+		for (i = 0; depth && i < table.n_ifaces; i++)
+			if (port[i].queue.n)
+				drain(i);
+		periodic();
+	}
+
+	close(ep);
+	port[0].cpu = cpu_time();
+	return 0;
+}
+
+/* wakes the worker of d if it is sleeping or about to */
+static void notify(int d)
+{
+	__u64 one = 1;
+
+	/* pairs with the fence in worker(): either we see idle or it sees the frames */
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&port[d].idle, memory_order_relaxed) &&
+	    atomic_exchange(&port[d].idle, 0))
+		if (write(port[d].efd, &one, sizeof(one)) < 0)
+			perror("eventfd");
+}
+
+static void ingress(int src)
+{
+	struct gw_port *p = &port[src];
+	int n, i, d, len, route = -1;
+	__u32 dst, busy = 0;
+	__u64 rx_ns = 0, t;
+	canid_t can_id;
+
+	n = receive(src);
+	t = limiter.n_limits || dedup ? now_ns() : 0;
+	for (i = 0; i < n; i++) {
+		len = p->rx_msg[i].msg_len;
+		if (len != CAN_MTU && len != CANFD_MTU)
+			continue;
+
+		can_id = p->rx_frame[i].can_id;
+		dst = gw_lookup(&table, src, can_id);
+		if (!dst) {
+			p->st.unrouted++;
+			continue;
+		}
+		if (dedup && duplicate(src, &p->rx_frame[i], t))
+			continue;
+		if (!gw_limiter_pass(&limiter, &table, src, can_id, t))
+			continue;
+		busy |= dst;
+		if (metrics.path)
+			rx_ns = rx_time(p, i);
+		p->st.rewritten += gw_rewrite_frame(&rewrite, src, &p->rx_frame[i]);
+
+		for (d = 0; dst; d++, dst >>= 1) {
+			if (!(dst & 1))
+				continue;
+			if (metrics.path)
+				route = gw_lookup_route(&table, src, can_id, d);
+			gw_ring_push(port[d].in[src], &p->rx_frame[i], len, route, rx_ns);
+			if (verbose)
+				print_forward(src, d, p->rx_frame[i].can_id);
+		}
+	}
+
+	for (d = 0; busy; d++, busy >>= 1) {
+		if (busy & 1) {
+			gw_ring_publish(port[d].in[src]);
+			notify(d);
+		}
+	}
+}
+
+static int egress_pending(int me)
+{
+	int s;
+
+	for (s = 0; s < table.n_ifaces; s++)
+		if (port[me].in[s] && !gw_ring_empty(port[me].in[s]))
+			return 1;
+
+	return 0;
+}
+
+/* sends one batch from the rings of all sources, round robin */
+static void egress(int me)
+{
+	struct gw_port *p = &port[me];
+	struct gw_slot *first;
+	unsigned int taken[GW_MAX_IFACES], k, j;
+	int i, s;
+
+	if (depth) {
+		/* everything goes through the queue, which picks the order */
+		for (s = 0; s < table.n_ifaces; s++) {
+			while (p->in[s] && (k = gw_ring_peek(p->in[s], GW_RING_SLOTS, &first))) {
+				for (j = 0; j < k; j++)
+					enqueue(me, &first[j].cf, first[j].len, first[j].route,
+						first[j].rx_ns);
+				gw_ring_release(p->in[s], k);
+			}
+		}
+		drain(me);
+		return;
+	}
+
+	for (i = 0; i < table.n_ifaces; i++) {
+		s = (p->next_in + i) % table.n_ifaces;
+		taken[s] = 0;
+		if (!p->in[s] || p->n_tx == batch)
+			continue;
+		k = gw_ring_peek(p->in[s], batch - p->n_tx, &first);
+		for (j = 0; j < k; j++, p->n_tx++) {
+			p->tx_iov[p->n_tx].iov_base = &first[j].cf;
+			p->tx_iov[p->n_tx].iov_len = first[j].len;
+			if (metrics.path) {
+				p->tx_path[p->n_tx] = gw_metrics_path(&metrics, first[j].route, me);
+				p->tx_rx_ns[p->n_tx] = first[j].rx_ns;
+			}
+		}
+		taken[s] = k;
+	}
+	p->next_in = (p->next_in + 1) % table.n_ifaces;
+
+	if (!p->n_tx)
+		return;
+	flush(me);
+
+	for (s = 0; s < table.n_ifaces; s++)
+		if (taken[s])
+			gw_ring_release(p->in[s], taken[s]);
+}
+
+static void pin(int me)
+{
+	cpu_set_t set;
+	int err;
+
+	if (!n_cpus)
+		return;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpus[me % n_cpus], &set);
+	err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (err)
+		fprintf(stderr, "[Gateway] %s: can't pin to CPU %d: %s\n",
+			table.iface[me].name, cpus[me % n_cpus], strerror(err));
+}
+
+static void *worker(void *arg)
+{
+	int me = (long)arg;
+	struct gw_port *p = &port[me];
+	struct epoll_event ev, events[2];
+	__u64 val;
+	int ep, n, i;
+
+	pin(me);
+
+	ep = epoll_create1(0);
+	if (ep < 0) {
+		perror("epoll_create1");
+		running = 0;
+		return NULL;
+	}
+	ev.events = EPOLLIN;
+	ev.data.u32 = 0;
+	epoll_ctl(ep, EPOLL_CTL_ADD, p->s, &ev);
+	ev.data.u32 = 1;
+	epoll_ctl(ep, EPOLL_CTL_ADD, p->efd, &ev);
+
+	while (running) {
+		atomic_store_explicit(&p->idle, 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_seq_cst);
+		n = epoll_wait(ep, events, 2, egress_pending(me) ? 0 : p->queue.n ? 1 : 100);
+		atomic_store_explicit(&p->idle, 0, memory_order_relaxed);
+		if (n < 0 && errno != EINTR) {
+			perror("epoll_wait");
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (events[i].data.u32 == 0)
+				ingress(me);
+			else if (read(p->efd, &val, sizeof(val)) < 0)
+				perror("eventfd");
+		}
+		egress(me);
+	}
+
+	close(ep);
+	p->cpu = cpu_time();
+	return NULL;
+}
+
+static int start_workers(void)
+{
+	struct gw_route *r;
+	__u32 dst;
+	int i, d;
+
+	/* a ring for every pair that has a route */
+	for (i = 0; i < table.n_routes; i++) {
+		r = &table.route[i];
+		dst = r->dst & ~(1U << r->src);
+		for (d = 0; dst; d++, dst >>= 1) {
+			if (!(dst & 1) || port[d].in[r->src])
+				continue;
+			port[d].in[r->src] = aligned_alloc(64, sizeof(struct gw_ring));
+			if (!port[d].in[r->src]) {
+				fprintf(stderr, "Out of memory\n");
+				return -1;
+			}
+			memset(port[d].in[r->src], 0, sizeof(struct gw_ring));
+		}
+	}
+
+	for (i = 0; i < table.n_ifaces; i++) {
+		port[i].efd = eventfd(0, EFD_NONBLOCK);
+		if (port[i].efd < 0) {
+			perror("eventfd");
+			return -1;
+		}
+	}
+
+	for (i = 0; i < table.n_ifaces; i++) {
+		if (pthread_create(&port[i].thread, NULL, worker, (void *)(long)i)) {
+			perror("pthread_create");
+			running = 0;
+			while (i--)
+				pthread_join(port[i].thread, NULL);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void stop_workers(void)
+{
+	int i;
+
+	running = 0;
+	for (i = 0; i < table.n_ifaces; i++)
+		pthread_join(port[i].thread, NULL);
+	for (i = 0; i < table.n_ifaces; i++)
+		close(port[i].efd);
+}
+
+static int parse_cpus(const char *s)
+{
+	char *end;
+	long cpu;
+
+	do {
+		cpu = strtol(s, &end, 10);
+		if (end == s || cpu < 0 || cpu >= CPU_SETSIZE || n_cpus == CPU_SETSIZE)
+			return -1;
+		cpus[n_cpus++] = cpu;
+		s = end + 1;
+	} while (*end == ',');
+
+	return *end ? -1 : 0;
+}
+
+static int ids_overlap(const struct gw_route *a, const struct gw_route *b)
+{
+	if (a->ext != 2 && b->ext != 2 && a->ext != b->ext)
+		return 0;
+
+	return !((a->id ^ b->id) & a->mask & b->mask);
+}
+
+/* returns a route that sends IDs of route i from its source to d as well, or -1 */
+static int overlap(int i, int d, const __u32 *dst)
+{
+	const struct gw_route *a = &table.route[i], *b;
+	int k;
+
+	for (k = 0; k < table.n_routes; k++) {
+		b = &table.route[k];
+		if (k == i || b->src != a->src || !(dst[k] & (1U << d)))
+			continue;
+		if (ids_overlap(a, b))
+			return k;
+	}
+
+	return -1;
+}
+
+/* returns a route that sends IDs of route i from d back to its source, or -1 */
+static int reverse(int i, int d, const __u32 *dst)
+{
+	const struct gw_route *a = &table.route[i], *b;
+	int k;
+
+	for (k = 0; k < table.n_routes; k++) {
+		b = &table.route[k];
+		if (b->src != d || !(dst[k] & (1U << a->src)))
+			continue;
+		if (ids_overlap(a, b))
+			return k;
+	}
+
+	return -1;
+}
+
+/* adds the Classical CAN and the CAN FD rule of route i to d */
+static int offload_route(int i, int d)
+{
+	const struct gw_route *r = &table.route[i];
+	struct gw_kernel_rule rule;
+	int err;
+
+	memset(&rule, 0, sizeof(rule));
+	rule.src_ifindex = if_nametoindex(table.iface[r->src].name);
+	rule.dst_ifindex = if_nametoindex(table.iface[d].name);
+	if (!rule.src_ifindex || !rule.dst_ifindex)
+		return -ENODEV;
+
+	if (r->ext == 1) {
+		rule.filter.can_id = r->id | CAN_EFF_FLAG;
+		rule.filter.can_mask = r->mask | CAN_EFF_FLAG;
+	} else if (!r->ext) {
+		rule.filter.can_id = r->id;
+		rule.filter.can_mask = r->mask | CAN_EFF_FLAG;
+	}
+
+	err = gw_kernel_add(&kernel, &rule);
+	if (err)
+		return err;
+
+	rule.fd = 1;
+	err = gw_kernel_add(&kernel, &rule);
+	if (err)
+		gw_kernel_del(&kernel, kernel.n_rules - 1);
+
+	return err;
+}
+
+static void print_path(int i, int d, const char *path)
+{
+	const struct gw_route *r = &table.route[i];
+
+	printf("[Gateway] %-8s ", table.iface[r->src].name);
+	if (r->ext == 2)
+		printf("%-17s", "*");
+	else if (r->ext)
+		printf("%08X/%08X", r->id, r->mask);
+	else
+		printf("%03X/%03X%10s", r->id, r->mask, "");
+	printf(" -> %-8s %s\n", table.iface[d].name, path);
+}
+
+/* moves what the kernel can forward there, returns the number of routes moved */
+static int offload(void)
+{
+	const struct gw_route *r;
+	__u32 dst[GW_MAX_ROUTES], rest;
+	char why[64];
+	int i, d, k, err, n = 0;
+
+	if (gw_kernel_open(&kernel)) {
+		perror("netlink");
+		return 0;
+	}
+
+	/* decide on the original routes, before any of them loses destinations */
+	for (i = 0; i < table.n_routes; i++)
+		dst[i] = table.route[i].dst & ~(1U << table.route[i].src);
+
+	for (i = 0; i < table.n_routes; i++) {
+		r = &table.route[i];
+		for (d = 0, rest = dst[i]; rest; d++, rest >>= 1) {
+			if (!(rest & 1))
+				continue;
+			if (dedup) {
+				print_path(i, d, "userspace (duplicate detection)");
+				continue;
+			}
+			k = gw_rewrite_overlap(&rewrite, r->src, r->id, r->mask, r->ext);
+			if (k >= 0) {
+				snprintf(why, sizeof(why), "userspace (rewrite rule %d)", k + 1);
+				print_path(i, d, why);
+				continue;
+			}
+			k = gw_limiter_overlap(&limiter, r->src, r->id, r->mask, r->ext);
+			if (k >= 0) {
+				snprintf(why, sizeof(why), "userspace (rate limit %d)", k + 1);
+				print_path(i, d, why);
+				continue;
+			}
+			k = overlap(i, d, dst);
+			if (k >= 0) {
+				snprintf(why, sizeof(why), "userspace (overlaps route %d)", k + 1);
+				print_path(i, d, why);
+				continue;
+			}
+			k = reverse(i, d, dst);
+			if (k >= 0) {
+				snprintf(why, sizeof(why), "userspace (route %d sends back)", k + 1);
+				print_path(i, d, why);
+				continue;
+			}
+			err = offload_route(i, d);
+			if (err) {
+				snprintf(why, sizeof(why), "userspace (%s)", strerror(-err));
+				print_path(i, d, why);
+				continue;
+			}
+			table.route[i].dst &= ~(1U << d);
+			print_path(i, d, "kernel");
+			n++;
+		}
+	}
+	fflush(stdout);
+
+	return n;
+}
+
+struct bench_load {
+	int src;
+	canid_t can_id;
+	__u32 dst;
+	int rate;		/* frames per second, 0 = as fast as possible */
+	double seconds;
+	unsigned long sent;
+};
+
+static struct bench_load loads[GW_MAX_IFACES];
+static int n_loads;
+static volatile int bench_receiving;
+static unsigned long bench_received;
+static __u64 *bench_latency;
+static unsigned long n_latency;
+
+static void *bench_send(void *arg)
+{
+	struct bench_load *bl = arg;
+	struct can_frame cf[GW_BATCH];
+	struct mmsghdr msg[GW_BATCH];
+	struct iovec iov[GW_BATCH];
+	struct pollfd pfd;
+	struct timespec next;
+	double end = now() + bl->seconds;
+	__u64 ts;
+	int s, i, n;
+
+	s = open_socket(table.iface[bl->src].name);
+	if (s < 0)
+		return NULL;
+
+	memset(cf, 0, sizeof(cf));
+	memset(msg, 0, sizeof(msg));
+	for (i = 0; i < GW_BATCH; i++) {
+		cf[i].can_id = bl->can_id;
+		cf[i].len = 8;
+		iov[i].iov_base = &cf[i];
+		iov[i].iov_len = CAN_MTU;
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	pfd.fd = s;
+	pfd.events = POLLOUT;
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	while (now() < end) {
+		if (bl->rate) {
+			next.tv_nsec += 1000000000 / bl->rate;
+			if (next.tv_nsec >= 1000000000) {
+				next.tv_sec++;
+				next.tv_nsec -= 1000000000;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		}
+
+		/* the payload is the send time, for the latency */
+		ts = now_ns();
+		for (i = 0; i < GW_BATCH; i++)
+			memcpy(cf[i].data, &ts, sizeof(ts));
+		n = sendmmsg(s, msg, bl->rate ? 1 : GW_BATCH, 0);
+		if (n < 0) {
+			if (errno != ENOBUFS && errno != EAGAIN) {
+				perror("sendmmsg");
+				break;
+			}
+			/* tx queue full, wait until the driver has room again */
+			poll(&pfd, 1, 1);
+			continue;
+		}
+		bl->sent += n;
+	}
+
+	close(s);
+	return NULL;
+}
+
+static void *bench_receive(void *arg)
+{
+	struct canfd_frame cf[GW_BATCH];
+	struct mmsghdr msg[GW_BATCH];
+	struct iovec iov[GW_BATCH];
+	struct pollfd pfd[GW_MAX_IFACES];
+	int iface[GW_MAX_IFACES];
+	__u32 dst = 0;
+	__u64 ts, t;
+	int np = 0, d, i, j, l, n;
+
+	(void)arg;
+	memset(msg, 0, sizeof(msg));
+	for (i = 0; i < GW_BATCH; i++) {
+		iov[i].iov_base = &cf[i];
+		iov[i].iov_len = sizeof(cf[i]);
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	for (l = 0; l < n_loads; l++)
+		dst |= loads[l].dst;
+	for (d = 0; d < table.n_ifaces; d++) {
+		if (!(dst & (1U << d)))
+			continue;
+		pfd[np].fd = open_socket(table.iface[d].name);
+		if (pfd[np].fd < 0)
+			goto out;
+		pfd[np].events = POLLIN;
+		iface[np++] = d;
+	}
+
+	while (bench_receiving) {
+		if (poll(pfd, np, 100) <= 0)
+			continue;
+		t = now_ns();
+		for (i = 0; i < np; i++) {
+			if (!(pfd[i].revents & POLLIN))
+				continue;
+			n = recvmmsg(pfd[i].fd, msg, GW_BATCH, MSG_DONTWAIT, NULL);
+			for (j = 0; j < n; j++) {
+				/* only count what the gateway forwarded here */
+				for (l = 0; l < n_loads; l++)
+					if (cf[j].can_id == loads[l].can_id &&
+					    (loads[l].dst & (1U << iface[i])))
+						break;
+				if (l == n_loads)
+					continue;
+				bench_received++;
+				memcpy(&ts, cf[j].data, sizeof(ts));
+				if (n_latency < BENCH_SAMPLES && t > ts)
+					bench_latency[n_latency++] = t - ts;
+			}
+		}
+	}
+
+out:
+	for (i = 0; i < np; i++)
+		close(pfd[i].fd);
+	return NULL;
+}
+
+/* sends the loads at rate (0 = flood), returns the frames expected */
+static unsigned long bench_run(int rate, double seconds)
+{
+	pthread_t tx[GW_MAX_IFACES], rx;
+	unsigned long expected = 0;
+	int l;
+
+	bench_received = 0;
+	n_latency = 0;
+	bench_receiving = 1;
+	if (pthread_create(&rx, NULL, bench_receive, NULL)) {
+		perror("pthread_create");
+		exit(1);
+	}
+	usleep(50000);
+
+	for (l = 0; l < n_loads; l++) {
+		loads[l].rate = rate;
+		loads[l].seconds = seconds;
+		loads[l].sent = 0;
+		if (pthread_create(&tx[l], NULL, bench_send, &loads[l])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (l = 0; l < n_loads; l++) {
+		pthread_join(tx[l], NULL);
+		expected += loads[l].sent * __builtin_popcount(loads[l].dst);
+	}
+
+	/* give the gateway time to drain its sockets */
+	usleep(200000);
+	bench_receiving = 0;
+	pthread_join(rx, NULL);
+
+	return expected;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	const __u64 *x = a, *y = b;
+
+	return (*x > *y) - (*x < *y);
+}
+
+static void *run_thread(void *arg)
+{
+	(void)arg;
+	run();
+	return NULL;
+}
+
+static int bench(double seconds)
+{
+	static const char *mode_name[] = { "batch 1", "batch 64", "threaded" };
+	struct gw_route *r;
+	unsigned long expected, received, rx;
+	pthread_t gw;
+	double cpu;
+	int mode, i, k;
+
+	/* the first route of every source interface */
+	for (i = 0; i < table.n_ifaces; i++) {
+		for (k = 0; k < table.n_routes; k++)
+			if (table.route[k].src == i)
+				break;
+		if (k == table.n_routes)
+			continue;
+		r = &table.route[k];
+		loads[n_loads].src = i;
+		loads[n_loads].can_id = r->id | (r->ext == 1 ? CAN_EFF_FLAG : 0);
+		loads[n_loads].dst = gw_lookup(&table, i, loads[n_loads].can_id);
+		if (loads[n_loads].dst)
+			n_loads++;
+	}
+	if (!n_loads) {
+		fprintf(stderr, "No route to benchmark\n");
+		return -1;
+	}
+
+	bench_latency = malloc(BENCH_SAMPLES * sizeof(*bench_latency));
+	if (!bench_latency)
+		return -1;
+
+	for (i = 0; i < n_loads; i++)
+		printf("flooding %X on %s, forwarded to %d interface(s)\n",
+		       loads[i].can_id & CAN_EFF_MASK, table.iface[loads[i].src].name,
+		       __builtin_popcount(loads[i].dst));
+	printf("%-9s %10s %12s %9s   latency at %d frames/s per route\n",
+	       "", "frames/s", "CPU/frame", "lost", BENCH_RATE);
+
+	for (mode = 0; mode < 3; mode++) {
+		batch = mode == 0 ? 1 : GW_BATCH;
+		running = 1;
+		if (open_ports())
+			return -1;
+		if (mode < 2) {
+			if (pthread_create(&gw, NULL, run_thread, NULL)) {
+				perror("pthread_create");
+				return -1;
+			}
+		} else if (start_workers()) {
+			return -1;
+		}
+
+		expected = bench_run(0, seconds);
+		received = bench_received;
+
+		bench_run(BENCH_RATE, 1);
+		qsort(bench_latency, n_latency, sizeof(*bench_latency), cmp_u64);
+
+		if (mode < 2) {
+			running = 0;
+			pthread_join(gw, NULL);
+		} else {
+			stop_workers();
+		}
+		close_ports();
+
+		cpu = 0;
+		rx = 0;
+		for (i = 0; i < table.n_ifaces; i++) {
+			cpu += port[i].cpu;
+			rx += port[i].st.rx;
+		}
+		printf("%-9s %10lu %9.2f us %9lu", mode_name[mode],
+		       (unsigned long)(received / seconds), rx ? cpu * 1e6 / rx : 0.0,
+		       expected > received ? expected - received : 0);
+		if (n_latency)
+			printf("   p50 %.1f us, p99 %.1f us, max %.1f us\n",
+			       bench_latency[n_latency / 2] / 1e3,
+			       bench_latency[n_latency * 99 / 100] / 1e3,
+			       bench_latency[n_latency - 1] / 1e3);
+		else
+			printf("   -\n");
+		fflush(stdout);
+	}
+
+	free(bench_latency);
+	return 0;
+}
+
+/* a rule applies to the ID, checked the way the compiled lists do */
+static int rule_id_match(const struct gw_rule *r, canid_t can_id)
+{
+	if (r->ext != 2 && r->ext != !!(can_id & CAN_EFF_FLAG))
+		return 0;
+	can_id &= can_id & CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK;
+
+	return (can_id & r->mask) == r->id;
+}
+
+/* the uncompiled way: every rule in turn */
+static int rewrite_linear(int src, struct canfd_frame *cf)
+{
+	const struct gw_rule *r;
+	int k;
+
+	for (k = 0; k < rewrite.n_rules; k++) {
+		r = &rewrite.rule[k];
+		if (r->src == src && rule_id_match(r, cf->can_id) && gw_rule_match(r, cf)) {
+			gw_rewrite_apply(r, cf);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Times the rewrite rules on a mix of frames, half of them made to match
+ * a rule, half random standard IDs: the copy a rewrite needs alone, the
+ * compiled rule lists and checking every rule.
+ */
+static int bench_rewrite(void)
+{
+	static const char *mode_name[] = { "copy only", "compiled", "all rules" };
+	static struct canfd_frame frame[BENCH_FRAMES];
+	static int frame_src[BENCH_FRAMES];
+	const struct gw_rule *r;
+	struct canfd_frame cf;
+	unsigned long n, hits;
+	double start, t;
+	canid_t bits;
+	__u64 data;
+	int mode, i;
+
+	if (!rewrite.n_rules) {
+		fprintf(stderr, "No rewrite rules to benchmark (-r)\n");
+		return -1;
+	}
+
+	srand(1);
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		r = &rewrite.rule[rand() % rewrite.n_rules];
+		memset(&frame[i], 0, sizeof(frame[i]));
+		frame_src[i] = r->src;
+		frame[i].len = r->min_len > CAN_MAX_DLEN ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+		for (n = 0; n < frame[i].len; n++)
+			frame[i].data[n] = rand();
+		if (i % 2) {
+			frame[i].can_id = rand() & CAN_SFF_MASK;
+			continue;
+		}
+		bits = ((canid_t)rand() << 16 ^ rand()) & ~r->mask;
+		if (r->ext == 1)
+			frame[i].can_id = CAN_EFF_FLAG | ((r->id | bits) & CAN_EFF_MASK);
+		else
+			frame[i].can_id = (r->id | bits) & CAN_SFF_MASK;
+		memcpy(&data, frame[i].data, sizeof(data));
+		data = (data & ~r->data_mask) | r->data;
+		memcpy(frame[i].data, &data, sizeof(data));
+	}
+
+	printf("%d rules, %d frames\n", rewrite.n_rules, BENCH_FRAMES);
+	for (mode = 0; mode < 3; mode++) {
+		n = hits = 0;
+		start = now();
+		do {
+			for (i = 0; i < BENCH_FRAMES; i++) {
+				cf = frame[i];
+				if (mode == 1)
+					hits += gw_rewrite_frame(&rewrite, frame_src[i], &cf);
+				else if (mode == 2)
+					hits += rewrite_linear(frame_src[i], &cf);
+				/* keep the compiler from dropping the work */
+				__asm__ volatile("" : : "m"(cf));
+			}
+			n += BENCH_FRAMES;
+			t = now() - start;
+		} while (t < 1);
+		printf("%-10s %8.1f ns/frame   %3.0f %% rewritten\n", mode_name[mode],
+		       t * 1e9 / n, 100.0 * hits / n);
+	}
+
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <srcIf> <dstIf>\n", argv[0]);
-        exit(1);
-    }
-
-    int s1, s2;
-    struct sockaddr_can addr;
-    struct ifreq ifr;
-
-    // -- Socket 1 (srcIf)
-    if ((s1 = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
-        perror("socket s1");
-        exit(1);
-    }
-    strcpy(ifr.ifr_name, argv[1]);
-    if (ioctl(s1, SIOCGIFINDEX, &ifr) < 0) {
-        perror("ioctl s1");
-        close(s1);
-        exit(1);
-    }
-    addr.can_family  = AF_CAN;
-    addr.can_ifindex = ifr.ifr_ifindex;
-    if (bind(s1, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        perror("bind s1");
-        close(s1);
-        exit(1);
-    }
-    printf("[Gateway] Bound to %s (socket s1)\n", argv[1]);
-
-    // -- Socket 2 (dstIf)
-    if ((s2 = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
-        perror("socket s2");
-        close(s1);
-        exit(1);
-    }
-    strcpy(ifr.ifr_name, argv[2]);
-    if (ioctl(s2, SIOCGIFINDEX, &ifr) < 0) {
-        perror("ioctl s2");
-        close(s2);
-        close(s1);
-        exit(1);
-    }
-    addr.can_family  = AF_CAN;
-    addr.can_ifindex = ifr.ifr_ifindex;
-    if (bind(s2, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        perror("bind s2");
-        close(s2);
-        close(s1);
-        exit(1);
-    }
-    printf("[Gateway] Bound to %s (socket s2)\n", argv[2]);
-
-    printf("[Gateway] Forwarding: 0x123 from %s->%s, 0x124 from %s->%s\n",
-           argv[1], argv[2], argv[2], argv[1]);
-
-    fd_set fds;
-    int maxfd = (s1 > s2) ? s1 : s2;
-
-    while (1) {
-        FD_ZERO(&fds);
-        FD_SET(s1, &fds);
-        FD_SET(s2, &fds);
-
-        int ret = select(maxfd+1, &fds, NULL, NULL, NULL);
-        if (ret < 0) {
-            perror("select");
-            break;
-        }
-
-        // If there's data on s1, read & forward certain IDs
-        if (FD_ISSET(s1, &fds)) {
-            struct can_frame frame;
-            int nbytes = read(s1, &frame, sizeof(frame));
-            if (nbytes < 0) {
-                perror("[Gateway] read s1");
-                break;
-            }
-            if (nbytes == sizeof(frame)) {
-                if (frame.can_id == BCM_CMD_ID) {
-                    // Forward 0x123 from s1->s2
-                    int w = write(s2, &frame, sizeof(frame));
-                    if (w < 0) perror("[Gateway] write s2");
-                    else printf("[Gateway] s1->s2: Forwarded ID=0x%03X\n", frame.can_id);
-                }
-            }
-        }
-
-        // If there's data on s2, read & forward certain IDs
-        if (FD_ISSET(s2, &fds)) {
-            struct can_frame frame;
-            int nbytes = read(s2, &frame, sizeof(frame));
-            if (nbytes < 0) {
-                perror("[Gateway] read s2");
-                break;
-            }
-            if (nbytes == sizeof(frame)) {
-                if (frame.can_id == BCM_STAT_ID) {
-                    // Forward 0x124 from s2->s1
-                    int w = write(s1, &frame, sizeof(frame));
-                    if (w < 0) perror("[Gateway] write s1");
-                    else printf("[Gateway] s2->s1: Forwarded ID=0x%03X\n", frame.can_id);
-                }
-            }
-        }
-    }
-
-    close(s1);
-    close(s2);
-    return 0;
+	struct sigaction sa;
+	char *config = NULL, *rules = NULL, *limits = NULL;
+	int print_only = 0, threaded = 0, use_kernel = 0, bench_rules = 0, ret = 1;
+	double bench_time = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:r:l:kd:D:b:tp:q:s:m:vnB:Rh?")) != -1) {
+		switch (opt) {
+		case 'c':
+			config = optarg;
+			break;
+		case 'r':
+			rules = optarg;
+			break;
+		case 'l':
+			limits = optarg;
+			break;
+		case 'k':
+			use_kernel = 1;
+			break;
+		case 'd':
+		case 'D':
+			dedup = opt == 'D' ? 2 : 1;
+			dedup_ms = atof(optarg);
+			if (dedup_ms <= 0 || dedup_ms > 60000)
+				usage("Invalid duplicate window");
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			if (batch < 1 || batch > GW_BATCH)
+				usage("Invalid batch size");
+			break;
+		case 't':
+			threaded = 1;
+			break;
+		case 'p':
+			if (parse_cpus(optarg))
+				usage("Invalid CPU list");
+			threaded = 1;
+			break;
+		case 's':
+			interval = atoi(optarg);
+			if (interval <= 0)
+				usage("Invalid interval");
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			if (depth < 1)
+				usage("Invalid queue depth");
+			break;
+		case 'm':
+			metrics_name = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'n':
+			print_only = 1;
+			break;
+		case 'B':
+			bench_time = atof(optarg);
+			if (bench_time <= 0)
+				usage("Invalid benchmark time");
+			break;
+		case 'R':
+			bench_rules = 1;
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(NULL);
+			break;
+		}
+	}
+
+	gw_table_init(&table);
+	if (config) {
+		if (optind != argc)
+			usage("Interfaces come from the config with -c");
+		if (gw_table_load(&table, config))
+			return 1;
+	} else {
+		int s, d;
+
+		if (argc - optind != 2)
+			usage("You must specify two interfaces or a config");
+		s = gw_iface_index(&table, argv[optind]);
+		d = gw_iface_index(&table, argv[optind + 1]);
+		if (s < 0 || d < 0 || s == d)
+			usage("Invalid interfaces");
+		gw_table_add(&table, s, BCM_CMD_ID, CAN_SFF_MASK, 0, 1U << d);
+		gw_table_add(&table, d, BCM_STAT_ID, CAN_SFF_MASK, 0, 1U << s);
+	}
+	if (gw_table_compile(&table)) {
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	gw_rewrite_init(&rewrite);
+	if (rules && (gw_rewrite_load(&rewrite, &table, rules) ||
+		      gw_rewrite_compile(&rewrite, &table)))
+		return 1;
+	gw_limiter_init(&limiter);
+	if (limits && (gw_limiter_load(&limiter, &table, limits) ||
+		       gw_limiter_compile(&limiter, &table)))
+		return 1;
+
+	if (print_only) {
+		gw_table_print(&table);
+		gw_rewrite_print(&rewrite, &table);
+		gw_limiter_print(&limiter, &table);
+		return 0;
+	}
+
+	if (bench_rules)
+		return bench_rewrite() ? 1 : 0;
+	if (bench_time)
+		return bench(bench_time) ? 1 : 0;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sa.sa_handler = request_dump;
+	sigaction(SIGUSR1, &sa, NULL);
+
+	if (use_kernel && offload() && gw_table_compile(&table)) {
+		fprintf(stderr, "Out of memory\n");
+		goto out;
+	}
+
+	if (metrics_name) {
+		metrics_file = fopen(metrics_name, "a");
+		if (!metrics_file) {
+			perror(metrics_name);
+			goto out;
+		}
+		if (gw_metrics_init(&metrics, &table)) {
+			fprintf(stderr, "Out of memory\n");
+			goto out;
+		}
+		metrics.last = wall_ns() / 1e9;
+	}
+
+	if (open_ports())
+		goto out;
+	printf("[Gateway] Forwarding %d routes between %d interfaces%s\n",
+	       table.n_routes, table.n_ifaces, threaded ? ", one thread each" : "");
+	fflush(stdout);
+
+	next_stats = now() + interval;
+	next_dump = now() + (interval ? interval : DUMP_INTERVAL);
+	if (threaded) {
+		if (start_workers())
+			goto out;
+		while (running) {
+			usleep(100000);
+			periodic();
+		}
+		stop_workers();
+	} else {
+		run();
+	}
+
+	print_stats();
+	if (metrics_file)
+		dump_metrics();
+	ret = 0;
+out:
+	close_ports();
+	if (metrics_file)
+		fclose(metrics_file);
+	gw_metrics_free(&metrics);
+	gw_rewrite_free(&rewrite);
+	gw_limiter_free(&limiter);
+	if (use_kernel)
+		gw_kernel_close(&kernel);
+	gw_table_free(&table);
+
+	return ret;
 }
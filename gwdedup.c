@@ -0,0 +1,40 @@
+/*
+ * gwdedup.c - loop and duplicate detection of the gateway
+ *
+ * See gwdedup.h for the interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gwdedup.h"
+
+int gw_dedup_init(struct gw_dedup *d, __u64 window_ns)
+{
+	memset(d, 0, sizeof(*d));
+	d->e = calloc(GW_DEDUP_SLOTS, sizeof(*d->e));
+	if (!d->e)
+		return -1;
+	d->window = window_ns;
+
+	return 0;
+}
+
+void gw_dedup_free(struct gw_dedup *d)
+{
+	free(d->e);
+	d->e = NULL;
+}
+
+void gw_dedup_alert(struct gw_dedup *d, const char *ifname, canid_t can_id,
+		    int suppress, __u64 now)
+{
+	printf("[Gateway] %s: %lu frame(s) seen twice within %.1f ms, %s (last ID %03X), a loop?\n",
+	       ifname, d->duplicates - d->alerted, d->window / 1e6,
+	       suppress ? "not forwarded" : "forwarded", can_id & CAN_EFF_MASK);
+	fflush(stdout);
+
+	d->alerted = d->duplicates;
+	d->next_alert = now + GW_DEDUP_ALERT_NS;
+}
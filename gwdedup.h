@@ -0,0 +1,118 @@
+/*
+ * gwdedup.h - loop and duplicate detection of the gateway
+ *
+ * Two gateways that bridge the same interfaces in both directions forward
+ * every frame around in circles, redundant gateways put every frame on
+ * the destination twice.  With gateway -d or -D each interface remembers
+ * the fingerprints (CAN ID, length and payload) of the frames seen on it
+ * for a short time window: the frames received from it and the frames the
+ * gateway sent to it.  A frame received again within the window is one
+ * that came back around a loop or a copy of one already forwarded.  -d
+ * only counts and reports those, -D does not forward them either.
+ *
+ * The window has to be shorter than the period of any periodic frame with
+ * a constant payload and longer than a trip around the loop, a few
+ * milliseconds usually fit.
+ *
+ * The fingerprints live in an open addressing hash table of fixed size per
+ * interface.  A fingerprint is looked for in GW_DEDUP_PROBE slots only,
+ * older entries are free slots, and if all probed slots are younger than
+ * the window the oldest one is overwritten (counted as evicted), so memory
+ * is bounded at any frame rate.  The table of an interface is only used by
+ * the thread that receives from and sends to it.
+ */
+
+#ifndef GWDEDUP_H
+#define GWDEDUP_H
+
+#include <string.h>
+#include <linux/types.h>
+#include <linux/can.h>
+
+#define GW_DEDUP_SLOTS	4096	/* per interface, power of two */
+#define GW_DEDUP_PROBE	8
+#define GW_DEDUP_ALERT_NS	1000000000ULL
+
+struct gw_dedup_entry {
+	__u64 fp;
+	__u64 seen;		/* CLOCK_MONOTONIC ns */
+};
+
+struct gw_dedup {
+	__u64 window;		/* ns */
+	struct gw_dedup_entry *e;
+	unsigned long duplicates;
+	unsigned long evicted;	/* live fingerprints overwritten */
+
+	/* alerts */
+	unsigned long alerted;	/* duplicates at the previous alert */
+	__u64 next_alert;
+};
+
+int gw_dedup_init(struct gw_dedup *d, __u64 window_ns);
+/*
+ * Return values: 0 = success, -1 = out of memory
+ */
+
+void gw_dedup_free(struct gw_dedup *d);
+
+void gw_dedup_alert(struct gw_dedup *d, const char *ifname, canid_t can_id,
+		    int suppress, __u64 now);
+/*
+ * Prints the duplicates found since the previous alert.
+ */
+
+/* CAN ID, length and payload in 64 bits */
+static inline __u64 gw_fingerprint(const struct canfd_frame *cf)
+{
+	__u64 h = ((__u64)cf->can_id << 8 | cf->len) * 0x9E3779B97F4A7C15ULL, w;
+	int i, n;
+
+	for (i = 0; i < cf->len; i += 8) {
+		n = cf->len - i < 8 ? cf->len - i : 8;
+		w = 0;
+		memcpy(&w, cf->data + i, n);
+		h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+		h ^= h >> 29;
+	}
+
+	return h ^ h >> 32;
+}
+
+/*
+ * Looks for fp seen within the window and records it as seen at now if
+ * it is not there, or refreshes it if refresh is set.
+ * Return values: 1 = seen before, 0 = new
+ */
+static inline int gw_dedup_seen(struct gw_dedup *d, __u64 fp, __u64 now, int refresh)
+{
+	struct gw_dedup_entry *e, *slot = NULL, *oldest = NULL;
+	unsigned int i = fp & (GW_DEDUP_SLOTS - 1), k;
+
+	for (k = 0; k < GW_DEDUP_PROBE; k++) {
+		e = &d->e[(i + k) & (GW_DEDUP_SLOTS - 1)];
+		if (now - e->seen >= d->window) {
+			if (!slot)
+				slot = e;
+			continue;
+		}
+		if (e->fp == fp) {
+			if (refresh)
+				e->seen = now;
+			return 1;
+		}
+		if (!oldest || e->seen < oldest->seen)
+			oldest = e;
+	}
+
+	if (!slot) {
+		slot = oldest;
+		d->evicted++;
+	}
+	slot->fp = fp;
+	slot->seen = now;
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * gwkernel.c - in-kernel CAN routing through the can-gw netlink interface
+ *
+ * See gwkernel.h for the interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "gwkernel.h"
+
+#define MSG_SIZE	1024	/* a rule with all modifications is about 400 bytes */
+
+static void add_attr(struct nlmsghdr *nh, int type, const void *data, int len)
+{
+	struct rtattr *rta = (struct rtattr *)((char *)nh + NLMSG_ALIGN(nh->nlmsg_len));
+
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+static void add_mods(struct nlmsghdr *nh, const struct gw_kernel_rule *r)
+{
+	static const int attr[CGW_MOD_FUNCS] = {
+		CGW_MOD_AND, CGW_MOD_OR, CGW_MOD_XOR, CGW_MOD_SET
+	};
+	static const int fdattr[CGW_MOD_FUNCS] = {
+		CGW_FDMOD_AND, CGW_FDMOD_OR, CGW_FDMOD_XOR, CGW_FDMOD_SET
+	};
+	const struct gw_kernel_mods *m = &r->mods;
+	struct cgw_fdframe_mod fdmod;
+	int i;
+
+	for (i = 0; i < CGW_MOD_FUNCS; i++) {
+		if (!m->mod[i].modtype)
+			continue;
+		if (!r->fd) {
+			add_attr(nh, attr[i], &m->mod[i], CGW_MODATTR_LEN);
+			continue;
+		}
+		memset(&fdmod, 0, sizeof(fdmod));
+		fdmod.cf.can_id = m->mod[i].cf.can_id;
+		fdmod.cf.len = m->mod[i].cf.len;
+		memcpy(fdmod.cf.data, m->mod[i].cf.data, CAN_MAX_DLEN);
+		fdmod.modtype = m->mod[i].modtype;
+		add_attr(nh, fdattr[i], &fdmod, CGW_FDMODATTR_LEN);
+	}
+
+	if (m->has_xor)
+		add_attr(nh, CGW_CS_XOR, &m->xor, CGW_CS_XOR_LEN);
+	if (m->has_crc8)
+		add_attr(nh, CGW_CS_CRC8, &m->crc8, CGW_CS_CRC8_LEN);
+}
+
+/* sends a rule with RTM_NEWROUTE or RTM_DELROUTE, returns the kernel's answer */
+static int request(struct gw_kernel *k, int type, const struct gw_kernel_rule *r)
+{
+	char req[MSG_SIZE] __attribute__((aligned(NLMSG_ALIGNTO)));
+	char buf[8192] __attribute__((aligned(NLMSG_ALIGNTO)));
+	struct nlmsghdr *nh = (struct nlmsghdr *)req;
+	struct rtcanmsg *rtcan = NLMSG_DATA(nh);
+	struct nlmsgerr *err;
+	__u32 ifindex;
+	ssize_t len;
+
+	memset(req, 0, sizeof(req));
+	nh->nlmsg_len = NLMSG_LENGTH(sizeof(struct rtcanmsg));
+	nh->nlmsg_type = type;
+	nh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	nh->nlmsg_seq = ++k->seq;
+	rtcan->can_family = AF_CAN;
+	rtcan->gwtype = CGW_TYPE_CAN_CAN;
+	/* without echo vcan does not deliver the frames to local sockets */
+	rtcan->flags = CGW_FLAGS_CAN_ECHO | (r->fd ? CGW_FLAGS_CAN_FD : 0);
+
+	ifindex = r->src_ifindex;
+	add_attr(nh, CGW_SRC_IF, &ifindex, sizeof(ifindex));
+	ifindex = r->dst_ifindex;
+	add_attr(nh, CGW_DST_IF, &ifindex, sizeof(ifindex));
+	add_attr(nh, CGW_FILTER, &r->filter, sizeof(r->filter));
+	add_mods(nh, r);
+
+	if (send(k->s, req, nh->nlmsg_len, 0) < 0)
+		return -errno;
+
+	do {
+		len = recv(k->s, buf, sizeof(buf), 0);
+		if (len < 0)
+			return -errno;
+		for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+			if (nh->nlmsg_seq != k->seq || nh->nlmsg_type != NLMSG_ERROR)
+				continue;
+			err = NLMSG_DATA(nh);
+			return err->error;
+		}
+	} while (1);
+}
+
+int gw_kernel_open(struct gw_kernel *k)
+{
+	memset(k, 0, sizeof(*k));
+	k->s = socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+	return k->s < 0 ? -1 : 0;
+}
+
+int gw_kernel_add(struct gw_kernel *k, const struct gw_kernel_rule *r)
+{
+	int err;
+
+	if (k->n_rules == GW_KERNEL_MAX_RULES)
+		return -ENOSPC;
+
+	err = request(k, RTM_NEWROUTE, r);
+	if (!err)
+		k->rule[k->n_rules++] = *r;
+
+	return err;
+}
+
+int gw_kernel_del(struct gw_kernel *k, int i)
+{
+	int err;
+
+	err = request(k, RTM_DELROUTE, &k->rule[i]);
+	if (!err || err == -ENODEV || err == -EINVAL) {
+		/* gone with its interface, or removed by someone else */
+		memmove(&k->rule[i], &k->rule[i + 1],
+			(k->n_rules - i - 1) * sizeof(k->rule[0]));
+		k->n_rules--;
+	}
+
+	return err;
+}
+
+void gw_kernel_close(struct gw_kernel *k)
+{
+	int err, n;
+
+	if (k->s < 0)
+		return;
+
+	while ((n = k->n_rules)) {
+		err = gw_kernel_del(k, n - 1);
+		if (k->n_rules == n) {
+			fprintf(stderr, "can-gw: can't delete rule: %s\n", strerror(-err));
+			k->n_rules--;
+		}
+	}
+
+	close(k->s);
+	k->s = -1;
+}
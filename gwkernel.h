@@ -0,0 +1,74 @@
+/*
+ * gwkernel.h - in-kernel CAN routing through the can-gw netlink interface
+ *
+ * The can-gw module (modprobe can-gw) forwards frames between CAN
+ * interfaces inside the kernel, without the copies and syscalls of a
+ * userspace gateway.  A rule routes the frames of one source interface
+ * that pass a struct can_filter to one destination interface, either
+ * Classical CAN or CAN FD frames, optionally modifying them on the way
+ * (AND, OR, XOR and SET of ID, length and data, then an XOR or CRC8
+ * checksum).  Adding rules needs CAP_NET_ADMIN.
+ *
+ * Rules are added with CGW_FLAGS_CAN_ECHO like cangw -e, the forwarded
+ * frames reach the local sockets of the destination interface as frames
+ * sent by a local socket would, also on vcan interfaces without echo.
+ *
+ * Rules live in the kernel until they are deleted, gw_kernel_close()
+ * deletes every rule added through the handle.
+ */
+
+#ifndef GWKERNEL_H
+#define GWKERNEL_H
+
+#include <linux/types.h>
+#include <linux/can.h>
+#include <linux/can/gw.h>
+
+#define GW_KERNEL_MAX_RULES	1024
+
+/* optional modifications of a rule, zero = none */
+struct gw_kernel_mods {
+	struct cgw_frame_mod mod[CGW_MOD_FUNCS];	/* AND, OR, XOR, SET */
+	int has_xor, has_crc8;
+	struct cgw_csum_xor xor;
+	struct cgw_csum_crc8 crc8;
+};
+
+struct gw_kernel_rule {
+	int src_ifindex, dst_ifindex;
+	struct can_filter filter;
+	int fd;				/* CAN FD instead of Classical CAN */
+	struct gw_kernel_mods mods;
+};
+
+struct gw_kernel {
+	int s;
+	__u32 seq;
+	int n_rules;
+	struct gw_kernel_rule rule[GW_KERNEL_MAX_RULES];
+};
+
+int gw_kernel_open(struct gw_kernel *k);
+/*
+ * Opens the netlink socket.  Return values: 0 = success, -1 = error (errno set)
+ */
+
+int gw_kernel_add(struct gw_kernel *k, const struct gw_kernel_rule *r);
+/*
+ * Adds a rule to the kernel.
+ * Return values: 0 = success, otherwise the negative errno of the kernel,
+ * e.g. -EPERM without CAP_NET_ADMIN or -EOPNOTSUPP without can-gw
+ */
+
+int gw_kernel_del(struct gw_kernel *k, int i);
+/*
+ * Deletes rule i added through k from the kernel and from k.
+ * Return values: 0 = success, otherwise the negative errno of the kernel
+ */
+
+void gw_kernel_close(struct gw_kernel *k);
+/*
+ * Deletes all rules added through k and closes the socket.
+ */
+
+#endif
@@ -0,0 +1,295 @@
+/*
+ * gwlimit.c - rate limits of the gateway
+ *
+ * See gwlimit.h for the interface and the config format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gwlimit.h"
+
+void gw_limiter_init(struct gw_limiter *l)
+{
+	memset(l, 0, sizeof(*l));
+}
+
+static int find_iface(const struct gw_table *t, const char *name)
+{
+	int i;
+
+	for (i = 0; i < t->n_ifaces; i++)
+		if (!strcmp(t->iface[i].name, name))
+			return i;
+
+	return -1;
+}
+
+/* parses "rate[/burst]" */
+static int parse_rate(struct gw_limit *lim, const char *s)
+{
+	char *end;
+	long burst;
+
+	lim->rate = strtod(s, &end);
+	if (end == s || lim->rate <= 0 || lim->rate > 1e9)
+		return -1;
+
+	lim->burst = lim->rate / 10 + 0.999;
+	if (lim->burst < 1)
+		lim->burst = 1;
+	if (*end == '/') {
+		s = end + 1;
+		burst = strtol(s, &end, 10);
+		if (end == s || burst < 1 || burst > 1000000)
+			return -1;
+		lim->burst = burst;
+	}
+
+	return *end ? -1 : 0;
+}
+
+int gw_limiter_load(struct gw_limiter *l, const struct gw_table *t, const char *path)
+{
+	char line[1024], *src, *idstr, *rate, *extra, *save;
+	struct gw_limit *lim;
+	int lineno = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (strchr(line, '#'))
+			*strchr(line, '#') = 0;
+
+		src = strtok_r(line, " \t\r\n", &save);
+		if (!src)
+			continue;
+		idstr = strtok_r(NULL, " \t\r\n", &save);
+		rate = strtok_r(NULL, " \t\r\n", &save);
+		extra = strtok_r(NULL, " \t\r\n", &save);
+		if (!rate || extra) {
+			fprintf(stderr, "%s:%d: expected <source> <id[/mask]|all> <rate[/burst]>\n",
+				path, lineno);
+			goto err;
+		}
+		if (l->n_limits == GW_MAX_LIMITS) {
+			fprintf(stderr, "%s:%d: more than %d limits\n", path, lineno, GW_MAX_LIMITS);
+			goto err;
+		}
+		lim = &l->limit[l->n_limits];
+		memset(lim, 0, sizeof(*lim));
+
+		lim->src = find_iface(t, src);
+		if (lim->src < 0) {
+			fprintf(stderr, "%s:%d: '%s' is not an interface of the routes\n",
+				path, lineno, src);
+			goto err;
+		}
+
+		if (!strcmp(idstr, "all")) {
+			lim->all = 1;
+			lim->ext = 2;
+		} else if (gw_parse_id(idstr, &lim->id, &lim->mask, &lim->ext)) {
+			fprintf(stderr, "%s:%d: bad CAN ID '%s'\n", path, lineno, idstr);
+			goto err;
+		}
+		lim->id &= lim->mask;
+
+		if (parse_rate(lim, rate)) {
+			fprintf(stderr, "%s:%d: bad rate '%s'\n", path, lineno, rate);
+			goto err;
+		}
+
+		l->n_limits++;
+	}
+
+	fclose(f);
+	return 0;
+
+err:
+	fclose(f);
+	return -1;
+}
+
+static int new_bucket(struct gw_limiter *l, int k, canid_t can_id)
+{
+	const struct gw_limit *lim = &l->limit[k];
+	struct gw_bucket *b = &l->bucket[l->n_buckets];
+
+	memset(b, 0, sizeof(*b));
+	b->interval = 1e9 / lim->rate;
+	b->tolerance = (lim->burst - 1) * b->interval;
+	b->limit = k;
+	b->can_id = can_id;
+
+	return l->n_buckets++;
+}
+
+int gw_limiter_compile(struct gw_limiter *l, const struct gw_table *t)
+{
+	const struct gw_limit *lim;
+	int n = 0, s, k;
+	canid_t id;
+
+	/* at most a bucket per standard ID and one per other limit */
+	for (s = 0; s < t->n_ifaces; s++) {
+		for (k = 0; k < l->n_limits; k++)
+			if (l->limit[k].src == s)
+				break;
+		if (k < l->n_limits)
+			n += CAN_SFF_MASK + 1;
+	}
+	l->bucket = malloc((n + l->n_limits) * sizeof(*l->bucket));
+	if (!l->bucket)
+		return -1;
+
+	for (s = 0; s < t->n_ifaces; s++) {
+		l->all[s] = -1;
+		for (k = 0; k < l->n_limits; k++)
+			if (l->limit[k].src == s)
+				break;
+		if (k == l->n_limits)
+			continue;
+
+		l->std[s] = malloc((CAN_SFF_MASK + 1) * sizeof(*l->std[s]));
+		if (!l->std[s])
+			return -1;
+
+		for (id = 0; id <= CAN_SFF_MASK; id++) {
+			l->std[s][id] = -1;
+			for (k = 0; k < l->n_limits; k++) {
+				lim = &l->limit[k];
+				if (lim->src == s && !lim->all && lim->ext != 1 &&
+				    (id & lim->mask) == (lim->id & CAN_SFF_MASK)) {
+					l->std[s][id] = new_bucket(l, k, id);
+					break;
+				}
+			}
+		}
+
+		for (k = 0; k < l->n_limits; k++) {
+			lim = &l->limit[k];
+			if (lim->src != s)
+				continue;
+			if (lim->all && l->all[s] < 0)
+				l->all[s] = new_bucket(l, k, 0);
+			else if (!lim->all && lim->ext)
+				l->ext[k] = new_bucket(l, k, CAN_EFF_FLAG | lim->id);
+		}
+	}
+
+	return 0;
+}
+
+int gw_limiter_overlap(const struct gw_limiter *l, int src, canid_t id,
+		       canid_t mask, int ext)
+{
+	const struct gw_limit *lim;
+	int k;
+
+	for (k = 0; k < l->n_limits; k++) {
+		lim = &l->limit[k];
+		if (lim->src != src)
+			continue;
+		if (lim->ext != 2 && ext != 2 && lim->ext != ext)
+			continue;
+		if (!((lim->id ^ id) & lim->mask & mask))
+			return k;
+	}
+
+	return -1;
+}
+
+int gw_limiter_ext(struct gw_limiter *l, int src, canid_t can_id)
+{
+	const struct gw_limit *lim;
+	int k;
+
+	can_id &= CAN_EFF_MASK;
+	for (k = 0; k < l->n_limits; k++) {
+		lim = &l->limit[k];
+		if (lim->src == src && !lim->all && lim->ext && (can_id & lim->mask) == lim->id)
+			return l->ext[k];
+	}
+
+	return -1;
+}
+
+/* a bucket: the ID of a per ID bucket, the filter of the others */
+static void print_bucket(const struct gw_limit *lim, canid_t can_id)
+{
+	if (lim->all)
+		printf("%-17s", "all");
+	else if (!(can_id & CAN_EFF_FLAG))
+		printf("%03X%14s", can_id, "");
+	else if (lim->ext == 2)
+		printf("%-17s", "*");
+	else
+		printf("%08X/%08X", lim->id, lim->mask);
+}
+
+void gw_limiter_alert(struct gw_limiter *l, const struct gw_table *t,
+		      struct gw_bucket *b, __u64 now)
+{
+	const struct gw_limit *lim = &l->limit[b->limit];
+
+	printf("[Gateway] %-8s ", t->iface[lim->src].name);
+	print_bucket(lim, b->can_id);
+	printf(" over %g frames/s, %lu dropped\n", lim->rate, b->dropped - b->alerted);
+	fflush(stdout);
+
+	b->alerted = b->dropped;
+	b->next_alert = now + GW_ALERT_NS;
+}
+
+unsigned long gw_limiter_dropped(const struct gw_limiter *l, int src)
+{
+	unsigned long n = 0;
+	int i;
+
+	for (i = 0; i < l->n_buckets; i++)
+		if (l->limit[l->bucket[i].limit].src == src)
+			n += l->bucket[i].dropped;
+
+	return n;
+}
+
+void gw_limiter_print(const struct gw_limiter *l, const struct gw_table *t)
+{
+	const struct gw_limit *lim;
+	int k;
+
+	for (k = 0; k < l->n_limits; k++) {
+		lim = &l->limit[k];
+		printf("limit   %-8s ", t->iface[lim->src].name);
+		if (lim->all)
+			printf("%-17s", "all");
+		else if (lim->ext == 2)
+			printf("%-17s", "*");
+		else if (lim->ext)
+			printf("%08X/%08X", lim->id, lim->mask);
+		else
+			printf("%03X/%03X%10s", lim->id, lim->mask, "");
+		printf(" %g frames/s, burst %d\n", lim->rate, lim->burst);
+	}
+}
+
+void gw_limiter_free(struct gw_limiter *l)
+{
+	int s;
+
+	for (s = 0; s < GW_MAX_IFACES; s++) {
+		free(l->std[s]);
+		l->std[s] = NULL;
+	}
+	free(l->bucket);
+	l->bucket = NULL;
+	l->n_buckets = 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * gwlimit.h - rate limits of the gateway
+ *
+ * Limits are read from a config file (gateway -l) with one limit per line:
+ *
+ *	# source  id[/mask]|all  rate[/burst]
+ *	vcan0     123            100/5
+ *	vcan0     *              500
+ *	vcan0     all            2000/200
+ *
+ * The ID is given as for routes (see gwroute.h).  Every standard ID
+ * matching a limit gets a bucket of its own, a limit for 29 bit IDs has
+ * one bucket for all of them.  The first limit that matches an ID applies.
+ * "all" limits everything the interface receives, on top of the per ID
+ * limits.  The rate is in frames per second, the burst (frames that may
+ * come back to back, default a tenth of the rate) is the bucket size.
+ *
+ * A bucket is the single number of the generic cell rate algorithm: the
+ * time the next frame is due.  A frame passes if it is not earlier than
+ * that time minus the burst tolerance, which costs a compare and an add.
+ * The buckets of a source interface are only used by the thread receiving
+ * from it, so they need no locks or atomics.  Frames over the limit are
+ * dropped and counted, and an alert is printed at most once per second and
+ * bucket.
+ */
+
+#ifndef GWLIMIT_H
+#define GWLIMIT_H
+
+#include <linux/types.h>
+#include <linux/can.h>
+
+#include "gwroute.h"
+
+#define GW_MAX_LIMITS	256
+#define GW_ALERT_NS	1000000000ULL	/* between alerts of a bucket */
+
+struct gw_limit {
+	int src;
+	canid_t id, mask;	/* as in struct gw_route */
+	int ext;
+	int all;		/* for the interface, not per ID */
+	double rate;
+	int burst;
+};
+
+struct gw_bucket {
+	__u64 due;		/* when the next frame may come, ns */
+	__u64 interval;		/* 1 / rate */
+	__u64 tolerance;	/* (burst - 1) * interval */
+	unsigned long passed, dropped;
+	unsigned long alerted;	/* dropped at the previous alert */
+	__u64 next_alert;
+	int limit;
+	canid_t can_id;		/* of a per ID bucket, for the alerts */
+};
+
+struct gw_limiter {
+	int n_limits;
+	struct gw_limit limit[GW_MAX_LIMITS];
+
+	/* compiled, per source interface */
+	int *std[GW_MAX_IFACES];	/* bucket per 11 bit ID, -1 = none */
+	int all[GW_MAX_IFACES];		/* bucket of the interface, -1 = none */
+	int ext[GW_MAX_LIMITS];		/* bucket of a 29 bit limit */
+	struct gw_bucket *bucket;
+	int n_buckets;
+};
+
+void gw_limiter_init(struct gw_limiter *l);
+
+int gw_limiter_load(struct gw_limiter *l, const struct gw_table *t, const char *path);
+/*
+ * Reads limits for the interfaces of t from a config file, errors are
+ * printed with their line.  Return values: 0 = success, -1 = error
+ */
+
+int gw_limiter_compile(struct gw_limiter *l, const struct gw_table *t);
+/*
+ * Creates the buckets.  Return values: 0 = success, -1 = out of memory
+ */
+
+int gw_limiter_overlap(const struct gw_limiter *l, int src, canid_t id,
+		       canid_t mask, int ext);
+/*
+ * Returns the first limit of src that applies to an ID of the given route
+ * filter, or -1.
+ */
+
+int gw_limiter_ext(struct gw_limiter *l, int src, canid_t can_id);
+/*
+ * Returns the bucket of a 29 bit ID, -1 = no limit.
+ */
+
+void gw_limiter_alert(struct gw_limiter *l, const struct gw_table *t,
+		      struct gw_bucket *b, __u64 now);
+/*
+ * Prints how many frames bucket b dropped since its previous alert.
+ */
+
+unsigned long gw_limiter_dropped(const struct gw_limiter *l, int src);
+/*
+ * Returns the frames from src dropped by its limits.
+ */
+
+void gw_limiter_print(const struct gw_limiter *l, const struct gw_table *t);
+
+void gw_limiter_free(struct gw_limiter *l);
+
+/* b has room for a frame at now */
+static inline int gw_bucket_ok(const struct gw_bucket *b, __u64 now)
+{
+	return now + b->tolerance >= b->due;
+}
+
+static inline void gw_bucket_take(struct gw_bucket *b, __u64 now)
+{
+	b->due = (b->due > now ? b->due : now) + b->interval;
+	b->passed++;
+}
+
+/*
+ * Checks a frame received on src at now against its ID and interface
+ * limits.  Return values: 1 = pass, 0 = drop
+ */
+static inline int gw_limiter_pass(struct gw_limiter *l, const struct gw_table *t,
+				  int src, canid_t can_id, __u64 now)
+{
+	struct gw_bucket *id = NULL, *all = NULL, *over;
+	int k;
+
+	if (!l->std[src])
+		return 1;
+
+	if (!(can_id & CAN_EFF_FLAG))
+		k = l->std[src][can_id & CAN_SFF_MASK];
+	else
+		k = gw_limiter_ext(l, src, can_id);
+	if (k >= 0)
+		id = &l->bucket[k];
+	if (l->all[src] >= 0)
+		all = &l->bucket[l->all[src]];
+
+	over = id && !gw_bucket_ok(id, now) ? id : all && !gw_bucket_ok(all, now) ? all : NULL;
+	if (over) {
+		over->dropped++;
+		if (now >= over->next_alert)
+			gw_limiter_alert(l, t, over, now);
+		return 0;
+	}
+
+	if (id)
+		gw_bucket_take(id, now);
+	if (all)
+		gw_bucket_take(all, now);
+
+	return 1;
+}
+
+#endif
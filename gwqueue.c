@@ -0,0 +1,173 @@
+/*
+ * gwqueue.c - egress priority queue of the gateway
+ *
+ * See gwqueue.h for the interface.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gwqueue.h"
+
+/*
+ * The bits in the order arbitration sees them: the 11 bit base ID, then
+ * SRR/IDE, which lets a standard frame win over an extended one with the
+ * same base ID, then the 18 bit ID extension.
+ */
+static __u32 arbitration(canid_t can_id)
+{
+	if (!(can_id & CAN_EFF_FLAG))
+		return (can_id & CAN_SFF_MASK) << 19;
+
+	can_id &= CAN_EFF_MASK;
+	return (can_id >> 18) << 19 | 1 << 18 | (can_id & 0x3FFFF);
+}
+
+/* a goes out before b */
+static int before(const struct gw_queue *q, int a, int b)
+{
+	const struct gw_qentry *x = &q->slot[a], *y = &q->slot[b];
+
+	if (x->prio != y->prio)
+		return x->prio < y->prio;
+	return (__s32)(x->seq - y->seq) < 0;
+}
+
+static void sift_up(struct gw_queue *q, int k)
+{
+	int i = q->heap[k];
+
+	while (k && before(q, i, q->heap[(k - 1) / 2])) {
+		q->heap[k] = q->heap[(k - 1) / 2];
+		k = (k - 1) / 2;
+	}
+	q->heap[k] = i;
+}
+
+static void sift_down(struct gw_queue *q, int k)
+{
+	int i = q->heap[k], c;
+
+	while ((c = 2 * k + 1) < q->n) {
+		if (c + 1 < q->n && before(q, q->heap[c + 1], q->heap[c]))
+			c++;
+		if (!before(q, q->heap[c], i))
+			break;
+		q->heap[k] = q->heap[c];
+		k = c;
+	}
+	q->heap[k] = i;
+}
+
+int gw_queue_init(struct gw_queue *q, int depth)
+{
+	int i;
+
+	memset(q, 0, sizeof(*q));
+	q->heap = malloc(depth * sizeof(*q->heap));
+	q->slot = malloc(depth * sizeof(*q->slot));
+	q->free_slot = malloc(depth * sizeof(*q->free_slot));
+	if (!q->heap || !q->slot || !q->free_slot) {
+		gw_queue_free(q);
+		return -1;
+	}
+
+	q->depth = depth;
+	for (i = 0; i < depth; i++)
+		q->free_slot[i] = depth - 1 - i;
+	q->n_free = depth;
+
+	return 0;
+}
+
+void gw_queue_free(struct gw_queue *q)
+{
+	free(q->heap);
+	free(q->slot);
+	free(q->free_slot);
+	q->heap = q->free_slot = NULL;
+	q->slot = NULL;
+	q->depth = q->n = q->n_free = 0;
+}
+
+int gw_queue_push(struct gw_queue *q, const struct canfd_frame *cf, int len,
+		  int route, __u64 rx_ns, __u64 now_ns, int *dropped_route)
+{
+	struct gw_qentry *e;
+	__u32 prio = arbitration(cf->can_id);
+	int i, k, worst, ret = 0;
+
+	if (q->n_free) {
+		i = q->free_slot[--q->n_free];
+		k = q->n++;
+	} else {
+		/* full: the lowest priority frame is one of the leaves */
+		if (!q->n)
+			goto drop;
+		worst = q->n / 2;
+		for (k = worst + 1; k < q->n; k++)
+			if (before(q, q->heap[worst], q->heap[k]))
+				worst = k;
+		if (q->slot[q->heap[worst]].prio <= prio)
+			goto drop;
+		/* a leaf with a new smaller value only has to move up */
+		i = q->heap[worst];
+		k = worst;
+		ret = 1;
+		q->dropped++;
+		*dropped_route = q->slot[i].route;
+	}
+
+	e = &q->slot[i];
+	memcpy(&e->cf, cf, len);
+	e->len = len;
+	e->route = route;
+	e->rx_ns = rx_ns;
+	e->queued_ns = now_ns;
+	e->prio = prio;
+	e->seq = q->seq++;
+
+	q->heap[k] = i;
+	sift_up(q, k);
+	if (q->n > q->max_n)
+		q->max_n = q->n;
+
+	return ret;
+
+drop:
+	q->dropped++;
+	*dropped_route = route;
+	return -1;
+}
+
+int gw_queue_pop(struct gw_queue *q)
+{
+	int i;
+
+	if (!q->n)
+		return -1;
+
+	i = q->heap[0];
+	q->heap[0] = q->heap[--q->n];
+	if (q->n)
+		sift_down(q, 0);
+
+	return i;
+}
+
+void gw_queue_requeue(struct gw_queue *q, int i)
+{
+	q->heap[q->n] = i;
+	sift_up(q, q->n++);
+}
+
+void gw_queue_done(struct gw_queue *q, int i, __u64 now_ns)
+{
+	__u64 delay = now_ns > q->slot[i].queued_ns ? now_ns - q->slot[i].queued_ns : 0;
+
+	q->free_slot[q->n_free++] = i;
+	q->sent++;
+	q->delay_hist[loghist_bucket(delay)]++;
+	if (delay > q->delay_max_ns)
+		q->delay_max_ns = delay;
+}
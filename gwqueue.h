@@ -0,0 +1,85 @@
+/*
+ * gwqueue.h - egress priority queue of the gateway
+ *
+ * With gateway -q every destination interface gets a queue that hands out
+ * frames in the order CAN arbitration would put them on the bus: lowest
+ * ID first, a standard frame before an extended frame with the same base
+ * ID, frames of the same ID in arrival order.  When the queue is full the
+ * frame with the highest ID is dropped, which may be the new one, so bulk
+ * traffic can not push out e.g. door commands.
+ *
+ * The queue is a binary heap of slot indices.  Frames stay in their slot
+ * from gw_queue_push() until gw_queue_done(), a popped frame can be handed
+ * to sendmmsg() directly and put back with gw_queue_requeue() if the
+ * interface did not take it.  A queue belongs to one thread.
+ */
+
+#ifndef GWQUEUE_H
+#define GWQUEUE_H
+
+#include <linux/types.h>
+#include <linux/can.h>
+
+#include "gwstats.h"
+
+struct gw_qentry {
+	struct canfd_frame cf;
+	int len;		/* CAN_MTU or CANFD_MTU */
+	int route;		/* for the metrics (see gwstats.h) */
+	__u64 rx_ns;		/* receive time, for the metrics */
+	__u64 queued_ns;	/* CLOCK_MONOTONIC time of gw_queue_push() */
+	__u32 prio;		/* arbitration order, lower wins */
+	__u32 seq;		/* arrival order */
+};
+
+struct gw_queue {
+	int depth;
+	int n;			/* frames in the heap */
+	__u32 seq;
+	int *heap;		/* slot indices */
+	struct gw_qentry *slot;
+	int *free_slot, n_free;
+
+	/* statistics */
+	int max_n;			/* highest fill level */
+	unsigned long dropped;		/* pushed out by higher priority frames */
+	unsigned long sent;
+	__u64 delay_max_ns;
+	__u64 delay_hist[LOGHIST_BUCKETS];	/* push to gw_queue_done() */
+};
+
+int gw_queue_init(struct gw_queue *q, int depth);
+/*
+ * Allocates a queue for depth frames.
+ * Return values: 0 = success, -1 = out of memory
+ */
+
+void gw_queue_free(struct gw_queue *q);
+
+int gw_queue_push(struct gw_queue *q, const struct canfd_frame *cf, int len,
+		  int route, __u64 rx_ns, __u64 now_ns, int *dropped_route);
+/*
+ * Queues a copy of the frame, dropping the lowest priority frame if the
+ * queue is full.  The route of the dropped frame goes to *dropped_route.
+ * Return values: 0 = queued, 1 = queued and another frame dropped,
+ * -1 = the frame itself was dropped
+ */
+
+int gw_queue_pop(struct gw_queue *q);
+/*
+ * Takes the highest priority frame out of the heap, its slot stays valid.
+ * Return values: slot index, -1 = queue empty
+ */
+
+void gw_queue_requeue(struct gw_queue *q, int i);
+/*
+ * Puts a popped frame back, in its old place of the order.
+ */
+
+void gw_queue_done(struct gw_queue *q, int i, __u64 now_ns);
+/*
+ * Frees the slot of a popped frame that was sent and counts its queueing
+ * delay.
+ */
+
+#endif
@@ -0,0 +1,418 @@
+/*
+ * gwrewrite.c - frame rewriting rules of the gateway
+ *
+ * See gwrewrite.h for the interface and the config format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "gwrewrite.h"
+
+static const char *op_name[] = {
+	"id", "set", "and", "or", "xor", "xorsum", "sum", "crc8"
+};
+
+static __u8 crc8_table[256];
+
+/* SAE J1850: polynomial 0x1D, initial value and final XOR 0xFF */
+static void crc8_init(void)
+{
+	__u8 crc;
+	int i, b;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (b = 0; b < 8; b++)
+			crc = crc & 0x80 ? (crc << 1) ^ 0x1D : crc << 1;
+		crc8_table[i] = crc;
+	}
+}
+
+void gw_rewrite_init(struct gw_rewrite *rw)
+{
+	memset(rw, 0, sizeof(*rw));
+	if (!crc8_table[1])
+		crc8_init();
+}
+
+static int hex_nibble(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c = tolower((unsigned char)c);
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/* parses a data pattern like "02.." */
+static int parse_pattern(struct gw_rule *r, const char *s)
+{
+	__u8 val[GW_PATTERN_LEN] = { 0 }, mask[GW_PATTERN_LEN] = { 0 };
+	int len = strlen(s), i, v;
+
+	if (len % 2 || len > 2 * GW_PATTERN_LEN)
+		return -1;
+
+	for (i = 0; i < len; i++) {
+		if (s[i] == '.')
+			continue;
+		v = hex_nibble(s[i]);
+		if (v < 0)
+			return -1;
+		val[i / 2] |= v << (i % 2 ? 0 : 4);
+		mask[i / 2] |= 0xF << (i % 2 ? 0 : 4);
+	}
+
+	memcpy(&r->data, val, sizeof(r->data));
+	memcpy(&r->data_mask, mask, sizeof(r->data_mask));
+	if (len / 2 > r->min_len)
+		r->min_len = len / 2;
+
+	return 0;
+}
+
+static int parse_byte(const char *s, char **end)
+{
+	long n = strtol(s, end, 10);
+
+	if (*end == s || n < 0 || n >= CANFD_MAX_DLEN)
+		return -1;
+
+	return n;
+}
+
+/* parses "op[n]=value" or "id=X" */
+static int parse_action(struct gw_rule *r, const char *s)
+{
+	struct gw_action *a = &r->action[r->n_actions];
+	const char *eq = strchr(s, '=');
+	canid_t mask;
+	int op, len, ext;
+	char *end;
+	long v;
+
+	if (!eq || r->n_actions == GW_MAX_ACTIONS)
+		return -1;
+	memset(a, 0, sizeof(*a));
+
+	len = strcspn(s, "[=");
+	for (op = 0; op <= GW_ACT_CRC8; op++)
+		if ((int)strlen(op_name[op]) == len && !strncmp(s, op_name[op], len))
+			break;
+	if (op > GW_ACT_CRC8)
+		return -1;
+	a->op = op;
+
+	if (op == GW_ACT_ID) {
+		if (s[len] != '=' || gw_parse_id(eq + 1, &a->can_id, &mask, &ext) ||
+		    ext == 2 || strchr(eq, '/'))
+			return -1;
+		if (ext)
+			a->can_id |= CAN_EFF_FLAG;
+		r->n_actions++;
+		return 0;
+	}
+
+	if (s[len] != '[')
+		return -1;
+	a->byte = parse_byte(s + len + 1, &end);
+	if (a->byte < 0 || strncmp(end, "]=", 2))
+		return -1;
+
+	if (op >= GW_ACT_XORSUM) {
+		a->from = parse_byte(end + 2, &end);
+		if (a->from < 0 || *end != '-')
+			return -1;
+		a->to = parse_byte(end + 1, &end);
+		if (a->to < a->from || *end)
+			return -1;
+		if (a->to >= r->min_len)
+			r->min_len = a->to + 1;
+	} else {
+		v = strtol(end + 2, &end, 16);
+		if (!*(eq + 1) || *end || v < 0 || v > 0xFF)
+			return -1;
+		a->val = v;
+	}
+	if (a->byte >= r->min_len)
+		r->min_len = a->byte + 1;
+
+	r->n_actions++;
+	return 0;
+}
+
+static int find_iface(const struct gw_table *t, const char *name)
+{
+	int i;
+
+	for (i = 0; i < t->n_ifaces; i++)
+		if (!strcmp(t->iface[i].name, name))
+			return i;
+
+	return -1;
+}
+
+int gw_rewrite_load(struct gw_rewrite *rw, const struct gw_table *t, const char *path)
+{
+	char line[1024], *tok, *save;
+	struct gw_rule *r;
+	int lineno = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (strchr(line, '#'))
+			*strchr(line, '#') = 0;
+
+		tok = strtok_r(line, " \t\r\n", &save);
+		if (!tok)
+			continue;
+		if (rw->n_rules == GW_MAX_RULES) {
+			fprintf(stderr, "%s:%d: more than %d rules\n", path, lineno, GW_MAX_RULES);
+			goto err;
+		}
+		r = &rw->rule[rw->n_rules];
+		memset(r, 0, sizeof(*r));
+
+		r->src = find_iface(t, tok);
+		if (r->src < 0) {
+			fprintf(stderr, "%s:%d: '%s' is not an interface of the routes\n",
+				path, lineno, tok);
+			goto err;
+		}
+
+		tok = strtok_r(NULL, " \t\r\n", &save);
+		if (!tok || gw_parse_id(tok, &r->id, &r->mask, &r->ext)) {
+			fprintf(stderr, "%s:%d: bad CAN ID '%s'\n", path, lineno, tok ? tok : "");
+			goto err;
+		}
+		r->id &= r->mask;
+
+		tok = strtok_r(NULL, " \t\r\n", &save);
+		if (tok && !strchr(tok, '=')) {
+			if (parse_pattern(r, tok)) {
+				fprintf(stderr, "%s:%d: bad data pattern '%s'\n", path, lineno, tok);
+				goto err;
+			}
+			tok = strtok_r(NULL, " \t\r\n", &save);
+		}
+
+		if (!tok) {
+			fprintf(stderr, "%s:%d: expected <source> <id[/mask]> [data] <action...>\n",
+				path, lineno);
+			goto err;
+		}
+		for (; tok; tok = strtok_r(NULL, " \t\r\n", &save)) {
+			if (parse_action(r, tok)) {
+				fprintf(stderr, "%s:%d: bad action '%s' or more than %d actions\n",
+					path, lineno, tok, GW_MAX_ACTIONS);
+				goto err;
+			}
+		}
+
+		rw->n_rules++;
+	}
+
+	fclose(f);
+	return 0;
+
+err:
+	fclose(f);
+	return -1;
+}
+
+/* appends a list, returns its offset, reusing an identical one */
+static int add_list(struct gw_rewrite *rw, const short *l, int n, int *size)
+{
+	short *list;
+	int i;
+
+	for (i = 0; i + n < rw->n_list; i++)
+		if (!memcmp(&rw->list[i], l, n * sizeof(*l)) && rw->list[i + n] < 0 &&
+		    (!i || rw->list[i - 1] < 0))
+			return i;
+
+	if (rw->n_list + n + 1 > *size) {
+		*size = 2 * (*size + n + 1);
+		list = realloc(rw->list, *size * sizeof(*list));
+		if (!list)
+			return -1;
+		rw->list = list;
+	}
+	memcpy(&rw->list[rw->n_list], l, n * sizeof(*l));
+	rw->list[rw->n_list + n] = -1;
+	rw->n_list += n + 1;
+
+	return rw->n_list - n - 1;
+}
+
+int gw_rewrite_compile(struct gw_rewrite *rw, const struct gw_table *t)
+{
+	short l[GW_MAX_RULES];
+	int size = 0, s, k, n, off;
+	canid_t id;
+	const struct gw_rule *r;
+
+	for (s = 0; s < t->n_ifaces; s++) {
+		for (k = 0; k < rw->n_rules; k++)
+			if (rw->rule[k].src == s)
+				break;
+		if (k == rw->n_rules)
+			continue;
+
+		rw->std[s] = malloc((CAN_SFF_MASK + 1) * sizeof(*rw->std[s]));
+		if (!rw->std[s])
+			return -1;
+
+		for (id = 0; id <= CAN_SFF_MASK; id++) {
+			n = 0;
+			for (k = 0; k < rw->n_rules; k++) {
+				r = &rw->rule[k];
+				if (r->src == s && r->ext != 1 &&
+				    (id & r->mask) == (r->id & CAN_SFF_MASK))
+					l[n++] = k;
+			}
+			off = n ? add_list(rw, l, n, &size) : -1;
+			if (n && off < 0)
+				return -1;
+			rw->std[s][id] = off;
+		}
+
+		n = 0;
+		for (k = 0; k < rw->n_rules; k++)
+			if (rw->rule[k].src == s && rw->rule[k].ext)
+				l[n++] = k;
+		rw->ext[s] = add_list(rw, l, n, &size);
+		if (rw->ext[s] < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int gw_rewrite_overlap(const struct gw_rewrite *rw, int src, canid_t id,
+		       canid_t mask, int ext)
+{
+	const struct gw_rule *r;
+	int k;
+
+	for (k = 0; k < rw->n_rules; k++) {
+		r = &rw->rule[k];
+		if (r->src != src)
+			continue;
+		if (r->ext != 2 && ext != 2 && r->ext != ext)
+			continue;
+		if (!((r->id ^ id) & r->mask & mask))
+			return k;
+	}
+
+	return -1;
+}
+
+void gw_rewrite_apply(const struct gw_rule *r, struct canfd_frame *cf)
+{
+	const struct gw_action *a;
+	__u8 v;
+	int i, b;
+
+	for (i = 0; i < r->n_actions; i++) {
+		a = &r->action[i];
+		switch (a->op) {
+		case GW_ACT_ID:
+			cf->can_id = a->can_id | (cf->can_id & CAN_RTR_FLAG);
+			break;
+		case GW_ACT_SET:
+			cf->data[a->byte] = a->val;
+			break;
+		case GW_ACT_AND:
+			cf->data[a->byte] &= a->val;
+			break;
+		case GW_ACT_OR:
+			cf->data[a->byte] |= a->val;
+			break;
+		case GW_ACT_XOR:
+			cf->data[a->byte] ^= a->val;
+			break;
+		case GW_ACT_XORSUM:
+			for (v = 0, b = a->from; b <= a->to; b++)
+				v ^= cf->data[b];
+			cf->data[a->byte] = v;
+			break;
+		case GW_ACT_SUM:
+			for (v = 0, b = a->from; b <= a->to; b++)
+				v += cf->data[b];
+			cf->data[a->byte] = v;
+			break;
+		case GW_ACT_CRC8:
+			for (v = 0xFF, b = a->from; b <= a->to; b++)
+				v = crc8_table[v ^ cf->data[b]];
+			cf->data[a->byte] = v ^ 0xFF;
+			break;
+		}
+	}
+}
+
+void gw_rewrite_print(const struct gw_rewrite *rw, const struct gw_table *t)
+{
+	const struct gw_rule *r;
+	const struct gw_action *a;
+	__u8 val[GW_PATTERN_LEN], mask[GW_PATTERN_LEN];
+	int k, i, n;
+
+	for (k = 0; k < rw->n_rules; k++) {
+		r = &rw->rule[k];
+		printf("rewrite %-8s ", t->iface[r->src].name);
+		if (r->ext == 2)
+			printf("%-17s", "*");
+		else if (r->ext)
+			printf("%08X/%08X", r->id, r->mask);
+		else
+			printf("%03X/%03X%10s", r->id, r->mask, "");
+
+		memcpy(val, &r->data, sizeof(val));
+		memcpy(mask, &r->data_mask, sizeof(mask));
+		for (n = GW_PATTERN_LEN; n && !mask[n - 1]; n--)
+			;
+		if (n)
+			printf(" ");
+		for (i = 0; i < n; i++) {
+			printf("%c", mask[i] & 0xF0 ? "0123456789ABCDEF"[val[i] >> 4] : '.');
+			printf("%c", mask[i] & 0x0F ? "0123456789ABCDEF"[val[i] & 0xF] : '.');
+		}
+
+		for (i = 0; i < r->n_actions; i++) {
+			a = &r->action[i];
+			if (a->op == GW_ACT_ID)
+				printf(a->can_id & CAN_EFF_FLAG ? " id=%08X" : " id=%03X",
+				       a->can_id & CAN_EFF_MASK);
+			else if (a->op >= GW_ACT_XORSUM)
+				printf(" %s[%d]=%d-%d", op_name[a->op], a->byte, a->from, a->to);
+			else
+				printf(" %s[%d]=%02X", op_name[a->op], a->byte, a->val);
+		}
+		printf("\n");
+	}
+}
+
+void gw_rewrite_free(struct gw_rewrite *rw)
+{
+	int s;
+
+	for (s = 0; s < GW_MAX_IFACES; s++) {
+		free(rw->std[s]);
+		rw->std[s] = NULL;
+	}
+	free(rw->list);
+	rw->list = NULL;
+	rw->n_list = 0;
+}
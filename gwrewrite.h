@@ -0,0 +1,171 @@
+/*
+ * gwrewrite.h - frame rewriting rules of the gateway
+ *
+ * Rules are read from a config file (gateway -r) with one rule per line:
+ *
+ *	# source  id[/mask]  [data]  action...
+ *	vcan0     244        id=255
+ *	vcan2     7DF        02..    set[2]=00 xor[0]=FF
+ *	vcan0     188        1.      and[1]=0F or[1]=80 crc8[7]=0-6
+ *
+ * The ID is given as for routes (see gwroute.h).  The optional data
+ * pattern is hex for the first bytes of the payload, "." matches any
+ * nibble.  Actions, done in order:
+ *
+ *	id=X		set the CAN ID (29 bit if above 7FF or more than 3 digits)
+ *	set[n]=X	set byte n
+ *	and[n]=X	AND, OR or XOR byte n with X
+ *	or[n]=X
+ *	xor[n]=X
+ *	xorsum[n]=a-b	byte n = XOR of bytes a to b
+ *	sum[n]=a-b	byte n = sum of bytes a to b, modulo 256
+ *	crc8[n]=a-b	byte n = CRC8 SAE J1850 of bytes a to b
+ *
+ * A rule only matches frames long enough for its pattern and for every
+ * byte its actions touch.  The first matching rule of the source
+ * interface rewrites a frame, before it is sent to any destination;
+ * routing still uses the received ID.
+ *
+ * gw_rewrite_compile() gives every standard ID of a source the list of
+ * rules that can match it, so a standard frame costs one array access, a
+ * compare per byte pattern and its actions.  Identical lists are shared.
+ * Rules for 29 bit IDs are checked one by one.
+ */
+
+#ifndef GWREWRITE_H
+#define GWREWRITE_H
+
+#include <string.h>
+#include <linux/types.h>
+#include <linux/can.h>
+
+#include "gwroute.h"
+
+#define GW_MAX_RULES	256
+#define GW_MAX_ACTIONS	8
+#define GW_PATTERN_LEN	8	/* bytes a data pattern can cover */
+
+enum {
+	GW_ACT_ID,
+	GW_ACT_SET,
+	GW_ACT_AND,
+	GW_ACT_OR,
+	GW_ACT_XOR,
+	GW_ACT_XORSUM,
+	GW_ACT_SUM,
+	GW_ACT_CRC8,
+};
+
+struct gw_action {
+	int op;
+	int byte;		/* the byte changed */
+	int from, to;		/* checksum range */
+	__u8 val;
+	canid_t can_id;		/* GW_ACT_ID */
+};
+
+struct gw_rule {
+	int src;
+	canid_t id, mask;	/* as in struct gw_route */
+	int ext;
+	__u64 data, data_mask;	/* pattern on the first 8 bytes */
+	int min_len;		/* shorter frames do not match */
+	int n_actions;
+	struct gw_action action[GW_MAX_ACTIONS];
+};
+
+struct gw_rewrite {
+	int n_rules;
+	struct gw_rule rule[GW_MAX_RULES];
+
+	/* compiled, per source interface */
+	int *std[GW_MAX_IFACES];	/* offset in list per 11 bit ID, -1 = none */
+	int ext[GW_MAX_IFACES];		/* offset in list of the 29 bit rules */
+	short *list;			/* rule indexes, each list ends with -1 */
+	int n_list;
+};
+
+void gw_rewrite_init(struct gw_rewrite *rw);
+
+int gw_rewrite_load(struct gw_rewrite *rw, const struct gw_table *t, const char *path);
+/*
+ * Reads rules for the interfaces of t from a config file, errors are
+ * printed with their line.  Return values: 0 = success, -1 = error
+ */
+
+int gw_rewrite_compile(struct gw_rewrite *rw, const struct gw_table *t);
+/*
+ * Builds the per ID rule lists.  Return values: 0 = success, -1 = out of memory
+ */
+
+int gw_rewrite_overlap(const struct gw_rewrite *rw, int src, canid_t id,
+		       canid_t mask, int ext);
+/*
+ * Returns the first rule of src that can match an ID of the given route
+ * filter, or -1.
+ */
+
+void gw_rewrite_apply(const struct gw_rule *r, struct canfd_frame *cf);
+/*
+ * Does the actions of r on cf, which must match r.
+ */
+
+void gw_rewrite_print(const struct gw_rewrite *rw, const struct gw_table *t);
+
+void gw_rewrite_free(struct gw_rewrite *rw);
+
+static inline int gw_rule_match(const struct gw_rule *r, const struct canfd_frame *cf)
+{
+	__u64 data;
+
+	if (cf->len < r->min_len)
+		return 0;
+	if (r->data_mask) {
+		memcpy(&data, cf->data, sizeof(data));
+		if ((data ^ r->data) & r->data_mask)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Rewrites a frame received on src with the first rule that matches.
+ * Return values: 1 = rewritten, 0 = no rule
+ */
+static inline int gw_rewrite_frame(const struct gw_rewrite *rw, int src,
+				   struct canfd_frame *cf)
+{
+	const struct gw_rule *r;
+	const short *l;
+	canid_t id;
+
+	if (!rw->std[src])
+		return 0;
+
+	if (!(cf->can_id & CAN_EFF_FLAG)) {
+		if (rw->std[src][cf->can_id & CAN_SFF_MASK] < 0)
+			return 0;
+		for (l = &rw->list[rw->std[src][cf->can_id & CAN_SFF_MASK]]; *l >= 0; l++) {
+			r = &rw->rule[*l];
+			if (gw_rule_match(r, cf)) {
+				gw_rewrite_apply(r, cf);
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	id = cf->can_id & CAN_EFF_MASK;
+	for (l = &rw->list[rw->ext[src]]; *l >= 0; l++) {
+		r = &rw->rule[*l];
+		if ((id & r->mask) == r->id && gw_rule_match(r, cf)) {
+			gw_rewrite_apply(r, cf);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * gwring.h - lock-free frame queue between gateway workers
+ *
+ * In threaded mode (gateway -t) every pair of ingress and egress
+ * interface that has a route gets its own ring.  The ingress worker is the
+ * only producer and the egress worker the only consumer of it, so a push
+ * or pop is a plain copy plus one release store, without locked
+ * instructions.  An egress worker consumes the rings of all its sources,
+ * which makes the set of rings of one destination a multi-producer,
+ * single-consumer queue.  Frames of one CAN ID from one source always use
+ * the same ring, so their order is kept.
+ *
+ * The producer publishes a whole receive batch with gw_ring_publish(), the
+ * consumer sends the frames straight from the ring slots and releases them
+ * with gw_ring_release() when sendmmsg() returned.
+ */
+
+#ifndef GWRING_H
+#define GWRING_H
+
+#include <string.h>
+#include <stdatomic.h>
+#include <linux/types.h>
+#include <linux/can.h>
+
+#define GW_RING_SLOTS	1024	/* power of two */
+
+struct gw_slot {
+	struct canfd_frame cf;
+	int len;		/* CAN_MTU or CANFD_MTU */
+	int route;		/* for the metrics (see gwstats.h) */
+	__u64 rx_ns;		/* receive time, for the metrics */
+};
+
+struct gw_ring {
+	/* consumer */
+	_Atomic unsigned int head __attribute__((aligned(64)));
+
+	/* producer */
+	_Atomic unsigned int tail __attribute__((aligned(64)));
+	unsigned int next;		/* tail after the frames pushed so far */
+	unsigned int head_cache;	/* last head seen */
+	unsigned long dropped;		/* frames that found the ring full */
+
+	struct gw_slot slot[GW_RING_SLOTS] __attribute__((aligned(64)));
+};
+
+/*
+ * Copies a frame into the ring, invisible to the consumer until
+ * gw_ring_publish().  Return values: 0 = queued, -1 = ring full (dropped)
+ */
+static inline int gw_ring_push(struct gw_ring *r, const struct canfd_frame *cf,
+			       int len, int route, __u64 rx_ns)
+{
+	struct gw_slot *s;
+
+	if (r->next - r->head_cache == GW_RING_SLOTS) {
+		r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+		if (r->next - r->head_cache == GW_RING_SLOTS) {
+			r->dropped++;
+			return -1;
+		}
+	}
+
+	s = &r->slot[r->next++ & (GW_RING_SLOTS - 1)];
+	memcpy(&s->cf, cf, len);
+	s->len = len;
+	s->route = route;
+	s->rx_ns = rx_ns;
+
+	return 0;
+}
+
+/* makes the pushed frames visible to the consumer */
+static inline void gw_ring_publish(struct gw_ring *r)
+{
+	atomic_store_explicit(&r->tail, r->next, memory_order_release);
+}
+
+/*
+ * Returns the number of consecutive published frames (at most max) that
+ * start at *first.  Consumer only.
+ */
+static inline unsigned int gw_ring_peek(struct gw_ring *r, unsigned int max,
+					struct gw_slot **first)
+{
+	unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	unsigned int n = atomic_load_explicit(&r->tail, memory_order_acquire) - head;
+
+	/* only hand out slots up to the end of the array */
+	if (n > GW_RING_SLOTS - (head & (GW_RING_SLOTS - 1)))
+		n = GW_RING_SLOTS - (head & (GW_RING_SLOTS - 1));
+	if (n > max)
+		n = max;
+	*first = &r->slot[head & (GW_RING_SLOTS - 1)];
+
+	return n;
+}
+
+/* frees the first n frames after they were sent */
+static inline void gw_ring_release(struct gw_ring *r, unsigned int n)
+{
+	unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	atomic_store_explicit(&r->head, head + n, memory_order_release);
+}
+
+static inline int gw_ring_empty(struct gw_ring *r)
+{
+	return atomic_load_explicit(&r->head, memory_order_relaxed) ==
+	       atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+#endif
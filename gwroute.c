@@ -0,0 +1,296 @@
+/*
+ * gwroute.c - CAN gateway routing table
+ *
+ * See gwroute.h for the config format and the lookup.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gwroute.h"
+
+#define EXT_ANY		2
+
+void gw_table_init(struct gw_table *t)
+{
+	memset(t, 0, sizeof(*t));
+}
+
+int gw_iface_index(struct gw_table *t, const char *name)
+{
+	int i;
+
+	for (i = 0; i < t->n_ifaces; i++)
+		if (!strcmp(t->iface[i].name, name))
+			return i;
+
+	if (t->n_ifaces == GW_MAX_IFACES || strlen(name) >= IFNAMSIZ)
+		return -1;
+
+	strcpy(t->iface[t->n_ifaces].name, name);
+	return t->n_ifaces++;
+}
+
+int gw_table_add(struct gw_table *t, int src, canid_t id, canid_t mask,
+		 int ext, __u32 dst)
+{
+	struct gw_route *r;
+
+	if (t->n_routes == GW_MAX_ROUTES)
+		return -1;
+
+	r = &t->route[t->n_routes++];
+	r->src = src;
+	r->mask = mask;
+	r->id = id & mask;
+	r->ext = ext;
+	r->dst = dst;
+
+	return 0;
+}
+
+int gw_parse_id(const char *s, canid_t *id, canid_t *mask, int *ext)
+{
+	const char *slash;
+	char *end;
+
+	if (!strcmp(s, "*")) {
+		*id = 0;
+		*mask = 0;
+		*ext = EXT_ANY;
+		return 0;
+	}
+
+	*id = strtoul(s, &end, 16);
+	if (end == s || (*end && *end != '/'))
+		return -1;
+	*ext = *id > CAN_SFF_MASK || end - s > 3;
+	if (*id > CAN_EFF_MASK)
+		return -1;
+	*mask = *ext ? CAN_EFF_MASK : CAN_SFF_MASK;
+
+	slash = strchr(s, '/');
+	if (slash) {
+		*mask = strtoul(slash + 1, &end, 16);
+		if (end == slash + 1 || *end)
+			return -1;
+		*mask &= *ext ? CAN_EFF_MASK : CAN_SFF_MASK;
+	}
+
+	return 0;
+}
+
+int gw_table_load(struct gw_table *t, const char *path)
+{
+	char line[1024], *src, *idstr, *dststr, *extra, *name, *save;
+	canid_t id, mask;
+	int lineno = 0, s, d, ext;
+	__u32 dst;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		if (strchr(line, '#'))
+			*strchr(line, '#') = 0;
+
+		src = strtok_r(line, " \t\r\n", &save);
+		if (!src)
+			continue;
+		idstr = strtok_r(NULL, " \t\r\n", &save);
+		dststr = strtok_r(NULL, " \t\r\n", &save);
+		extra = strtok_r(NULL, " \t\r\n", &save);
+		if (!dststr || extra) {
+			fprintf(stderr, "%s:%d: expected <source> <id[/mask]> <destination[,...]>\n",
+				path, lineno);
+			goto err;
+		}
+
+		s = gw_iface_index(t, src);
+		if (s < 0) {
+			fprintf(stderr, "%s:%d: bad interface '%s' or more than %d interfaces\n",
+				path, lineno, src, GW_MAX_IFACES);
+			goto err;
+		}
+
+		if (gw_parse_id(idstr, &id, &mask, &ext)) {
+			fprintf(stderr, "%s:%d: bad CAN ID '%s'\n", path, lineno, idstr);
+			goto err;
+		}
+
+		dst = 0;
+		for (name = strtok_r(dststr, ",", &save); name;
+		     name = strtok_r(NULL, ",", &save)) {
+			d = gw_iface_index(t, name);
+			if (d < 0) {
+				fprintf(stderr, "%s:%d: bad interface '%s' or more than %d interfaces\n",
+					path, lineno, name, GW_MAX_IFACES);
+				goto err;
+			}
+			dst |= 1U << d;
+		}
+
+		if (gw_table_add(t, s, id, mask, ext, dst)) {
+			fprintf(stderr, "%s:%d: more than %d routes\n",
+				path, lineno, GW_MAX_ROUTES);
+			goto err;
+		}
+	}
+
+	fclose(f);
+	return 0;
+
+err:
+	fclose(f);
+	return -1;
+}
+
+static void ext_insert(struct gw_iface *gi, __u32 id, __u32 dst, int route)
+{
+	unsigned int i = ((__u64)id * 0x9E3779B97F4A7C15ULL >> 32) & (gi->ext_size - 1);
+
+	while (gi->ext[i].id && gi->ext[i].id != id)
+		i = (i + 1) & (gi->ext_size - 1);
+	if (!gi->ext[i].id)
+		gi->ext[i].route = route;
+	gi->ext[i].id = id;
+	gi->ext[i].dst |= dst;
+}
+
+int gw_table_compile(struct gw_table *t)
+{
+	struct gw_iface *gi;
+	struct gw_route *r;
+	unsigned int n_exact;
+	int i, k;
+	canid_t id;
+
+	for (i = 0; i < t->n_ifaces; i++) {
+		gi = &t->iface[i];
+		free(gi->ext);
+		free(gi->masked);
+		memset(gi->std, 0, sizeof(gi->std));
+		memset(gi->std_route, 0xff, sizeof(gi->std_route));
+		gi->ext = NULL;
+		gi->ext_size = 0;
+		gi->masked = NULL;
+		gi->n_masked = 0;
+
+		n_exact = 0;
+		for (k = 0; k < t->n_routes; k++) {
+			r = &t->route[k];
+			if (r->src != i || !r->ext)
+				continue;
+			if (r->ext == 1 && r->mask == CAN_EFF_MASK)
+				n_exact++;
+			else
+				gi->n_masked++;
+		}
+
+		if (n_exact) {
+			/* keep the load factor below 1/2 */
+			for (gi->ext_size = 16; gi->ext_size < 2 * n_exact; )
+				gi->ext_size *= 2;
+			gi->ext = calloc(gi->ext_size, sizeof(*gi->ext));
+			if (!gi->ext)
+				return -1;
+		}
+		if (gi->n_masked) {
+			gi->masked = malloc(gi->n_masked * sizeof(*gi->masked));
+			if (!gi->masked)
+				return -1;
+			gi->n_masked = 0;
+		}
+
+		for (k = 0; k < t->n_routes; k++) {
+			r = &t->route[k];
+			if (r->src != i)
+				continue;
+
+			if (r->ext != 1) {
+				for (id = 0; id <= CAN_SFF_MASK; id++) {
+					if ((id & r->mask) != (r->id & CAN_SFF_MASK))
+						continue;
+					gi->std[id] |= r->dst;
+					if (gi->std_route[id] < 0)
+						gi->std_route[id] = k;
+				}
+			}
+
+			if (r->ext == 1 && r->mask == CAN_EFF_MASK)
+				ext_insert(gi, CAN_EFF_FLAG | r->id, r->dst, k);
+			else if (r->ext)
+				gi->masked[gi->n_masked++] = r;
+		}
+
+		/* frames never go back to where they came from */
+		for (id = 0; id <= CAN_SFF_MASK; id++)
+			gi->std[id] &= ~(1U << i);
+	}
+
+	return 0;
+}
+
+static void print_dst(const struct gw_table *t, __u32 dst)
+{
+	const char *sep = "";
+	int i;
+
+	for (i = 0; i < t->n_ifaces; i++) {
+		if (dst & (1U << i)) {
+			printf("%s%s", sep, t->iface[i].name);
+			sep = ",";
+		}
+	}
+}
+
+void gw_table_print(const struct gw_table *t)
+{
+	const struct gw_route *r;
+	const struct gw_iface *gi;
+	int i, n_std;
+	unsigned int k, n_ext;
+
+	for (i = 0; i < t->n_routes; i++) {
+		r = &t->route[i];
+		printf("%-8s ", t->iface[r->src].name);
+		if (r->ext == EXT_ANY)
+			printf("%-17s ", "*");
+		else if (r->ext)
+			printf("%08X/%08X ", r->id, r->mask);
+		else
+			printf("%03X/%03X%10s ", r->id, r->mask, "");
+		print_dst(t, r->dst);
+		printf("\n");
+	}
+
+	for (i = 0; i < t->n_ifaces; i++) {
+		gi = &t->iface[i];
+		n_std = 0;
+		for (k = 0; k <= CAN_SFF_MASK; k++)
+			n_std += !!gi->std[k];
+		n_ext = 0;
+		for (k = 0; k < gi->ext_size; k++)
+			n_ext += !!gi->ext[k].id;
+		printf("%s: %d standard IDs, %u extended IDs, %d masked extended routes\n",
+		       gi->name, n_std, n_ext, gi->n_masked);
+	}
+}
+
+void gw_table_free(struct gw_table *t)
+{
+	int i;
+
+	for (i = 0; i < t->n_ifaces; i++) {
+		free(t->iface[i].ext);
+		free(t->iface[i].masked);
+		t->iface[i].ext = NULL;
+		t->iface[i].masked = NULL;
+	}
+}
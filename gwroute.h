@@ -0,0 +1,186 @@
+/*
+ * gwroute.h - CAN gateway routing table
+ *
+ * Routes are read from a config file with one route per line:
+ *
+ *	# source  id[/mask]  destination[,destination...]
+ *	vcan0     123        vcan1
+ *	vcan1     124        vcan0
+ *	vcan0     100/700    vcan1,vcan2
+ *	vcan2     18DAF110   vcan0
+ *	vcan0     *          vcan2
+ *
+ * IDs and masks are hex.  An ID above 7FF or written with more than three
+ * digits is a 29 bit ID, the mask defaults to all bits of the ID's kind
+ * and "*" matches every standard and extended ID.  Several routes can
+ * match a frame, it goes to the union of their destinations, but never
+ * back to its source interface.
+ *
+ * gw_table_compile() turns the routes into per source interface lookup
+ * tables: a directly indexed bitmap of destinations for all 2048 standard
+ * IDs, an open addressing hash for exact 29 bit IDs and a short list for
+ * masked 29 bit routes, which can not be expanded.  A lookup is one array
+ * access for standard frames.  The tables also keep the first route (in
+ * config order) that matches each ID, for per route statistics.
+ */
+
+#ifndef GWROUTE_H
+#define GWROUTE_H
+
+#include <linux/types.h>
+#include <linux/can.h>
+#include <net/if.h>
+
+#define GW_MAX_IFACES	32	/* destinations are a __u32 bitmap */
+#define GW_MAX_ROUTES	1024
+
+struct gw_route {
+	int src;
+	canid_t id, mask;	/* without CAN_EFF_FLAG */
+	int ext;		/* 0 = 11 bit, 1 = 29 bit, 2 = both ("*") */
+	__u32 dst;		/* bitmap of interface indexes */
+};
+
+struct gw_ext {
+	__u32 id;		/* CAN_EFF_FLAG | 29 bit ID, 0 = free slot */
+	__u32 dst;
+	int route;		/* first route of the ID */
+};
+
+struct gw_iface {
+	char name[IFNAMSIZ];
+	__u32 std[CAN_SFF_MASK + 1];	/* destinations per 11 bit ID */
+	__s16 std_route[CAN_SFF_MASK + 1];	/* first route per 11 bit ID */
+	struct gw_ext *ext;		/* exact 29 bit IDs */
+	unsigned int ext_size;		/* slots, power of two */
+	struct gw_route **masked;	/* masked 29 bit routes, in order */
+	int n_masked;
+};
+
+struct gw_table {
+	int n_ifaces;
+	struct gw_iface iface[GW_MAX_IFACES];
+	int n_routes;
+	struct gw_route route[GW_MAX_ROUTES];
+};
+
+void gw_table_init(struct gw_table *t);
+
+int gw_iface_index(struct gw_table *t, const char *name);
+/*
+ * Returns the index of interface name, adding it when it is new, or -1
+ * when there are GW_MAX_IFACES interfaces already.
+ */
+
+int gw_parse_id(const char *s, canid_t *id, canid_t *mask, int *ext);
+/*
+ * Parses "id[/mask]" or "*" as in the config, ext is set like in struct
+ * gw_route.  Return values: 0 = success, -1 = bad ID
+ */
+
+int gw_table_add(struct gw_table *t, int src, canid_t id, canid_t mask,
+		 int ext, __u32 dst);
+/*
+ * Adds a route.  Return values: 0 = success, -1 = table full
+ */
+
+int gw_table_load(struct gw_table *t, const char *path);
+/*
+ * Adds the routes of a config file.  Errors are reported on stderr with
+ * their line number.  Return values: 0 = success, -1 = error
+ */
+
+int gw_table_compile(struct gw_table *t);
+/*
+ * Builds the lookup tables from the routes.  Must be called again after
+ * adding routes.  Return values: 0 = success, -1 = out of memory
+ */
+
+void gw_table_print(const struct gw_table *t);
+/*
+ * Prints the routes and a summary of the lookup tables to stdout.
+ */
+
+void gw_table_free(struct gw_table *t);
+
+static inline __u32 gw_lookup(const struct gw_table *t, int src, canid_t can_id)
+{
+	const struct gw_iface *gi = &t->iface[src];
+	__u32 id, dst = 0;
+	unsigned int i;
+	int k;
+
+	if (!(can_id & CAN_EFF_FLAG))
+		return gi->std[can_id & CAN_SFF_MASK];
+
+	id = can_id & (CAN_EFF_FLAG | CAN_EFF_MASK);
+	if (gi->ext_size) {
+		i = ((__u64)id * 0x9E3779B97F4A7C15ULL >> 32) & (gi->ext_size - 1);
+		while (gi->ext[i].id) {
+			if (gi->ext[i].id == id) {
+				dst = gi->ext[i].dst;
+				break;
+			}
+			i = (i + 1) & (gi->ext_size - 1);
+		}
+	}
+	for (k = 0; k < gi->n_masked; k++)
+		if (((id & CAN_EFF_MASK) & gi->masked[k]->mask) == gi->masked[k]->id)
+			dst |= gi->masked[k]->dst;
+
+	return dst & ~(1U << src);
+}
+
+static inline int gw_route_match(const struct gw_route *r, canid_t can_id)
+{
+	if (r->ext != 2 && r->ext != !!(can_id & CAN_EFF_FLAG))
+		return 0;
+	can_id &= can_id & CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK;
+
+	return (can_id & r->mask) == r->id;
+}
+
+/*
+ * Returns the index of the first route that sends can_id from src to d,
+ * or -1.  Only to be called for destinations gw_lookup() returned.
+ */
+static inline int gw_lookup_route(const struct gw_table *t, int src,
+				  canid_t can_id, int d)
+{
+	const struct gw_iface *gi = &t->iface[src];
+	int r = -1, k;
+	unsigned int i;
+	__u32 id;
+
+	if (!(can_id & CAN_EFF_FLAG)) {
+		r = gi->std_route[can_id & CAN_SFF_MASK];
+	} else {
+		id = can_id & (CAN_EFF_FLAG | CAN_EFF_MASK);
+		if (gi->ext_size) {
+			i = ((__u64)id * 0x9E3779B97F4A7C15ULL >> 32) & (gi->ext_size - 1);
+			while (gi->ext[i].id && gi->ext[i].id != id)
+				i = (i + 1) & (gi->ext_size - 1);
+			if (gi->ext[i].id)
+				r = gi->ext[i].route;
+		}
+		for (k = 0; k < gi->n_masked; k++) {
+			if (r >= 0 && gi->masked[k] - t->route > r)
+				break;
+			if (gw_route_match(gi->masked[k], can_id)) {
+				r = gi->masked[k] - t->route;
+				break;
+			}
+		}
+	}
+
+	/* overlapping routes: the first one may not go to d */
+	if (r >= 0 && !(t->route[r].dst & (1U << d)))
+		for (r = 0; r < t->n_routes; r++)
+			if (t->route[r].src == src && (t->route[r].dst & (1U << d)) &&
+			    gw_route_match(&t->route[r], can_id))
+				break;
+
+	return r < t->n_routes ? r : -1;
+}
+
+#endif
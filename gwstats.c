@@ -0,0 +1,96 @@
+/*
+ * gwstats.c - per route forwarding metrics of the gateway
+ *
+ * See gwstats.h for the interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gwstats.h"
+
+int gw_metrics_init(struct gw_metrics *m, const struct gw_table *t)
+{
+	__u32 dst;
+	int i, d, n = 0;
+
+	memset(m, 0, sizeof(*m));
+	for (i = 0; i < t->n_routes; i++) {
+		m->first[i] = n;
+		m->dst[i] = t->route[i].dst & ~(1U << t->route[i].src);
+		n += __builtin_popcount(m->dst[i]);
+	}
+
+	m->path = calloc(n ? n : 1, sizeof(*m->path));
+	if (!m->path)
+		return -1;
+	m->n_paths = n;
+
+	for (i = 0; i < t->n_routes; i++) {
+		for (d = 0, dst = m->dst[i]; dst; d++, dst >>= 1) {
+			if (!(dst & 1))
+				continue;
+			gw_metrics_path(m, i, d)->route = i;
+			gw_metrics_path(m, i, d)->dst = d;
+		}
+	}
+
+	return 0;
+}
+
+static void print_filter(FILE *f, const struct gw_route *r)
+{
+	if (r->ext == 2)
+		fprintf(f, "*");
+	else if (r->ext)
+		fprintf(f, "%08X/%08X", r->id, r->mask);
+	else
+		fprintf(f, "%03X/%03X", r->id, r->mask);
+}
+
+int gw_metrics_dump(struct gw_metrics *m, const struct gw_table *t, FILE *f,
+		    double time)
+{
+	static const char *name[] = { "p50", "p90", "p99", "p99.9" };
+	static const double pct[] = { 50, 90, 99, 99.9 };
+	struct gw_path_stats *p;
+	unsigned long frames, bytes;
+	double elapsed = m->last ? time - m->last : 0;
+	unsigned int k;
+	int i;
+
+	for (i = 0; i < m->n_paths; i++) {
+		p = &m->path[i];
+		/* the sending thread may go on counting meanwhile */
+		frames = p->frames;
+		bytes = p->bytes;
+
+		fprintf(f, "%s{\"route\":%d,\"src\":\"%s\",\"filter\":\"", i ? "," : "",
+			p->route + 1, t->iface[t->route[p->route].src].name);
+		print_filter(f, &t->route[p->route]);
+		fprintf(f, "\",\"dst\":\"%s\",\"frames\":%lu,\"bytes\":%lu,\"dropped\":%lu",
+			t->iface[p->dst].name, frames, bytes, p->dropped);
+		fprintf(f, ",\"frames_per_s\":%.1f,\"bytes_per_s\":%.1f",
+			elapsed > 0 ? (frames - p->last_frames) / elapsed : 0.0,
+			elapsed > 0 ? (bytes - p->last_bytes) / elapsed : 0.0);
+		fprintf(f, ",\"latency_us\":{");
+		for (k = 0; k < sizeof(pct) / sizeof(pct[0]); k++)
+			fprintf(f, "\"%s\":%.1f,", name[k],
+				loghist_percentile(p->hist, frames, pct[k]) / 1e3);
+		fprintf(f, "\"max\":%.1f}}", p->max_ns / 1e3);
+
+		p->last_frames = frames;
+		p->last_bytes = bytes;
+	}
+	m->last = time;
+
+	return ferror(f) ? -1 : 0;
+}
+
+void gw_metrics_free(struct gw_metrics *m)
+{
+	free(m->path);
+	m->path = NULL;
+	m->n_paths = 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * gwstats.h - per route forwarding metrics of the gateway
+ *
+ * Every route and destination interface of the routing table is a path
+ * with its own counters: frames and payload bytes sent, frames the
+ * destination did not take, and a histogram of the forwarding latency,
+ * from the kernel's receive timestamp (SO_TIMESTAMPNS) of a frame on the
+ * source interface to the return of the sendmmsg() that put it on the
+ * destination.  A frame counts for the first route in config order that
+ * sends it to the destination.
+ *
+ * The histogram is the log-linear one of loghist.h.  A path is only ever
+ * updated by the thread that sends to its destination.
+ */
+
+#ifndef GWSTATS_H
+#define GWSTATS_H
+
+#include <stdio.h>
+#include <linux/types.h>
+
+#include "gwroute.h"
+#include "loghist.h"
+
+struct gw_path_stats {
+	int route, dst;
+	unsigned long frames, bytes;	/* sent */
+	unsigned long dropped;		/* refused by the destination */
+	__u64 max_ns;
+	__u64 hist[LOGHIST_BUCKETS];	/* latency */
+
+	/* at the previous dump, for the rates */
+	unsigned long last_frames, last_bytes;
+};
+
+struct gw_metrics {
+	int n_paths;
+	struct gw_path_stats *path;
+	int first[GW_MAX_ROUTES];	/* first path of each route */
+	__u32 dst[GW_MAX_ROUTES];	/* destinations with a path */
+	double last;			/* time of the previous dump */
+};
+
+int gw_metrics_init(struct gw_metrics *m, const struct gw_table *t);
+/*
+ * Creates a path for every route and destination the table forwards in
+ * userspace, call it after the last gw_table_compile().
+ * Return values: 0 = success, -1 = out of memory
+ */
+
+int gw_metrics_dump(struct gw_metrics *m, const struct gw_table *t, FILE *f,
+		    double time);
+/*
+ * Writes the paths as the elements of a JSON array (without the brackets),
+ * with the frame and byte rates since the previous dump at time and the
+ * latency percentiles since the start.
+ * Return values: 0 = success, -1 = write error
+ */
+
+void gw_metrics_free(struct gw_metrics *m);
+
+/* the path of route r to d, NULL for no route or no metrics */
+static inline struct gw_path_stats *gw_metrics_path(const struct gw_metrics *m,
+						    int r, int d)
+{
+	if (r < 0 || !m->path || !(m->dst[r] & (1U << d)))
+		return NULL;
+
+	return &m->path[m->first[r] + __builtin_popcount(m->dst[r] & ((1U << d) - 1))];
+}
+
+/* counts a frame of len payload bytes sent latency_ns after it arrived */
+static inline void gw_metrics_add(struct gw_path_stats *p, int len, __u64 latency_ns)
+{
+	p->frames++;
+	p->bytes += len;
+	p->hist[loghist_bucket(latency_ns)]++;
+	if (latency_ns > p->max_ns)
+		p->max_ns = latency_ns;
+}
+
+#endif
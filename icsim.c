@@ -15,6 +15,8 @@
 #include <unistd.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <signal.h>
 #include <getopt.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -26,6 +28,10 @@
 
 #include "lib.h"
 #include "data.h"
+#include "asynclog.h"
+#include "trigring.h"
+#include "canshm.h"
+#include "canids.h"
 
 // Define the data directory if not defined
 #ifndef DATA_DIR
@@ -175,6 +181,19 @@ SDL_Texture *trafficCarTexture = NULL; // Texture for traffic cars
 int running_flag = 0;
 static unsigned char doorState = 0x00;
 FILE *fptr;
+struct asynclog *canLog = NULL; // --log, frames as received
+struct trigring *canRing = NULL; // --ring, frames before a trigger
+struct canids *canIds = NULL; // -g / -i, timing based intrusion detection
+struct canshm canShm;            // --shm, last value per CAN ID for local readers
+int shmEnabled = 0;
+
+// --ring-on, events that dump the ring
+#define RING_ON_COLLISION 0x01
+#define RING_ON_CHALLENGE 0x02
+#define RING_ON_DIAG      0x04
+#define RING_ON_SIGNAL    0x08
+int ringTriggers = RING_ON_COLLISION | RING_ON_CHALLENGE | RING_ON_DIAG | RING_ON_SIGNAL;
+static volatile sig_atomic_t ringSignal = 0;
 
 SDL_Texture *roadTexture = NULL;  // For the scrolling road background
 SDL_Texture *carTexture = NULL;   // For the car sprite
@@ -378,10 +397,57 @@ void blankIC() {
   SDL_RenderCopy(renderer, baseTexture, NULL, NULL);
 }
 
+// Writes the frames that led up to an event when the ring is enabled for it
+void ringTrigger(int trigger, const char *reason) {
+  if (canRing && (ringTriggers & trigger) && trigring_dump(canRing, reason) < 0)
+    perror("[Ring] dump");
+}
+
+// Flushes and closes what records the bus, registered with atexit() so
+// early error exits do not lose the frames still queued for the log
+void closeRecorders() {
+  if (canLog)
+    asynclog_close(canLog);
+  if (canRing)
+    trigring_close(canRing);
+  if (shmEnabled)
+    canshm_close(&canShm);
+  if (canIds)
+    canids_close(canIds);
+  canLog = NULL;
+  canRing = NULL;
+  shmEnabled = 0;
+  canIds = NULL;
+}
+
+void ringSignalHandler(int sig) {
+  (void)sig;
+  ringSignal = 1;
+}
+
+// Parses "collision,challenge,diag,signal" into RING_ON_* bits
+int parseRingTriggers(char *list) {
+  int triggers = 0;
+  char *tok;
+
+  for (tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+    if (!strcmp(tok, "collision")) triggers |= RING_ON_COLLISION;
+    else if (!strcmp(tok, "challenge")) triggers |= RING_ON_CHALLENGE;
+    else if (!strcmp(tok, "diag")) triggers |= RING_ON_DIAG;
+    else if (!strcmp(tok, "signal")) triggers |= RING_ON_SIGNAL;
+    else return -1;
+  }
+  return triggers;
+}
+
 void validateChallenge(int challenge) {
+  char reason[32];
+
   if (challenges[challenge] == 0) {
     challenges[challenge] = 1;
     score += challengeValue[challenge];
+    snprintf(reason, sizeof(reason), "challenge%d", challenge);
+    ringTrigger(RING_ON_CHALLENGE, reason);
   }
 }
 
@@ -1203,6 +1269,14 @@ void Usage(char *msg) {
   printf("\t-f, --firmware-update    Enable firmware update simulation\n");
   printf("\t-c, --can-fd-support     Enable CAN FD support\n");
   printf("\t-i, --intrusion-detection Enable intrusion detection\n");
+  printf("\t    --ids-train SEC      Learn the ID periods for SEC seconds (default: %d)\n", CANIDS_TRAIN_SEC);
+  printf("\t-L, --log FILE           Log received frames in candump format\n");
+  printf("\t    --log-size MB        Rotate the log after MB megabytes\n");
+  printf("\t    --log-time SEC       Rotate the log after SEC seconds\n");
+  printf("\t    --shm                Publish the last frame of every CAN ID in /dev/shm/icsim-<can>\n");
+  printf("\t    --ring SEC           Keep the last SEC seconds of frames in memory\n");
+  printf("\t    --ring-file PREFIX   Dump the ring to PREFIX-N-REASON.log (default: icsim-ring)\n");
+  printf("\t    --ring-on LIST       Dump on collision,challenge,diag,signal (default: all, signal = SIGUSR1)\n");
   printf("\t-r\t-randomize IDs\n");
   printf("\t-d\tdebug mode\n");
   printf("\t-h, --help               Display this help message\n");
@@ -1216,9 +1290,22 @@ void initializeMultipleECUs() {
     printf("[Feature] Initializing Multiple ECUs...\n");
 }
 
-void startGatewayModule() {
-    // TODO: Implement gateway/IDS module start
+void initializeIntrusionDetection(const char *ifname, int trainTime) {
+    if (canIds)
+        return;
+    printf("[Feature] Initializing Intrusion Detection...\n");
+    canIds = canids_open(ifname, trainTime);
+    if (!canIds) {
+        perror("ids");
+        exit(1);
+    }
+    printf("[IDS] Learning the periods of the CAN IDs for %d s\n", trainTime);
+}
+
+void startGatewayModule(const char *ifname, int trainTime) {
+    // The gateway node watches the timing of the bus, see canids.h
     printf("[Feature] Starting Gateway/IDS Module...\n");
+    initializeIntrusionDetection(ifname, trainTime);
 }
 
 void initializeMessageAuth() {
@@ -1236,11 +1323,6 @@ void enableCanFDSupport() {
     printf("[Feature] Enabling CAN FD Support...\n");
 }
 
-void initializeIntrusionDetection() {
-    // TODO: Implement intrusion detection
-    printf("[Feature] Initializing Intrusion Detection...\n");
-}
-
 /* Main Function */
 int main(int argc, char *argv[]) {
     int opt;
@@ -1254,15 +1336,30 @@ int main(int argc, char *argv[]) {
         {"firmware-update",   no_argument,       0, 'f'},
         {"can-fd-support",    no_argument,       0, 'c'},
         {"intrusion-detection", no_argument,     0, 'i'},
+        {"log",               required_argument, 0, 'L'},
+        {"log-size",          required_argument, 0, 'Z'},
+        {"log-time",          required_argument, 0, 'T'},
+        {"shm",               no_argument,       0, 'S'},
+        {"ring",              required_argument, 0, 'R'},
+        {"ring-file",         required_argument, 0, 'P'},
+        {"ring-on",           required_argument, 0, 'O'},
+        {"ids-train",         required_argument, 0, 'I'},
         {"help",              no_argument,       0, 'h'},
         {0, 0, 0, 0}
     };
 
     /* Initialize SimConfig with default values */
     SimConfig simConfig = {0, 0, 0, 0, 0, 0};
+    char *logFile = NULL;
+    long logSize = 0;
+    int logTime = 0;
+    int ringTime = 0;
+    char *ringFile = "icsim-ring";
+    int idsTrain = CANIDS_TRAIN_SEC;
+    char lastDiagSession;
 
     /* Parse command-line options */
-    while ((opt = getopt_long(argc, argv, "mgafcih?", long_options, &option_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "mgafciL:h?", long_options, &option_index)) != -1) {
         switch(opt) {
             case 'm':
                 simConfig.multipleECUs = 1;
@@ -1282,6 +1379,33 @@ int main(int argc, char *argv[]) {
             case 'i':
                 simConfig.intrusionDetection = 1;
                 break;
+            case 'L':
+                logFile = optarg;
+                break;
+            case 'Z':
+                logSize = atol(optarg);
+                break;
+            case 'T':
+                logTime = atoi(optarg);
+                break;
+            case 'S':
+                shmEnabled = 1;
+                break;
+            case 'R':
+                ringTime = atoi(optarg);
+                if (ringTime <= 0) Usage("--ring needs a number of seconds");
+                break;
+            case 'P':
+                ringFile = optarg;
+                break;
+            case 'O':
+                ringTriggers = parseRingTriggers(optarg);
+                if (ringTriggers < 0) Usage("Unknown --ring-on event");
+                break;
+            case 'I':
+                idsTrain = atoi(optarg);
+                if (idsTrain <= 0) Usage("--ids-train needs a number of seconds");
+                break;
             case 'r':
                 randomize_flag = 1;
                 break;
@@ -1330,8 +1454,9 @@ int main(int argc, char *argv[]) {
     struct msghdr msg;
     struct cmsghdr *cmsg;
     struct timeval tv, timeoutConfig = { 0, 0 };
+    struct timespec rxTime;
     fd_set rdfs;
-    char ctrlmsg[CMSG_SPACE(sizeof(struct timeval)) + CMSG_SPACE(sizeof(__u32))];
+    char ctrlmsg[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(__u32))];
     int nbytes, maxdlen;
     struct msghdr received_msg;
     struct iovec received_iov;
@@ -1342,8 +1467,52 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    /* Log received frames with their kernel receive timestamps */
+    if (logFile || ringTime || shmEnabled || simConfig.gatewayNode || simConfig.intrusionDetection) {
+        const int timestamp_on = 1;
+        if (setsockopt(can_socket, SOL_SOCKET, SO_TIMESTAMPNS, &timestamp_on, sizeof(timestamp_on)) < 0)
+            perror("setsockopt SO_TIMESTAMPNS");
+    }
+    atexit(closeRecorders);
+    if (logFile) {
+        canLog = asynclog_open(logFile, ifr.ifr_name, logSize * 1024 * 1024, logTime);
+        if (!canLog) {
+            perror(logFile);
+            return 1;
+        }
+        printf("Logging received frames to %s\n", logFile);
+    }
+
+    /* Share the bus state with local tools, see canlast */
+    if (shmEnabled) {
+        if (canshm_create(&canShm, ifr.ifr_name)) {
+            perror("shm");
+            shmEnabled = 0;
+            return 1;
+        }
+        printf("Publishing the last value of every CAN ID in /dev/shm%s\n", canShm.name);
+    }
+
+    /* Keep the last ringTime seconds for dumps on trigger events */
+    if (ringTime) {
+        struct sigaction sa;
+
+        canRing = trigring_open(ringFile, ifr.ifr_name, ringTime);
+        if (!canRing) {
+            perror("ring");
+            return 1;
+        }
+        // no SA_RESTART: interrupts recvmsg() so the dump happens right away
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = ringSignalHandler;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR1, &sa, NULL);
+        printf("Keeping the last %d s of frames, dumps go to %s-N-REASON.log\n", ringTime, ringFile);
+    }
+
     /* Initialize Car State */
     initCarState();
+    lastDiagSession = diagSession;
 
     /* Handle Randomization */
     int doorId = DEFAULT_DOOR_ID;
@@ -1469,7 +1638,7 @@ int main(int argc, char *argv[]) {
     }
 
     if (simConfig.gatewayNode) {
-        startGatewayModule();
+        startGatewayModule(ifr.ifr_name, idsTrain);
     }
 
     if (simConfig.messageAuth) {
@@ -1485,7 +1654,7 @@ int main(int argc, char *argv[]) {
     }
 
     if (simConfig.intrusionDetection) {
-        initializeIntrusionDetection();
+        initializeIntrusionDetection(ifr.ifr_name, idsTrain);
     }
 
     /* Main Loop */
@@ -1510,6 +1679,11 @@ int main(int argc, char *argv[]) {
            SDL_Delay(3);
         }
 
+        if (ringSignal) {
+            ringSignal = 0;
+            ringTrigger(RING_ON_SIGNAL, "signal");
+        }
+
         /* Receive CAN Frame */
         memset(&frame, 0, sizeof(frame));
         received_iov.iov_base = &frame;
@@ -1524,6 +1698,8 @@ int main(int argc, char *argv[]) {
 
         nbytes = recvmsg(can_socket, &received_msg, 0);
         if (nbytes < 0) {
+          if (errno == EINTR)
+            continue;
           perror("read");
           return 1;
         }
@@ -1537,16 +1713,32 @@ int main(int argc, char *argv[]) {
         }
 
         /* Handle Control Messages */
+        rxTime.tv_sec = 0;
         for (cmsg = CMSG_FIRSTHDR(&received_msg);
              cmsg && (cmsg->cmsg_level == SOL_SOCKET);
              cmsg = CMSG_NXTHDR(&received_msg,cmsg)) {
           if (cmsg->cmsg_type == SO_TIMESTAMP)
               tv = *(struct timeval *)CMSG_DATA(cmsg);
+          else if (cmsg->cmsg_type == SO_TIMESTAMPNS)
+              rxTime = *(struct timespec *)CMSG_DATA(cmsg);
           else if (cmsg->cmsg_type == SO_RXQ_OVFL)
                  //dropcnt[i] = *(__u32 *)CMSG_DATA(cmsg);
                    fprintf(stderr, "Dropped packet\n");
         }
 
+        if (canLog || canRing || shmEnabled || canIds) {
+          if (rxTime.tv_sec == 0)
+            clock_gettime(CLOCK_REALTIME, &rxTime);
+          if (shmEnabled)
+            canshm_update(&canShm, &frame, nbytes, rxTime.tv_sec * 1000000000ULL + rxTime.tv_nsec);
+          if (canLog)
+            asynclog_push(canLog, &frame, nbytes, rxTime.tv_sec * 1000000000ULL + rxTime.tv_nsec);
+          if (canRing)
+            trigring_push(canRing, &frame, nbytes, rxTime.tv_sec * 1000000000ULL + rxTime.tv_nsec);
+          if (canIds)
+            canids_frame(canIds, frame.can_id, rxTime.tv_sec * 1000000000ULL + rxTime.tv_nsec);
+        }
+
         currentTime = SDL_GetTicks();
         pristine = 1;
 
@@ -1579,6 +1771,13 @@ int main(int argc, char *argv[]) {
           diagActive = 0;
           secretSessionFound = 0;
         }
+        if (diagSession != lastDiagSession) {
+          char reason[32];
+
+          snprintf(reason, sizeof(reason), "diag%d", diagSession);
+          lastDiagSession = diagSession;
+          ringTrigger(RING_ON_DIAG, reason);
+        }
         if (isoTpRequest > 0 && isoTpRemainingBytes > 0) {
           sendIsoTpData();
         }
@@ -1622,6 +1821,7 @@ int main(int argc, char *argv[]) {
           for (int i = 0; i < trafficCarCount; i++) {
               if (checkCollision(&playerCarRect, &trafficCars[i].rect)) {
                   printf("Collision detected! Game Over!\n");
+                  ringTrigger(RING_ON_COLLISION, "collision");
                   running_flag = 0; // End the simulation
                   break;
               }
@@ -1650,6 +1850,7 @@ int main(int argc, char *argv[]) {
     SDL_Quit();
 
     close(can_socket);
+    closeRecorders();
 
     return 0;
 }
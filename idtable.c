@@ -0,0 +1,54 @@
+/*
+ * idtable.c - hash table of per (interface, CAN ID) entries
+ *
+ * See idtable.h for the interface.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "idtable.h"
+
+void idtable_init(struct idtable *t, size_t esize, size_t align)
+{
+	memset(t, 0, sizeof(*t));
+	t->esize = esize;
+	t->align = align;
+}
+
+void idtable_free(struct idtable *t)
+{
+	free(t->ent);
+	idtable_init(t, t->esize, t->align);
+}
+
+int idtable_grow(struct idtable *t)
+{
+	struct idtable old = *t;
+	unsigned int i, j;
+	__u64 *e;
+
+	t->size = old.size ? old.size * 2 : IDTABLE_MIN;
+	if (t->align)
+		t->ent = aligned_alloc(t->align, t->size * t->esize);
+	else
+		t->ent = malloc(t->size * t->esize);
+	if (!t->ent) {
+		*t = old;
+		return -1;
+	}
+	memset(t->ent, 0, t->size * t->esize);
+
+	for (i = 0; i < old.size; i++) {
+		e = idtable_slot(&old, i);
+		if (!*e)
+			continue;
+		j = idtable_hash(*e) & (t->size - 1);
+		while (*(__u64 *)idtable_slot(t, j))
+			j = (j + 1) & (t->size - 1);
+		memcpy(idtable_slot(t, j), e, t->esize);
+	}
+	free(old.ent);
+
+	return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * idtable.h - hash table of per (interface, CAN ID) entries
+ *
+ * The log tools keep their state per interface and CAN ID in an open
+ * addressing table with linear probing, keyed by idtable_key().  Entries
+ * are of any size and start with their __u64 key, 0 marks a free slot.
+ * The table doubles when it gets half full, so an ID costs a multiply and
+ * usually a single probe.  Entries move when the table grows: pointers
+ * returned by idtable_get() are only valid until the next call.
+ */
+
+#ifndef IDTABLE_H
+#define IDTABLE_H
+
+#include <stddef.h>
+#include <linux/types.h>
+#include <linux/can.h>
+
+#define IDTABLE_MIN	256	/* slots of the first allocation */
+
+struct idtable {
+	void *ent;		/* size slots of esize bytes */
+	unsigned int size;	/* slots, power of two, 0 before the first entry */
+	unsigned int count;	/* used slots */
+	size_t esize;
+	size_t align;		/* of the slots, 0 = as malloc() */
+};
+
+void idtable_init(struct idtable *t, size_t esize, size_t align);
+/*
+ * Sets up an empty table for entries of esize bytes that start with their
+ * __u64 key.  align must be a power of two dividing esize, or 0.
+ */
+
+void idtable_free(struct idtable *t);
+
+int idtable_grow(struct idtable *t);
+/*
+ * Doubles the table.  Return values: 0 = success, -1 = out of memory
+ */
+
+static inline __u64 idtable_key(int ifindex, canid_t can_id)
+{
+	return ((__u64)(ifindex + 1) << 32) | can_id;
+}
+
+static inline unsigned int idtable_hash(__u64 key)
+{
+	return (key * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+/* slot i, a free one when its key is 0 */
+static inline void *idtable_slot(const struct idtable *t, unsigned int i)
+{
+	return (char *)t->ent + i * t->esize;
+}
+
+/*
+ * Returns the entry of key, a zeroed one with the key set when it is new,
+ * or NULL when the table cannot grow.
+ */
+static inline void *idtable_get(struct idtable *t, __u64 key)
+{
+	unsigned int i;
+	__u64 *e;
+
+	/* keep the load factor below 1/2 */
+	if (2 * (t->count + 1) > t->size && idtable_grow(t))
+		return NULL;
+
+	i = idtable_hash(key) & (t->size - 1);
+	e = idtable_slot(t, i);
+	while (*e && *e != key) {
+		i = (i + 1) & (t->size - 1);
+		e = idtable_slot(t, i);
+	}
+
+	if (!*e) {
+		*e = key;
+		t->count++;
+	}
+
+	return e;
+}
+
+#endif
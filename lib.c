@@ -85,18 +85,127 @@ unsigned char can_len2dlc(unsigned char len)
 	return len2dlc[len];
 }
 
+/* ASCII hex character to value, 16 for all non hex characters */
+static const unsigned char hexval[256] = {
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* 00 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* 10 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* 20 */
+	 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 16, 16, 16, 16, 16, 16,	/* 30 */
+	16, 10, 11, 12, 13, 14, 15, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* 40 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* 50 */
+	16, 10, 11, 12, 13, 14, 15, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* 60 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* 70 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* 80 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* 90 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* A0 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* B0 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* C0 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* D0 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16,	/* E0 */
+	16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16, 16	/* F0 */
+};
+
 unsigned char asc2nibble(char c) {
 
-	if ((c >= '0') && (c <= '9'))
-		return c - '0';
+	return hexval[(unsigned char)c]; /* 16 = error */
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_HEXDEC_SIMD
+
+/*
+ * The SIMD decoders turn a block of ASCII hex characters into bytes.
+ * They accept exactly the characters asc2nibble() accepts and leave dst
+ * untouched (returning 0) when the block contains anything else, e.g. a
+ * DATA_SEPERATOR, so the caller can fall back to the scalar code.
+ */
+
+/* 16 characters -> 8 bytes, SSE2 is always available on x86_64 */
+static int hexdec16_sse2(const char *src, unsigned char *dst)
+{
+	__m128i c = _mm_loadu_si128((const __m128i *)src);
+	__m128i lc = _mm_or_si128(c, _mm_set1_epi8(0x20)); /* 'A' -> 'a' */
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+				      _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+	__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lc, _mm_set1_epi8('a' - 1)),
+				      _mm_cmplt_epi8(lc, _mm_set1_epi8('f' + 1)));
+	__m128i val;
+
+	if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF)
+		return 0;
+
+	/* digits have 0x20 set already, so lc - '0' or lc - 'a' + 10 */
+	val = _mm_sub_epi8(lc, _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8('0')),
+					    _mm_andnot_si128(digit, _mm_set1_epi8('a' - 10))));
+
+	/* each 16 bit lane holds <high nibble, low nibble> in memory order */
+	val = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(val, _mm_set1_epi16(0xFF)), 4),
+			   _mm_srli_epi16(val, 8));
+	_mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(val, val));
+
+	return 1;
+}
+
+/* 32 characters -> 16 bytes */
+__attribute__((target("avx2")))
+static int hexdec32_avx2(const char *src, unsigned char *dst)
+{
+	__m256i c = _mm256_loadu_si256((const __m256i *)src);
+	__m256i lc = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+	__m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+					 _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+	__m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lc, _mm256_set1_epi8('a' - 1)),
+					 _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lc));
+	__m256i val;
+
+	if (_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != -1)
+		return 0;
+
+	val = _mm256_sub_epi8(lc, _mm256_or_si256(_mm256_and_si256(digit, _mm256_set1_epi8('0')),
+						  _mm256_andnot_si256(digit, _mm256_set1_epi8('a' - 10))));
+	val = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(val, _mm256_set1_epi16(0xFF)), 4),
+			      _mm256_srli_epi16(val, 8));
+
+	/* packus works per 128 bit lane, gather both 8 byte results */
+	val = _mm256_permute4x64_epi64(_mm256_packus_epi16(val, val), 0xD8);
+	_mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(val));
 
-	if ((c >= 'A') && (c <= 'F'))
-		return c - 'A' + 10;
+	return 1;
+}
+
+static int have_avx2(void)
+{
+	static int avx2 = -1;
 
-	if ((c >= 'a') && (c <= 'f'))
-		return c - 'a' + 10;
+	if (avx2 < 0)
+		avx2 = __builtin_cpu_supports("avx2");
 
-	return 16; /* error */
+	return avx2;
+}
+#endif
+
+/*
+ * Decodes leading full blocks of src (nchars ASCII hex characters) into at
+ * most maxbytes bytes of dst.  Returns the number of bytes decoded, the
+ * rest is left to the scalar asc2nibble() loops.
+ */
+static int hexdec_blocks(const char *src, int nchars, unsigned char *dst, int maxbytes)
+{
+	int n = 0;
+
+#ifdef HAVE_HEXDEC_SIMD
+	if (have_avx2())
+		while (maxbytes - n >= 16 && nchars - 2*n >= 32 &&
+		       hexdec32_avx2(src + 2*n, dst + n))
+			n += 16;
+
+	while (maxbytes - n >= 8 && nchars - 2*n >= 16 &&
+	       hexdec16_sse2(src + 2*n, dst + n))
+		n += 8;
+#endif
+
+	return n;
 }
 
 int hexstring2data(char *arg, unsigned char *data, int maxdlen) {
@@ -110,7 +219,7 @@ int hexstring2data(char *arg, unsigned char *data, int maxdlen) {
 
 	memset(data, 0, maxdlen);
 
-	for (i=0; i < len/2; i++) {
+	for (i = hexdec_blocks(arg, len, data, maxdlen); i < len/2; i++) {
 
 		tmp = asc2nibble(*(arg+(2*i)));
 		if (tmp > 0x0F)
@@ -211,69 +320,225 @@ int parse_canframe(char *cs, struct canfd_frame *cf) {
 	return ret;
 }
 
+int parse_canframe_len(const char *cs, int len, struct canfd_frame *cf) {
+	/* documentation see lib.h */
+
+	int i, idx;
+	int maxdlen = CAN_MAX_DLEN;
+	int ret = CAN_MTU;
+	unsigned char tmp;
+
+	memset(cf, 0, sizeof(*cf)); /* init CAN FD frame, e.g. LEN = 0 */
+
+	if (len < 4)
+		return 0;
+
+	if (cs[3] == CANID_DELIM) { /* 3 digits */
+
+		idx = 4;
+		for (i=0; i<3; i++){
+			if ((tmp = hexval[(unsigned char)cs[i]]) > 0x0F)
+				return 0;
+			cf->can_id |= (tmp << (2-i)*4);
+		}
+
+	} else if (len > 8 && cs[8] == CANID_DELIM) { /* 8 digits */
+
+		idx = 9;
+		for (i=0; i<8; i++){
+			if ((tmp = hexval[(unsigned char)cs[i]]) > 0x0F)
+				return 0;
+			cf->can_id |= (tmp << (7-i)*4);
+		}
+		if (!(cf->can_id & CAN_ERR_FLAG)) /* 8 digits but no errorframe?  */
+			cf->can_id |= CAN_EFF_FLAG;   /* then it is an extended frame */
+
+	} else
+		return 0;
+
+	if (idx < len && (cs[idx] == 'R' || cs[idx] == 'r')) { /* RTR frame */
+		cf->can_id |= CAN_RTR_FLAG;
+
+		/* check for optional DLC value for CAN 2.0B frames */
+		if (++idx < len && (tmp = hexval[(unsigned char)cs[idx]]) <= CAN_MAX_DLC)
+			cf->len = tmp;
+
+		return ret;
+	}
+
+	if (idx < len && cs[idx] == CANID_DELIM) { /* CAN FD frame escape char '##' */
+
+		maxdlen = CANFD_MAX_DLEN;
+		ret = CANFD_MTU;
+
+		/* CAN FD frame <canid>##<flags><data>* */
+		if (idx + 1 >= len || (tmp = hexval[(unsigned char)cs[idx+1]]) > 0x0F)
+			return 0;
+
+		cf->flags = tmp;
+		idx += 2;
+	}
+
+	/* unseparated payload: whole blocks at once */
+	i = hexdec_blocks(cs + idx, len - idx, cf->data, maxdlen);
+	idx += 2*i;
+
+	for (; i < maxdlen; i++){
+
+		if (idx < len && cs[idx] == DATA_SEPERATOR) /* skip (optional) separator */
+			idx++;
+
+		if (idx >= len) /* end of string => end of data */
+			break;
+
+		if ((tmp = hexval[(unsigned char)cs[idx++]]) > 0x0F)
+			return 0;
+		cf->data[i] = (tmp << 4);
+		if (idx >= len || (tmp = hexval[(unsigned char)cs[idx++]]) > 0x0F)
+			return 0;
+		cf->data[i] |= tmp;
+	}
+	cf->len = i;
+
+	return ret;
+}
+
+/* two ASCII hex characters per byte value */
+static const char hex2asc[512] =
+	"000102030405060708090A0B0C0D0E0F"
+	"101112131415161718191A1B1C1D1E1F"
+	"202122232425262728292A2B2C2D2E2F"
+	"303132333435363738393A3B3C3D3E3F"
+	"404142434445464748494A4B4C4D4E4F"
+	"505152535455565758595A5B5C5D5E5F"
+	"606162636465666768696A6B6C6D6E6F"
+	"707172737475767778797A7B7C7D7E7F"
+	"808182838485868788898A8B8C8D8E8F"
+	"909192939495969798999A9B9C9D9E9F"
+	"A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+	"B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+	"C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+	"D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+	"E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+	"F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+/* binary representation of a nibble */
+static const char nibble2bin[16][4] = {
+	{'0','0','0','0'}, {'0','0','0','1'}, {'0','0','1','0'}, {'0','0','1','1'},
+	{'0','1','0','0'}, {'0','1','0','1'}, {'0','1','1','0'}, {'0','1','1','1'},
+	{'1','0','0','0'}, {'1','0','0','1'}, {'1','0','1','0'}, {'1','0','1','1'},
+	{'1','1','0','0'}, {'1','1','0','1'}, {'1','1','1','0'}, {'1','1','1','1'},
+};
+
+static inline char *put_hex8(char *p, unsigned char c)
+{
+	memcpy(p, &hex2asc[2*c], 2);
+	return p + 2;
+}
+
+/* "%08X" */
+static inline char *put_hex32(char *p, canid_t v)
+{
+	p = put_hex8(p, v >> 24);
+	p = put_hex8(p, v >> 16);
+	p = put_hex8(p, v >> 8);
+	return put_hex8(p, v);
+}
+
+/* "%03X" for values up to 0xFFF */
+static inline char *put_hex12(char *p, canid_t v)
+{
+	*p++ = hex2asc[2*((v >> 8) & 0xF) + 1];
+	return put_hex8(p, v);
+}
+
+static inline char *put_bin8(char *p, unsigned char c)
+{
+	memcpy(p, nibble2bin[c >> 4], 4);
+	memcpy(p + 4, nibble2bin[c & 0xF], 4);
+	return p + 8;
+}
+
 void fprint_canframe(FILE *stream , struct canfd_frame *cf, char *eol, int sep, int maxdlen) {
 	/* documentation see lib.h */
 
 	char buf[CL_CFSZ]; /* max length */
+	int n;
 
-	sprint_canframe(buf, cf, sep, maxdlen);
-	fprintf(stream, "%s", buf);
+	n = sprint_canframe(buf, cf, sep, maxdlen);
+	fwrite(buf, 1, n, stream);
 	if (eol)
 		fprintf(stream, "%s", eol);
 }
 
-void sprint_canframe(char *buf , struct canfd_frame *cf, int sep, int maxdlen) {
+int sprint_canframe(char *buf , struct canfd_frame *cf, int sep, int maxdlen) {
 	/* documentation see lib.h */
 
-	int i,offset;
+	int i;
 	int len = (cf->len > maxdlen) ? maxdlen : cf->len;
+	char *p = buf;
 
-	if (cf->can_id & CAN_ERR_FLAG) {
-		sprintf(buf, "%08X#", cf->can_id & (CAN_ERR_MASK|CAN_ERR_FLAG));
-		offset = 9;
-	} else if (cf->can_id & CAN_EFF_FLAG) {
-		sprintf(buf, "%08X#", cf->can_id & CAN_EFF_MASK);
-		offset = 9;
-	} else {
-		sprintf(buf, "%03X#", cf->can_id & CAN_SFF_MASK);
-		offset = 4;
-	}
+	if (cf->can_id & CAN_ERR_FLAG)
+		p = put_hex32(p, cf->can_id & (CAN_ERR_MASK|CAN_ERR_FLAG));
+	else if (cf->can_id & CAN_EFF_FLAG)
+		p = put_hex32(p, cf->can_id & CAN_EFF_MASK);
+	else
+		p = put_hex12(p, cf->can_id & CAN_SFF_MASK);
+	*p++ = CANID_DELIM;
 
 	/* standard CAN frames may have RTR enabled. There are no ERR frames with RTR */
 	if (maxdlen == CAN_MAX_DLEN && cf->can_id & CAN_RTR_FLAG) {
 
+		*p++ = 'R';
 		/* print a given CAN 2.0B DLC if it's not zero */
 		if (cf->len && cf->len <= CAN_MAX_DLC)
-			sprintf(buf+offset, "R%d", cf->len);
-		else
-			sprintf(buf+offset, "R");
+			*p++ = '0' + cf->len;
+		*p = 0;
 
-		return;
+		return p - buf;
 	}
 
 	if (maxdlen == CANFD_MAX_DLEN) {
 		/* add CAN FD specific escape char and flags */
-		sprintf(buf+offset, "#%X", cf->flags & 0xF);
-		offset += 2;
+		*p++ = CANID_DELIM;
+		*p++ = hex2asc[2*(cf->flags & 0xF) + 1];
 		if (sep && len)
-			sprintf(buf+offset++, ".");
+			*p++ = DATA_SEPERATOR;
 	}
 
 	for (i = 0; i < len; i++) {
-		sprintf(buf+offset, "%02X", cf->data[i]);
-		offset += 2;
+		p = put_hex8(p, cf->data[i]);
 		if (sep && (i+1 < len))
-			sprintf(buf+offset++, ".");
+			*p++ = DATA_SEPERATOR;
 	}
+	*p = 0;
+
+	return p - buf;
+}
+
+int sprint_canframes(char *buf, struct canfd_frame *cf, int n, int sep, int maxdlen) {
+	/* documentation see lib.h */
+
+	char *p = buf;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		p += sprint_canframe(p, &cf[i], sep, maxdlen);
+		*p++ = '\n';
+	}
+	*p = 0;
+
+	return p - buf;
 }
 
 void fprint_long_canframe(FILE *stream , struct canfd_frame *cf, char *eol, int view, int maxdlen) {
 	/* documentation see lib.h */
 
 	char buf[CL_LONGCFSZ];
+	int n;
 
-	sprint_long_canframe(buf, cf, view, maxdlen);
-	fprintf(stream, "%s", buf);
+	n = sprint_long_canframe(buf, cf, view, maxdlen);
+	fwrite(buf, 1, n, stream);
 	if ((view & CANLIB_VIEW_ERROR) && (cf->can_id & CAN_ERR_FLAG)) {
 		snprintf_can_error_frame(buf, sizeof(buf), cf, "\n\t");
 		fprintf(stream, "\n\t%s", buf);
@@ -282,72 +547,76 @@ void fprint_long_canframe(FILE *stream , struct canfd_frame *cf, char *eol, int
 		fprintf(stream, "%s", eol);
 }
 
-void sprint_long_canframe(char *buf , struct canfd_frame *cf, int view, int maxdlen) {
+int sprint_long_canframe(char *buf , struct canfd_frame *cf, int view, int maxdlen) {
 	/* documentation see lib.h */
 
-	int i, j, dlen, offset;
+	int i, j, dlen;
 	int len = (cf->len > maxdlen)? maxdlen : cf->len;
+	char *p = buf;
 
 	if (cf->can_id & CAN_ERR_FLAG) {
-		sprintf(buf, "%08X  ", cf->can_id & (CAN_ERR_MASK|CAN_ERR_FLAG));
-		offset = 10;
+		p = put_hex32(p, cf->can_id & (CAN_ERR_MASK|CAN_ERR_FLAG));
 	} else if (cf->can_id & CAN_EFF_FLAG) {
-		sprintf(buf, "%08X  ", cf->can_id & CAN_EFF_MASK);
-		offset = 10;
+		p = put_hex32(p, cf->can_id & CAN_EFF_MASK);
 	} else {
 		if (view & CANLIB_VIEW_INDENT_SFF) {
-			sprintf(buf, "     %03X  ", cf->can_id & CAN_SFF_MASK);
-			offset = 10;
-		} else {
-			sprintf(buf, "%03X  ", cf->can_id & CAN_SFF_MASK);
-			offset = 5;
+			memset(p, ' ', 5);
+			p += 5;
 		}
+		p = put_hex12(p, cf->can_id & CAN_SFF_MASK);
 	}
+	*p++ = ' ';
+	*p++ = ' ';
 
 	if (maxdlen == CAN_MAX_DLEN) {
-		sprintf(buf+offset, " [%d] ", len);
+		/* " [%d] " */
+		*p++ = ' ';
+		*p++ = '[';
+		*p++ = '0' + len;
+		*p++ = ']';
+		*p++ = ' ';
 		/* standard CAN frames may have RTR enabled */
 		if (cf->can_id & CAN_RTR_FLAG) {
-			sprintf(buf+offset+5, " remote request");
-			return;
+			memcpy(p, " remote request", sizeof(" remote request"));
+			return p - buf + sizeof(" remote request") - 1;
 		}
 	} else {
-		sprintf(buf+offset, "[%02d] ", len);
+		/* "[%02d] " */
+		*p++ = '[';
+		*p++ = '0' + len / 10;
+		*p++ = '0' + len % 10;
+		*p++ = ']';
+		*p++ = ' ';
 	}
-	offset += 5;
 
 	if (view & CANLIB_VIEW_BINARY) {
 		dlen = 9; /* _10101010 */
 		if (view & CANLIB_VIEW_SWAP) {
 			for (i = len - 1; i >= 0; i--) {
-				buf[offset++] = (i == len-1)?' ':SWAP_DELIMITER;
-				for (j = 7; j >= 0; j--)
-					buf[offset++] = (1<<j & cf->data[i])?'1':'0';
+				*p++ = (i == len-1)?' ':SWAP_DELIMITER;
+				p = put_bin8(p, cf->data[i]);
 			}
 		} else {
 			for (i = 0; i < len; i++) {
-				buf[offset++] = ' ';
-				for (j = 7; j >= 0; j--)
-					buf[offset++] = (1<<j & cf->data[i])?'1':'0';
+				*p++ = ' ';
+				p = put_bin8(p, cf->data[i]);
 			}
 		}
-		buf[offset] = 0; /* terminate string */
 	} else {
 		dlen = 3; /* _AA */
 		if (view & CANLIB_VIEW_SWAP) {
 			for (i = len - 1; i >= 0; i--) {
-				sprintf(buf+offset, "%c%02X",
-					(i == len-1)?' ':SWAP_DELIMITER,
-					cf->data[i]);
-				offset += dlen;
+				*p++ = (i == len-1)?' ':SWAP_DELIMITER;
+				p = put_hex8(p, cf->data[i]);
 			}
 		} else {
 			for (i = 0; i < len; i++) {
-				sprintf(buf+offset, " %02X", cf->data[i]);
-				offset += dlen;
+				*p++ = ' ';
+				p = put_hex8(p, cf->data[i]);
 			}
 		}
 	}
+	*p = 0; /* terminate string */
 
 	/*
 	 * The ASCII & ERRORFRAME output is put at a fixed len behind the data.
@@ -355,34 +624,40 @@ void sprint_long_canframe(char *buf , struct canfd_frame *cf, int view, int maxd
 	 * Does it make sense to write 64 ASCII byte behind 64 ASCII HEX data on the console?
 	 */
 	if (len > CAN_MAX_DLEN)
-		return;
+		return p - buf;
 
-	if (cf->can_id & CAN_ERR_FLAG)
-		sprintf(buf+offset, "%*s", dlen*(8-len)+13, "ERRORFRAME");
-	else if (view & CANLIB_VIEW_ASCII) {
-		j = dlen*(8-len)+4;
+	if (cf->can_id & CAN_ERR_FLAG) {
+		/* "%*s" right aligned at dlen*(8-len)+13 */
+		j = dlen*(8-len)+3;
+		memset(p, ' ', j);
+		p += j;
+		memcpy(p, "ERRORFRAME", sizeof("ERRORFRAME"));
+		p += sizeof("ERRORFRAME") - 1;
+	} else if (view & CANLIB_VIEW_ASCII) {
+		char delim = (view & CANLIB_VIEW_SWAP) ? '`' : '\'';
+
+		j = dlen*(8-len)+3;
+		memset(p, ' ', j);
+		p += j;
+		*p++ = delim;
 		if (view & CANLIB_VIEW_SWAP) {
-			sprintf(buf+offset, "%*s", j, "`");
-			offset += j;
 			for (i = len - 1; i >= 0; i--)
 				if ((cf->data[i] > 0x1F) && (cf->data[i] < 0x7F))
-					buf[offset++] = cf->data[i];
+					*p++ = cf->data[i];
 				else
-					buf[offset++] = '.';
-
-			sprintf(buf+offset, "`");
+					*p++ = '.';
 		} else {
-			sprintf(buf+offset, "%*s", j, "'");
-			offset += j;
 			for (i = 0; i < len; i++)
 				if ((cf->data[i] > 0x1F) && (cf->data[i] < 0x7F))
-					buf[offset++] = cf->data[i];
+					*p++ = cf->data[i];
 				else
-					buf[offset++] = '.';
-
-			sprintf(buf+offset, "'");
+					*p++ = '.';
 		}
+		*p++ = delim;
+		*p = 0;
 	}
+
+	return p - buf;
 }
 
 static const char *error_classes[] = {
@@ -142,11 +142,25 @@ int parse_canframe(char *cs, struct canfd_frame *cf);
  * - CAN FD frames do not have a RTR bit
  */
 
+int parse_canframe_len(const char *cs, int len, struct canfd_frame *cf);
+/*
+ * Same as parse_canframe() for the first len characters of cs, which do
+ * not need to be terminated.  Results are identical for strings of that
+ * length, including the partially filled canfd_frame on errors.
+ *
+ * Hex digits are decoded through a lookup table instead of asc2nibble()
+ * and payloads without DATA_SEPERATORs are decoded 16 (SSE2) or 32 (AVX2,
+ * selected at runtime) characters at a time on x86_64.  This is the
+ * variant to use when parsing large logs, as the string length is usually
+ * known from the line scan already.
+ */
+
 void fprint_canframe(FILE *stream , struct canfd_frame *cf, char *eol, int sep, int maxdlen);
-void sprint_canframe(char *buf , struct canfd_frame *cf, int sep, int maxdlen);
+int sprint_canframe(char *buf , struct canfd_frame *cf, int sep, int maxdlen);
 /*
  * Creates a CAN frame hexadecimal output in compact format.
  * The CAN data[] is separated by '.' when sep != 0.
+ * Returns the length of the terminated string written to buf.
  *
  * The type of the CAN frame (CAN 2.0 / CAN FD) is specified by maxdlen:
  * maxdlen = 8 -> CAN2.0 frame
@@ -167,6 +181,16 @@ void sprint_canframe(char *buf , struct canfd_frame *cf, int sep, int maxdlen);
  *
  */
 
+int sprint_canframes(char *buf, struct canfd_frame *cf, int n, int sep, int maxdlen);
+/*
+ * Creates the compact format of n frames, each followed by '\n', in one
+ * contiguous buffer so a batch can be written with a single write().
+ * buf needs n * CL_CFSZ bytes.  Returns the total length.
+ *
+ * Neither formatter uses sprintf(): bytes are emitted from a two character
+ * hex table and binary views from precomputed nibble strings.
+ */
+
 #define CANLIB_VIEW_ASCII	0x1
 #define CANLIB_VIEW_BINARY	0x2
 #define CANLIB_VIEW_SWAP	0x4
@@ -176,9 +200,10 @@ void sprint_canframe(char *buf , struct canfd_frame *cf, int sep, int maxdlen);
 #define SWAP_DELIMITER '`'
 
 void fprint_long_canframe(FILE *stream , struct canfd_frame *cf, char *eol, int view, int maxdlen);
-void sprint_long_canframe(char *buf , struct canfd_frame *cf, int view, int maxdlen);
+int sprint_long_canframe(char *buf , struct canfd_frame *cf, int view, int maxdlen);
 /*
  * Creates a CAN frame hexadecimal output in user readable format.
+ * Returns the length of the terminated string written to buf.
  *
  * The type of the CAN frame (CAN 2.0 / CAN FD) is specified by maxdlen:
  * maxdlen = 8 -> CAN2.0 frame
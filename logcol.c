@@ -0,0 +1,394 @@
+/*
+ * logcol.c - columnar CAN log store
+ *
+ * See logcol.h for the file layout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logcol.h"
+
+#define STDIO_BUFSZ	(1 << 20)
+#define COLUMN_MIN	64
+
+/* makes room for one more frame, byte columns up to width included */
+static int grow_buf(struct logcol_buf *b, int width)
+{
+	__u64 alloc = b->alloc;
+	void *p;
+	int i;
+
+	if (b->n == alloc) {
+		alloc = alloc ? 2 * alloc : COLUMN_MIN;
+		if (!(p = realloc(b->ts, alloc * sizeof(*b->ts))))
+			return -1;
+		b->ts = p;
+		if (!(p = realloc(b->len, alloc)))
+			return -1;
+		b->len = p;
+		if (!(p = realloc(b->flags, alloc)))
+			return -1;
+		b->flags = p;
+		for (i = 0; i < b->width; i++) {
+			if (!(p = realloc(b->col[i], alloc)))
+				return -1;
+			b->col[i] = p;
+			memset(b->col[i] + b->alloc, 0, alloc - b->alloc);
+		}
+		b->alloc = alloc;
+	}
+
+	/* a longer payload than before, earlier frames read as 0 */
+	for (; b->width < width; b->width++) {
+		b->col[b->width] = calloc(b->alloc, 1);
+		if (!b->col[b->width])
+			return -1;
+	}
+
+	return 0;
+}
+
+int logcol_create(struct logcol *c, const char *path)
+{
+	memset(c, 0, sizeof(*c));
+	idtable_init(&c->bufs, sizeof(struct logcol_buf), 0);
+
+	c->fp = fopen(path, "wb");
+	if (!c->fp)
+		return -1;
+	setvbuf(c->fp, NULL, _IOFBF, STDIO_BUFSZ);
+
+	return 0;
+}
+
+int logcol_write(struct logcol *c, const struct canlog_rec *rec,
+		 const char *ifname)
+{
+	struct logcol_buf *b;
+	int idx, len, i;
+
+	idx = canlog_ifindex(&c->ifaces, ifname);
+	if (idx < 0) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	b = idtable_get(&c->bufs, idtable_key(idx, rec->can_id));
+	len = rec->len > CANFD_MAX_DLEN ? CANFD_MAX_DLEN : rec->len;
+	if (!b || grow_buf(b, len)) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (b->n && rec->ts_ns < b->ts[b->n - 1])
+		b->unsorted = 1;
+	b->ts[b->n] = rec->ts_ns;
+	b->len[b->n] = len;
+	b->flags[b->n] = rec->flags;
+	for (i = 0; i < len; i++)
+		b->col[i][b->n] = rec->data[i];
+	b->n++;
+	c->n_frames++;
+
+	return 0;
+}
+
+static const __u64 *sort_ts;
+
+static int cmp_row(const void *a, const void *b)
+{
+	__u64 ra = *(const __u64 *)a, rb = *(const __u64 *)b;
+
+	if (sort_ts[ra] != sort_ts[rb])
+		return sort_ts[ra] < sort_ts[rb] ? -1 : 1;
+	return (ra > rb) - (ra < rb);
+}
+
+static int permute(void *col, size_t size, const __u64 *row, __u64 n)
+{
+	__u8 *tmp = malloc(n * size);
+	__u64 i;
+
+	if (!tmp)
+		return -1;
+	for (i = 0; i < n; i++)
+		memcpy(tmp + i * size, (__u8 *)col + row[i] * size, size);
+	memcpy(col, tmp, n * size);
+	free(tmp);
+
+	return 0;
+}
+
+/* brings the frames of an ID that arrived out of order into time order */
+static int sort_buf(struct logcol_buf *b)
+{
+	__u64 *row, i;
+	int ret = 0, j;
+
+	row = malloc(b->n * sizeof(*row));
+	if (!row)
+		return -1;
+	for (i = 0; i < b->n; i++)
+		row[i] = i;
+	sort_ts = b->ts;
+	qsort(row, b->n, sizeof(*row), cmp_row);
+
+	ret |= permute(b->ts, sizeof(*b->ts), row, b->n);
+	ret |= permute(b->len, 1, row, b->n);
+	ret |= permute(b->flags, 1, row, b->n);
+	for (j = 0; j < b->width; j++)
+		ret |= permute(b->col[j], 1, row, b->n);
+	free(row);
+
+	return ret;
+}
+
+static int cmp_id(const void *a, const void *b)
+{
+	const struct logcol_buf *ba = *(struct logcol_buf * const *)a;
+	const struct logcol_buf *bb = *(struct logcol_buf * const *)b;
+
+	return (ba->key > bb->key) - (ba->key < bb->key);
+}
+
+static __u64 align(__u64 off)
+{
+	return (off + LOGCOL_ALIGN - 1) & ~(__u64)(LOGCOL_ALIGN - 1);
+}
+
+static int put(FILE *fp, __u64 *off, const void *data, size_t size)
+{
+	static const __u8 zero[LOGCOL_ALIGN];
+	size_t pad = align(*off) - *off;
+
+	if ((pad && fwrite(zero, pad, 1, fp) != 1) ||
+	    (size && fwrite(data, size, 1, fp) != 1))
+		return -1;
+	*off += pad + size;
+
+	return 0;
+}
+
+static int write_store(struct logcol *c)
+{
+	struct logcol_header hdr;
+	struct logcol_buf **order, *b;
+	struct logcol_id *ids;
+	__u64 off;
+	unsigned int i, n = 0;
+	int j, ret = -1;
+
+	order = malloc((c->bufs.count + 1) * sizeof(*order));
+	ids = calloc(c->bufs.count + 1, sizeof(*ids));
+	if (!order || !ids)
+		goto out;
+
+	for (i = 0; i < c->bufs.size; i++) {
+		b = idtable_slot(&c->bufs, i);
+		if (b->n)
+			order[n++] = b;
+	}
+	qsort(order, n, sizeof(*order), cmp_id);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LOGCOL_MAGIC, sizeof(hdr.magic));
+	hdr.version = LOGCOL_VERSION;
+	hdr.n_ifaces = c->ifaces.n_ifaces;
+	memcpy(hdr.ifname, c->ifaces.ifname, sizeof(hdr.ifname));
+	hdr.n_ids = n;
+	hdr.n_frames = c->n_frames;
+	hdr.first_ts = ~0ULL;
+
+	/* lay out the columns */
+	off = sizeof(hdr) + n * sizeof(*ids);
+	for (i = 0; i < n; i++) {
+		b = order[i];
+		if (b->unsorted && sort_buf(b))
+			goto out;
+		if (b->ts[0] < hdr.first_ts)
+			hdr.first_ts = b->ts[0];
+		if (b->ts[b->n - 1] > hdr.last_ts)
+			hdr.last_ts = b->ts[b->n - 1];
+
+		ids[i].can_id = b->key & 0xFFFFFFFF;
+		ids[i].ifindex = (b->key >> 32) - 1;
+		ids[i].width = b->width;
+		ids[i].n_frames = b->n;
+		ids[i].stride = align(b->n);
+		ids[i].ts_off = off = align(off);
+		off += b->n * sizeof(*b->ts);
+		ids[i].len_off = off = align(off);
+		off += b->n;
+		ids[i].flags_off = off = align(off);
+		off += b->n;
+		ids[i].data_off = off = align(off);
+		off += b->width * ids[i].stride;
+	}
+	if (!n)
+		hdr.first_ts = 0;
+
+	off = 0;
+	if (put(c->fp, &off, &hdr, sizeof(hdr)) ||
+	    put(c->fp, &off, ids, n * sizeof(*ids)))
+		goto out;
+	for (i = 0; i < n; i++) {
+		b = order[i];
+		if (put(c->fp, &off, b->ts, b->n * sizeof(*b->ts)) ||
+		    put(c->fp, &off, b->len, b->n) ||
+		    put(c->fp, &off, b->flags, b->n))
+			goto out;
+		for (j = 0; j < b->width; j++)
+			if (put(c->fp, &off, b->col[j], b->n))
+				goto out;
+	}
+	ret = 0;
+
+out:
+	free(order);
+	free(ids);
+	return ret;
+}
+
+static int check_store(struct logcol *c)
+{
+	const struct logcol_header *hdr = (const struct logcol_header *)c->map;
+	const struct logcol_id *id;
+	unsigned int i;
+
+	if (c->size < sizeof(*hdr) ||
+	    hdr->version != LOGCOL_VERSION ||
+	    hdr->n_ifaces > CANLOG_MAX_IFACES ||
+	    hdr->n_ids > (c->size - sizeof(*hdr)) / sizeof(*id))
+		return -1;
+
+	c->hdr = hdr;
+	c->ids = (const struct logcol_id *)(c->map + sizeof(*hdr));
+
+	for (i = 0; i < hdr->n_ids; i++) {
+		id = &c->ids[i];
+		if (id->ifindex >= hdr->n_ifaces ||
+		    id->width > CANFD_MAX_DLEN ||
+		    id->n_frames > c->size || id->stride < id->n_frames ||
+		    id->ts_off % sizeof(__u64) ||
+		    id->ts_off > c->size ||
+		    id->n_frames > (c->size - id->ts_off) / sizeof(__u64) ||
+		    id->len_off > c->size || id->n_frames > c->size - id->len_off ||
+		    id->flags_off > c->size || id->n_frames > c->size - id->flags_off ||
+		    id->data_off > c->size ||
+		    (id->width && (id->stride > c->size ||
+				   (id->width - 1) * id->stride + id->n_frames >
+				   c->size - id->data_off)))
+			return -1;
+	}
+
+	return 0;
+}
+
+int logcol_open(struct logcol *c, const char *path)
+{
+	struct stat st;
+	int fd;
+
+	memset(c, 0, sizeof(*c));
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	c->size = st.st_size;
+
+	if (c->size < sizeof(*c->hdr)) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
+	}
+	c->map = mmap(NULL, c->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); /* the mapping keeps the file referenced */
+	if (c->map == MAP_FAILED) {
+		c->map = NULL;
+		return -1;
+	}
+
+	if (memcmp(c->map, LOGCOL_MAGIC, sizeof(c->hdr->magic)) ||
+	    check_store(c)) {
+		logcol_close(c);
+		errno = EINVAL;
+		return -1;
+	}
+
+	return 0;
+}
+
+int logcol_close(struct logcol *c)
+{
+	struct logcol_buf *b;
+	unsigned int i;
+	int j, ret = 0;
+
+	if (c->map) {
+		munmap((void *)c->map, c->size);
+		c->map = NULL;
+		return 0;
+	}
+
+	if (write_store(c))
+		ret = -1;
+	if (fclose(c->fp))
+		ret = -1;
+
+	for (i = 0; i < c->bufs.size; i++) {
+		b = idtable_slot(&c->bufs, i);
+		free(b->ts);
+		free(b->len);
+		free(b->flags);
+		for (j = 0; j < b->width; j++)
+			free(b->col[j]);
+	}
+	idtable_free(&c->bufs);
+
+	return ret;
+}
+
+void logcol_range(const struct logcol *c, const struct logcol_id *id,
+		  __u64 from_ns, __u64 to_ns, __u64 *lo, __u64 *hi)
+{
+	const __u64 *ts = logcol_ts(c, id);
+	__u64 l, h, mid;
+
+	/* first frame at or after from_ns */
+	l = 0;
+	h = id->n_frames;
+	while (l < h) {
+		mid = (l + h) / 2;
+		if (ts[mid] < from_ns)
+			l = mid + 1;
+		else
+			h = mid;
+	}
+	*lo = l;
+
+	/* first frame at or after to_ns */
+	h = id->n_frames;
+	while (l < h) {
+		mid = (l + h) / 2;
+		if (ts[mid] < to_ns)
+			l = mid + 1;
+		else
+			h = mid;
+	}
+	*hi = l;
+}
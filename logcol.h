@@ -0,0 +1,151 @@
+/*
+ * logcol.h - columnar CAN log store
+ *
+ * Most questions asked of a capture are about a few CAN IDs: "all
+ * payloads of 244 between t1 and t2", "when did byte 2 of 19B have bit 6
+ * set".  A row oriented log makes every such query read every frame.  A
+ * column store keeps the frames of each (interface, CAN ID) together, with
+ * one column for the timestamps, the lengths, the flags and every payload
+ * byte:
+ *
+ *	struct logcol_header
+ *	struct logcol_id[n_ids]		sorted by ifindex, then can_id
+ *	columns of ID 0, ID 1, ...
+ *
+ * The columns of an ID are its n_frames timestamps (__u64, ns since the
+ * epoch, ascending), lengths, flags (as canlog_rec.flags) and then width
+ * byte columns, column b holding payload byte b of every frame or 0 past
+ * its length.  Every column starts at a LOGCOL_ALIGN boundary.  A query
+ * maps the file, binary searches the time range and only touches the
+ * columns it tests, in sequential runs that vectorize well.
+ *
+ * Files are written in one go from any frame source, frames may arrive in
+ * any order.  All fields are in host byte order.
+ */
+
+#ifndef LOGCOL_H
+#define LOGCOL_H
+
+#include <stdio.h>
+#include <linux/types.h>
+#include <linux/can.h>
+#include <net/if.h>
+
+#include "canlog.h"
+#include "idtable.h"
+
+#define LOGCOL_MAGIC		"ICSIMCOL"
+#define LOGCOL_VERSION		1
+#define LOGCOL_ALIGN		64
+
+struct logcol_header {
+	char magic[8];		/* LOGCOL_MAGIC, not terminated */
+	__u16 version;		/* LOGCOL_VERSION */
+	__u16 n_ifaces;
+	__u32 n_ids;
+	__u64 n_frames;
+	__u64 first_ts;		/* of the whole log */
+	__u64 last_ts;
+	__u64 reserved[3];	/* zero */
+	char ifname[CANLOG_MAX_IFACES][IFNAMSIZ];
+};
+
+struct logcol_id {
+	canid_t can_id;		/* including CAN_*_FLAG bits */
+	__u8 ifindex;
+	__u8 width;		/* byte columns, the longest payload */
+	__u16 __res;
+	__u64 n_frames;
+	__u64 ts_off;		/* file offsets of the columns */
+	__u64 len_off;
+	__u64 flags_off;
+	__u64 data_off;		/* column b at data_off + b * stride */
+	__u64 stride;		/* n_frames rounded up to LOGCOL_ALIGN */
+};
+
+/* per ID columns while writing */
+struct logcol_buf {
+	__u64 key;		/* (ifindex + 1) << 32 | can_id, 0 = free slot */
+	__u64 n, alloc;
+	int width;
+	int unsorted;
+	__u64 *ts;
+	__u8 *len;
+	__u8 *flags;
+	__u8 *col[CANFD_MAX_DLEN];
+};
+
+struct logcol {
+	/* reading */
+	const __u8 *map;
+	size_t size;
+	const struct logcol_header *hdr;
+	const struct logcol_id *ids;
+
+	/* writing */
+	FILE *fp;
+	struct canlog_header ifaces;
+	struct idtable bufs;		/* of struct logcol_buf */
+	__u64 n_frames;
+};
+
+int logcol_create(struct logcol *c, const char *path);
+/*
+ * Starts a column store that is written to path by logcol_close().
+ * Return values: 0 = success, -1 = error (errno set)
+ */
+
+int logcol_write(struct logcol *c, const struct canlog_rec *rec,
+		 const char *ifname);
+/*
+ * Adds a frame received on ifname.  Frames are kept in memory until
+ * logcol_close().
+ *
+ * Return values: 0 = success, -1 = error (errno set, ENOSPC when there
+ * are more than CANLOG_MAX_IFACES interfaces)
+ */
+
+int logcol_open(struct logcol *c, const char *path);
+/*
+ * Maps a column store for reading.
+ * Return values: 0 = success, -1 = error (errno set, EINVAL on a bad file)
+ */
+
+int logcol_close(struct logcol *c);
+/*
+ * Writes the file of a store being created, unmaps one being read.
+ * Return values: 0 = success, -1 = error (errno set)
+ */
+
+void logcol_range(const struct logcol *c, const struct logcol_id *id,
+		  __u64 from_ns, __u64 to_ns, __u64 *lo, __u64 *hi);
+/*
+ * Returns in [*lo, *hi) the frames of id with from_ns <= ts < to_ns.
+ */
+
+static inline const __u64 *logcol_ts(const struct logcol *c,
+				     const struct logcol_id *id)
+{
+	return (const __u64 *)(c->map + id->ts_off);
+}
+
+static inline const __u8 *logcol_len(const struct logcol *c,
+				     const struct logcol_id *id)
+{
+	return c->map + id->len_off;
+}
+
+static inline const __u8 *logcol_flags(const struct logcol *c,
+				       const struct logcol_id *id)
+{
+	return c->map + id->flags_off;
+}
+
+/* payload byte b of every frame, b < id->width */
+static inline const __u8 *logcol_byte(const struct logcol *c,
+				      const struct logcol_id *id, int b)
+{
+	return c->map + id->data_off + b * id->stride;
+}
+
+#endif
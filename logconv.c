@@ -0,0 +1,704 @@
+/*
+ * logconv.c - convert CAN logs between candump text, binary, packed, columnar
+ *             and pcap formats
+ *
+ * Usage: ./logconv [-f] [-o format] <infile> <outfile>
+ *        ./logconv -B [-n count] <infile>
+ *        ./logconv -P [-n count] <infile>
+ *
+ * The input format is detected: binary logs (see canlog.h), packed logs
+ * (see logpack.h), pcap and pcapng files (see canpcap.h) and anything else
+ * as candump text.  The output format is given with -o or taken from the
+ * extension of outfile (.log/.txt, .bin, .pack, .col, .pcap, .pcapng).
+ * Otherwise candump text is written as a binary log and everything else as
+ * candump text.  Column stores (see logcol.h) are only written, canquery
+ * reads them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logreader.h"
+#include "canpcap.h"
+#include "logpack.h"
+#include "logcol.h"
+
+#define DEFAULT_BENCH_RUNS 5
+
+#define FMT_TEXT	1
+#define FMT_BIN		2
+#define FMT_PCAP	3
+#define FMT_PCAPNG	4
+#define FMT_PACK	5
+#define FMT_COL		6
+
+static void usage(char *msg)
+{
+	if (msg)
+		fprintf(stderr, "%s\n", msg);
+	fprintf(stderr, "Usage: logconv [options] <infile> [outfile]\n");
+	fprintf(stderr, "\t-f\twrite CAN FD sized records (needed for logs with CAN FD frames)\n");
+	fprintf(stderr, "\t-o\toutput format: text, bin, pack, col, pcap or pcapng\n");
+	fprintf(stderr, "\t-B\tbenchmark reading infile instead of converting it\n");
+	fprintf(stderr, "\t-P\tcheck and benchmark parse_canframe_len() against parse_canframe()\n");
+	fprintf(stderr, "\t-n\tbenchmark runs (default: %d)\n", DEFAULT_BENCH_RUNS);
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* an input log of any of the formats */
+struct source {
+	int pcap;
+	struct logreader lr;
+	struct canpcap *pc;
+	union {
+		struct canlog_rec rec;
+		__u8 buf[CANLOG_REC_CANFD];
+	} cur;
+};
+
+static int src_open(struct source *src, const char *path)
+{
+	memset(src, 0, sizeof(*src));
+	src->pcap = canpcap_detect(path) > 0;
+
+	if (!src->pcap)
+		return logreader_open(&src->lr, path);
+
+	src->pc = malloc(sizeof(*src->pc));
+	if (!src->pc)
+		return -1;
+	if (canpcap_open(src->pc, path)) {
+		free(src->pc);
+		return -1;
+	}
+
+	return 0;
+}
+
+static const struct canlog_rec *src_next(struct source *src)
+{
+	int ret;
+
+	if (!src->pcap)
+		return logreader_next(&src->lr);
+
+	ret = canpcap_read(src->pc, &src->cur.rec);
+	if (ret < 0)
+		perror("pcap");
+
+	return ret > 0 ? &src->cur.rec : NULL;
+}
+
+static const char *src_ifname(struct source *src, int ifindex)
+{
+	if (!src->pcap)
+		return logreader_ifname(&src->lr, ifindex);
+
+	return ifindex < src->pc->hdr.n_ifaces ? src->pc->hdr.ifname[ifindex] : "?";
+}
+
+static void src_close(struct source *src)
+{
+	if (!src->pcap) {
+		if (src->lr.bad_lines && !src->lr.binary && !src->lr.packed)
+			fprintf(stderr, "skipped %lu malformed lines\n", src->lr.bad_lines);
+		logreader_close(&src->lr);
+		return;
+	}
+
+	if (src->pc->skipped)
+		fprintf(stderr, "skipped %lu packets that are no SocketCAN frames\n",
+			src->pc->skipped);
+	canpcap_close(src->pc);
+	free(src->pc);
+}
+
+static int write_bin(struct source *src, const char *out, int canfd)
+{
+	__u8 recbuf[CANLOG_REC_CANFD];
+	struct canlog_rec *rec = (struct canlog_rec *)recbuf;
+	const struct canlog_rec *in;
+	struct canlog log;
+	int idx, ret = 0;
+	size_t n;
+
+	if (canlog_create(&log, out, canfd)) {
+		perror(out);
+		return 1;
+	}
+
+	while ((in = src_next(src))) {
+		if (in->len > CAN_MAX_DLEN && !canfd) {
+			fprintf(stderr, "CAN FD payload at %llu ns, convert with -f\n",
+				(unsigned long long)in->ts_ns);
+			ret = 1;
+			break;
+		}
+		/* the reader's interface table is built in line order, too */
+		idx = canlog_ifindex(&log.hdr, src_ifname(src, in->ifindex));
+		if (idx < 0) {
+			fprintf(stderr, "more than %d interfaces\n", CANLOG_MAX_IFACES);
+			ret = 1;
+			break;
+		}
+
+		/* binary sources hand out their records in place, at their own size */
+		n = sizeof(*in) + in->len;
+		memcpy(rec, in, n);
+		memset(recbuf + n, 0, log.hdr.rec_size - n);
+		rec->ifindex = idx;
+		if (canlog_write(&log, rec)) {
+			perror(out);
+			ret = 1;
+			break;
+		}
+	}
+
+	if (canlog_close(&log)) {
+		perror(out);
+		return 1;
+	}
+	printf("%s: %llu frames, %d interfaces\n", out,
+	       (unsigned long long)log.hdr.n_recs, log.hdr.n_ifaces);
+
+	return ret;
+}
+
+static int write_text(struct source *src, const char *out)
+{
+	static char buf[1 << 16];
+	const struct canlog_rec *rec;
+	struct canfd_frame cf;
+	size_t n = 0;
+	int mtu, ret = 0;
+	FILE *fp;
+
+	fp = fopen(out, "w");
+	if (!fp) {
+		perror(out);
+		return 1;
+	}
+
+	/* format into one buffer, written out in large chunks */
+	while ((rec = src_next(src))) {
+		mtu = canlog_rec2frame(rec, &cf);
+		n += canlog_sprint_line(buf + n, rec->ts_ns,
+					src_ifname(src, rec->ifindex), &cf, mtu);
+		if (n > sizeof(buf) - CANLOG_LINESZ) {
+			if (fwrite(buf, 1, n, fp) != n) {
+				ret = 1;
+				break;
+			}
+			n = 0;
+		}
+	}
+	if (!ret && fwrite(buf, 1, n, fp) != n)
+		ret = 1;
+
+	if (fclose(fp) || ret) {
+		perror(out);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int write_pcap(struct source *src, const char *out, int ng)
+{
+	static struct canpcap pc;
+	const struct canlog_rec *rec;
+	unsigned long frames = 0;
+	int ret = 0;
+
+	if (canpcap_create(&pc, out, ng)) {
+		perror(out);
+		return 1;
+	}
+
+	while ((rec = src_next(src))) {
+		if (canpcap_write(&pc, rec, src_ifname(src, rec->ifindex))) {
+			perror(out);
+			ret = 1;
+			break;
+		}
+		frames++;
+	}
+
+	if (canpcap_close(&pc)) {
+		perror(out);
+		return 1;
+	}
+	printf("%s: %lu frames\n", out, frames);
+
+	return ret;
+}
+
+static int write_pack(struct source *src, const char *out)
+{
+	static struct logpack pk;
+	const struct canlog_rec *rec;
+	unsigned long frames = 0;
+	int ret = 0;
+
+	if (logpack_create(&pk, out)) {
+		perror(out);
+		return 1;
+	}
+
+	while ((rec = src_next(src))) {
+		if (logpack_write(&pk, rec, src_ifname(src, rec->ifindex))) {
+			perror(out);
+			ret = 1;
+			break;
+		}
+		frames++;
+	}
+
+	if (logpack_close(&pk)) {
+		perror(out);
+		return 1;
+	}
+	printf("%s: %lu frames in %llu blocks\n", out, frames,
+	       (unsigned long long)pk.hdr.n_blocks);
+
+	return ret;
+}
+
+static int write_col(struct source *src, const char *out)
+{
+	static struct logcol col;
+	const struct canlog_rec *rec;
+	int ret = 0;
+
+	if (logcol_create(&col, out)) {
+		perror(out);
+		return 1;
+	}
+
+	while ((rec = src_next(src))) {
+		if (logcol_write(&col, rec, src_ifname(src, rec->ifindex))) {
+			perror(out);
+			ret = 1;
+			break;
+		}
+	}
+
+	printf("%s: %llu frames of %u CAN IDs\n", out,
+	       (unsigned long long)col.n_frames, col.bufs.count);
+	if (logcol_close(&col)) {
+		perror(out);
+		return 1;
+	}
+
+	return ret;
+}
+
+/* output format from the file name, 0 when it says nothing */
+static int format_of(const char *path)
+{
+	const char *ext = strrchr(path, '.');
+
+	if (!ext)
+		return 0;
+	if (!strcmp(ext, ".pcap"))
+		return FMT_PCAP;
+	if (!strcmp(ext, ".pcapng"))
+		return FMT_PCAPNG;
+	if (!strcmp(ext, ".bin"))
+		return FMT_BIN;
+	if (!strcmp(ext, ".pack"))
+		return FMT_PACK;
+	if (!strcmp(ext, ".col"))
+		return FMT_COL;
+	if (!strcmp(ext, ".log") || !strcmp(ext, ".txt"))
+		return FMT_TEXT;
+
+	return 0;
+}
+
+static int convert(const char *in, const char *out, int format, int canfd)
+{
+	struct source src;
+	int ret;
+
+	if (src_open(&src, in)) {
+		perror(in);
+		return 1;
+	}
+
+	if (!format)
+		format = format_of(out);
+	if (!format)
+		format = (src.pcap || src.lr.binary || src.lr.packed) ?
+			 FMT_TEXT : FMT_BIN;
+
+	switch (format) {
+	case FMT_BIN:
+		ret = write_bin(&src, out, canfd);
+		break;
+	case FMT_PACK:
+		ret = write_pack(&src, out);
+		break;
+	case FMT_COL:
+		ret = write_col(&src, out);
+		break;
+	case FMT_PCAP:
+	case FMT_PCAPNG:
+		ret = write_pcap(&src, out, format == FMT_PCAPNG);
+		break;
+	default:
+		ret = write_text(&src, out);
+		break;
+	}
+
+	/* a text log may have junk lines, a binary one is broken */
+	if (!src.pcap && (src.lr.binary || src.lr.packed) && src.lr.bad_lines) {
+		fprintf(stderr, "%s: corrupt log, skipped %lu %s\n", in,
+			src.lr.bad_lines, src.lr.packed ? "blocks" : "records");
+		ret = 1;
+	}
+	src_close(&src);
+
+	return ret;
+}
+
+/* reads the whole log once, returns the number of frames or -1 */
+static long bench_text(const char *in)
+{
+	char line[CANLOG_LINESZ], ifname[IFNAMSIZ];
+	struct canfd_frame cf;
+	long frames = 0;
+	__u64 ts;
+	FILE *fp;
+
+	fp = fopen(in, "r");
+	if (!fp)
+		return -1;
+	while (fgets(line, sizeof(line), fp))
+		if (canlog_parse_line(line, strlen(line), &ts, ifname, &cf))
+			frames++;
+	fclose(fp);
+
+	return frames;
+}
+
+static long bench_bin(const char *in)
+{
+	__u8 recbuf[CANLOG_REC_CANFD];
+	struct canlog_rec *rec = (struct canlog_rec *)recbuf;
+	struct canfd_frame cf;
+	struct canlog log;
+	long frames = 0;
+
+	if (canlog_open(&log, in))
+		return -1;
+	while (canlog_read(&log, rec) > 0) {
+		canlog_rec2frame(rec, &cf);
+		frames++;
+	}
+	canlog_close(&log);
+
+	return frames;
+}
+
+static long bench_mmap(const char *in)
+{
+	const struct canlog_rec *rec;
+	struct logreader lr;
+	struct canfd_frame cf;
+	long frames = 0;
+
+	if (logreader_open(&lr, in))
+		return -1;
+	while ((rec = logreader_next(&lr))) {
+		canlog_rec2frame(rec, &cf);
+		frames++;
+	}
+	logreader_close(&lr);
+
+	return frames;
+}
+
+static long bench_pcap(const char *in)
+{
+	static struct canpcap pc;
+	__u8 recbuf[CANLOG_REC_CANFD];
+	struct canlog_rec *rec = (struct canlog_rec *)recbuf;
+	struct canfd_frame cf;
+	long frames = 0;
+	int ret;
+
+	if (canpcap_open(&pc, in))
+		return -1;
+	while ((ret = canpcap_read(&pc, rec)) > 0) {
+		canlog_rec2frame(rec, &cf);
+		frames++;
+	}
+	canpcap_close(&pc);
+
+	return ret < 0 ? -1 : frames;
+}
+
+static int bench_run(const char *name, long (*read)(const char *),
+		     const char *path, const char *format, int runs)
+{
+	double start, elapsed;
+	long frames = 0;
+	FILE *fp;
+	long size;
+	int i;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		perror(path);
+		return 1;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fclose(fp);
+
+	start = now();
+	for (i = 0; i < runs; i++) {
+		frames = read(path);
+		if (frames < 0) {
+			perror(path);
+			return 1;
+		}
+	}
+	elapsed = now() - start;
+
+	printf("%-6s %-5s %9ld frames %10ld bytes %6.1f B/frame %12.0f frames/s %8.1f MB/s\n",
+	       format, name, frames, size,
+	       frames ? (double)size / frames : 0.0,
+	       frames * runs / elapsed, size * runs / elapsed / 1e6);
+
+	return 0;
+}
+
+static int is_packed(const char *path)
+{
+	char magic[8];
+	FILE *fp;
+	int ret;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		return -1;
+	ret = fread(magic, sizeof(magic), 1, fp) == 1 &&
+	      !memcmp(magic, LOGPACK_MAGIC, sizeof(magic));
+	fclose(fp);
+
+	return ret;
+}
+
+static int bench(const char *in, int canfd, int runs)
+{
+	char binname[] = "/tmp/logconvXXXXXX", ngname[] = "/tmp/logconvXXXXXX";
+	char packname[] = "/tmp/logconvXXXXXX";
+	int fd, ret;
+
+	if (canlog_is_binary(in) == 1)
+		return bench_run("stdio", bench_bin, in, "binary", runs) ||
+		       bench_run("mmap", bench_mmap, in, "binary", runs);
+	if (is_packed(in) == 1)
+		return bench_run("mmap", bench_mmap, in, "packed", runs);
+	if (canpcap_detect(in) > 0)
+		return bench_run("stdio", bench_pcap, in, "pcap", runs);
+
+	/* compare against the same log converted to binary, packed and pcapng */
+	fd = mkstemp(binname);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+	fd = mkstemp(ngname);
+	if (fd < 0) {
+		perror("mkstemp");
+		unlink(binname);
+		return 1;
+	}
+	close(fd);
+	fd = mkstemp(packname);
+	if (fd < 0) {
+		perror("mkstemp");
+		unlink(binname);
+		unlink(ngname);
+		return 1;
+	}
+	close(fd);
+
+	ret = convert(in, binname, FMT_BIN, canfd) ||
+	      convert(in, ngname, FMT_PCAPNG, canfd) ||
+	      convert(in, packname, FMT_PACK, canfd);
+	if (!ret)
+		ret = bench_run("stdio", bench_text, in, "text", runs) ||
+		      bench_run("mmap", bench_mmap, in, "text", runs) ||
+		      bench_run("stdio", bench_bin, binname, "binary", runs) ||
+		      bench_run("mmap", bench_mmap, binname, "binary", runs) ||
+		      bench_run("mmap", bench_mmap, packname, "packed", runs) ||
+		      bench_run("stdio", bench_pcap, ngname, "pcapng", runs);
+	unlink(binname);
+	unlink(ngname);
+	unlink(packname);
+
+	return ret;
+}
+
+/*
+ * Cross-checks parse_canframe_len() against parse_canframe() on every
+ * frame of a text log, plus its DATA_SEPERATOR formatted variant, then
+ * times both parsers on the same strings.
+ */
+static int parse_check(const char *in, int runs)
+{
+	char line[CANLOG_LINESZ], frame[CL_CFSZ];
+	struct canfd_frame cf, cf2;
+	char **strs = NULL;
+	int *lens = NULL;
+	long n = 0, alloc = 0, i, bad = 0;
+	double start, t_old, t_new;
+	int r, sum = 0;
+	char *tok;
+	FILE *fp;
+
+	fp = fopen(in, "r");
+	if (!fp) {
+		perror(in);
+		return 1;
+	}
+	while (fgets(line, sizeof(line), fp)) {
+		/* third field of "(ts) ifname frame" */
+		if (!(tok = strchr(line, ' ')) || !(tok = strchr(tok + 1, ' ')))
+			continue;
+		tok[strcspn(tok, "\r\n")] = 0;
+		if (n + 2 > alloc) {
+			alloc = alloc ? alloc * 2 : 4096;
+			strs = realloc(strs, alloc * sizeof(*strs));
+			lens = realloc(lens, alloc * sizeof(*lens));
+			if (!strs || !lens) {
+				perror("realloc");
+				return 1;
+			}
+		}
+		strs[n++] = strdup(tok + 1);
+		if ((r = parse_canframe(tok + 1, &cf))) {
+			sprint_canframe(frame, &cf, 1,
+					r == CANFD_MTU ? CANFD_MAX_DLEN : CAN_MAX_DLEN);
+			strs[n++] = strdup(frame);
+		}
+	}
+	fclose(fp);
+
+	for (i = 0; i < n; i++) {
+		lens[i] = strlen(strs[i]);
+		r = parse_canframe(strs[i], &cf);
+		if (r != parse_canframe_len(strs[i], lens[i], &cf2) ||
+		    memcmp(&cf, &cf2, sizeof(cf))) {
+			if (bad++ < 10)
+				fprintf(stderr, "mismatch: '%s'\n", strs[i]);
+		}
+	}
+	printf("%ld frame strings, %ld mismatches\n", n, bad);
+
+	start = now();
+	for (r = 0; r < runs; r++)
+		for (i = 0; i < n; i++)
+			sum += parse_canframe(strs[i], &cf);
+	t_old = now() - start;
+
+	start = now();
+	for (r = 0; r < runs; r++)
+		for (i = 0; i < n; i++)
+			sum += parse_canframe_len(strs[i], lens[i], &cf);
+	t_new = now() - start;
+
+	if (n) {
+		printf("parse_canframe      %6.1f ns/frame\n", t_old * 1e9 / (n * runs));
+		printf("parse_canframe_len  %6.1f ns/frame (%.2fx)\n",
+		       t_new * 1e9 / (n * runs), t_old / t_new);
+	}
+
+	for (i = 0; i < n; i++)
+		free(strs[i]);
+	free(strs);
+	free(lens);
+
+	return bad != 0 || !sum;
+}
+
+int main(int argc, char **argv)
+{
+	int canfd = 0, benchmark = 0, check = 0, runs = DEFAULT_BENCH_RUNS;
+	int format = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "fo:BPn:h?")) != -1) {
+		switch (opt) {
+		case 'f':
+			canfd = 1;
+			break;
+		case 'o':
+			if (!strcmp(optarg, "text"))
+				format = FMT_TEXT;
+			else if (!strcmp(optarg, "bin"))
+				format = FMT_BIN;
+			else if (!strcmp(optarg, "pack"))
+				format = FMT_PACK;
+			else if (!strcmp(optarg, "col"))
+				format = FMT_COL;
+			else if (!strcmp(optarg, "pcap"))
+				format = FMT_PCAP;
+			else if (!strcmp(optarg, "pcapng"))
+				format = FMT_PCAPNG;
+			else
+				usage("Unknown output format");
+			break;
+		case 'B':
+			benchmark = 1;
+			break;
+		case 'P':
+			check = 1;
+			break;
+		case 'n':
+			runs = atoi(optarg);
+			if (runs < 1)
+				usage("benchmark runs must be at least 1");
+			break;
+		case 'h':
+		case '?':
+		default:
+			usage(NULL);
+			break;
+		}
+	}
+
+	if (optind >= argc)
+		usage("You must specify an input log");
+
+	if (benchmark)
+		return bench(argv[optind], canfd, runs);
+
+	if (check)
+		return parse_check(argv[optind], runs);
+
+	if (optind + 1 >= argc)
+		usage("You must specify an output log");
+
+	return convert(argv[optind], argv[optind + 1], format, canfd);
+}
@@ -0,0 +1,57 @@
+/*
+ * loghist.h - log-linear latency histogram
+ *
+ * Values (ns) below 32 have a bucket each, above that every power of two
+ * is split into LOGHIST_SUB buckets.  Percentiles are good to about 6 %
+ * over the whole __u64 range and adding a sample is a count leading zeros
+ * and a shift.  canreplay keeps its timing error in one, the gateway its
+ * forwarding latency and queueing delay.
+ */
+
+#ifndef LOGHIST_H
+#define LOGHIST_H
+
+#include <linux/types.h>
+
+#define LOGHIST_SUB	16
+#define LOGHIST_BUCKETS	(64 * LOGHIST_SUB)
+
+static inline int loghist_bucket(__u64 v)
+{
+	int msb;
+
+	if (v < 2 * LOGHIST_SUB)
+		return v;
+	msb = 63 - __builtin_clzll(v);
+	return (msb - 3) * LOGHIST_SUB + ((v >> (msb - 4)) & (LOGHIST_SUB - 1));
+}
+
+/* lowest value of a bucket */
+static inline __u64 loghist_value(int b)
+{
+	int msb = b / LOGHIST_SUB + 3;
+
+	if (b < 2 * LOGHIST_SUB)
+		return b;
+	return (__u64)(LOGHIST_SUB + b % LOGHIST_SUB) << (msb - 4);
+}
+
+/*
+ * Returns the pct percentile of the count samples in hist.
+ * Return values: the lower bound of the bucket, 0 = no samples
+ */
+static inline __u64 loghist_percentile(const __u64 *hist, __u64 count, double pct)
+{
+	__u64 seen = 0, want = (__u64)(count * pct / 100.0);
+	int b;
+
+	for (b = 0; b < LOGHIST_BUCKETS; b++) {
+		seen += hist[b];
+		if (seen > want)
+			return loghist_value(b);
+	}
+
+	return 0;
+}
+
+#endif
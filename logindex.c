@@ -0,0 +1,281 @@
+/*
+ * logindex.c - sparse time index for CAN logs
+ *
+ * See logindex.h for the sidecar layout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logreader.h"
+#include "logindex.h"
+
+void logstate_init(struct logstate *st)
+{
+	idtable_init(&st->tab, sizeof(struct logstate_ent), 0);
+}
+
+void logstate_free(struct logstate *st)
+{
+	idtable_free(&st->tab);
+}
+
+int logstate_update(struct logstate *st, const struct canlog_rec *rec,
+		    __u64 offset)
+{
+	struct logstate_ent *e;
+
+	e = idtable_get(&st->tab, idtable_key(rec->ifindex, rec->can_id));
+	if (!e)
+		return -1;
+	e->offset = offset;
+	memcpy(&e->u.rec, rec, sizeof(*rec) + rec->len);
+	e->u.rec.len = rec->len;
+
+	return 0;
+}
+
+static int cmp_ts(const void *a, const void *b)
+{
+	const struct canlog_rec *ra = *(const struct canlog_rec **)a;
+	const struct canlog_rec *rb = *(const struct canlog_rec **)b;
+
+	return (ra->ts_ns > rb->ts_ns) - (ra->ts_ns < rb->ts_ns);
+}
+
+const struct canlog_rec **logstate_list(struct logstate *st)
+{
+	const struct canlog_rec **list;
+	struct logstate_ent *e;
+	unsigned int i, n = 0;
+
+	list = malloc((st->tab.count + 1) * sizeof(*list));
+	if (!list)
+		return NULL;
+
+	for (i = 0; i < st->tab.size; i++) {
+		e = idtable_slot(&st->tab, i);
+		if (e->key)
+			list[n++] = &e->u.rec;
+	}
+	qsort(list, n, sizeof(*list), cmp_ts);
+
+	return list;
+}
+
+int logindex_build(struct logindex *idx, struct logreader *lr, int interval)
+{
+	const struct canlog_rec *rec;
+	struct logstate st;
+	__u64 frames = 0, n_alloc = 0, s_alloc = 0, off;
+	unsigned int i;
+	void *p;
+
+	memset(idx, 0, sizeof(*idx));
+	memcpy(idx->hdr.magic, LOGINDEX_MAGIC, sizeof(idx->hdr.magic));
+	idx->hdr.version = LOGINDEX_VERSION;
+	idx->hdr.interval = interval;
+	logstate_init(&st);
+
+	logreader_rewind(lr);
+	for (;;) {
+		off = logreader_tell(lr);
+		rec = logreader_next(lr);
+		if (!rec)
+			break;
+
+		if (frames++ % interval == 0) {
+			struct logindex_entry *e;
+			struct logstate_ent *s;
+
+			if (idx->hdr.n_entries == n_alloc) {
+				n_alloc = n_alloc ? n_alloc * 2 : 64;
+				p = realloc(idx->ent, n_alloc * sizeof(*idx->ent));
+				if (!p)
+					goto err;
+				idx->ent = p;
+			}
+			if (idx->hdr.n_snap + st.tab.count > s_alloc) {
+				s_alloc = (idx->hdr.n_snap + st.tab.count) * 2;
+				p = realloc(idx->snap, s_alloc * sizeof(*idx->snap));
+				if (!p)
+					goto err;
+				idx->snap = p;
+			}
+
+			e = &idx->ent[idx->hdr.n_entries++];
+			e->ts_ns = rec->ts_ns;
+			e->offset = off;
+			e->snap = idx->hdr.n_snap;
+			e->n_snap = st.tab.count;
+			for (i = 0; i < st.tab.size; i++) {
+				s = idtable_slot(&st.tab, i);
+				if (s->key)
+					idx->snap[idx->hdr.n_snap++] = s->offset;
+			}
+		}
+
+		if (logstate_update(&st, rec, off))
+			goto err;
+	}
+
+	logstate_free(&st);
+	return 0;
+
+err:
+	logstate_free(&st);
+	logindex_free(idx);
+	errno = ENOMEM;
+	return -1;
+}
+
+int logindex_save(struct logindex *idx, const char *path)
+{
+	FILE *fp = fopen(path, "wb");
+	int ret = 0;
+
+	if (!fp)
+		return -1;
+
+	if (fwrite(&idx->hdr, sizeof(idx->hdr), 1, fp) != 1 ||
+	    fwrite(idx->ent, sizeof(*idx->ent), idx->hdr.n_entries, fp) != idx->hdr.n_entries ||
+	    fwrite(idx->snap, sizeof(*idx->snap), idx->hdr.n_snap, fp) != idx->hdr.n_snap)
+		ret = -1;
+
+	if (fclose(fp))
+		ret = -1;
+
+	return ret;
+}
+
+int logindex_load(struct logindex *idx, const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+
+	memset(idx, 0, sizeof(*idx));
+	if (!fp)
+		return -1;
+
+	if (fread(&idx->hdr, sizeof(idx->hdr), 1, fp) != 1 ||
+	    memcmp(idx->hdr.magic, LOGINDEX_MAGIC, sizeof(idx->hdr.magic)) ||
+	    idx->hdr.version != LOGINDEX_VERSION)
+		goto inval;
+
+	idx->ent = malloc((idx->hdr.n_entries + 1) * sizeof(*idx->ent));
+	idx->snap = malloc((idx->hdr.n_snap + 1) * sizeof(*idx->snap));
+	if (!idx->ent || !idx->snap) {
+		fclose(fp);
+		logindex_free(idx);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (fread(idx->ent, sizeof(*idx->ent), idx->hdr.n_entries, fp) != idx->hdr.n_entries ||
+	    fread(idx->snap, sizeof(*idx->snap), idx->hdr.n_snap, fp) != idx->hdr.n_snap)
+		goto inval;
+
+	fclose(fp);
+	return 0;
+
+inval:
+	fclose(fp);
+	logindex_free(idx);
+	errno = EINVAL;
+	return -1;
+}
+
+void logindex_free(struct logindex *idx)
+{
+	free(idx->ent);
+	free(idx->snap);
+	idx->ent = NULL;
+	idx->snap = NULL;
+	idx->hdr.n_entries = 0;
+	idx->hdr.n_snap = 0;
+}
+
+int logindex_open(struct logindex *idx, struct logreader *lr,
+		  const char *logpath, int save)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	if (stat(logpath, &st))
+		return -1;
+	snprintf(path, sizeof(path), "%s.idx", logpath);
+
+	if (!logindex_load(idx, path)) {
+		if (idx->hdr.log_size == (__u64)st.st_size &&
+		    idx->hdr.log_mtime == (__u64)st.st_mtime)
+			return 0;
+		logindex_free(idx);
+	}
+
+	if (logindex_build(idx, lr, LOGINDEX_INTERVAL))
+		return -1;
+	idx->hdr.log_size = st.st_size;
+	idx->hdr.log_mtime = st.st_mtime;
+
+	if (save && logindex_save(idx, path))
+		perror(path); /* the index in memory is still usable */
+
+	return 1;
+}
+
+int logindex_seek(struct logindex *idx, struct logreader *lr, __u64 ts_ns,
+		  struct logstate *state)
+{
+	const struct canlog_rec *rec;
+	struct logindex_entry *e = NULL;
+	__u64 lo = 0, hi = idx->hdr.n_entries, mid, i, off;
+
+	/* last entry before ts_ns, frames at ts_ns may come before an entry at it */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (idx->ent[mid].ts_ns < ts_ns)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo)
+		e = &idx->ent[lo - 1];
+
+	if (e && state) {
+		for (i = 0; i < e->n_snap; i++) {
+			off = idx->snap[e->snap + i];
+			if (logreader_seek(lr, off) || !(rec = logreader_next(lr)) ||
+			    logstate_update(state, rec, off))
+				return -1;
+		}
+	}
+
+	if (e) {
+		if (logreader_seek(lr, e->offset))
+			return -1;
+	} else {
+		logreader_rewind(lr);
+	}
+
+	for (;;) {
+		off = logreader_tell(lr);
+		rec = logreader_next(lr);
+		if (!rec)
+			break;
+		if (rec->ts_ns >= ts_ns) {
+			logreader_seek(lr, off);
+			break;
+		}
+		if (state && logstate_update(state, rec, off))
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * logindex.h - sparse time index for CAN logs
+ *
+ * An index maps a timestamp to the file offset of every interval-th frame
+ * of a text or binary log, so replay can jump to any point of a long
+ * capture without reading it from the start.  Each entry also carries a
+ * snapshot: the offsets of the latest frame of every (interface, CAN ID)
+ * seen before it.  Together with the frames between the entry and the
+ * seek point this gives the exact last-known payload of every ID, so a
+ * replayed cluster shows the right state immediately.
+ *
+ * The index is kept in a sidecar file next to the log (<log>.idx):
+ *
+ *	struct logindex_header
+ *	struct logindex_entry[n_entries]
+ *	__u64 snapshot offsets[n_snap]
+ *
+ * Logs are expected to be in timestamp order.
+ */
+
+#ifndef LOGINDEX_H
+#define LOGINDEX_H
+
+#include <stddef.h>
+#include <linux/types.h>
+
+#include "canlog.h"
+#include "logreader.h"
+#include "idtable.h"
+
+#define LOGINDEX_MAGIC		"ICSIMIDX"
+#define LOGINDEX_VERSION	1
+#define LOGINDEX_INTERVAL	1024	/* frames between entries */
+
+struct logindex_header {
+	char magic[8];		/* LOGINDEX_MAGIC, not terminated */
+	__u32 version;		/* LOGINDEX_VERSION */
+	__u32 interval;
+	__u64 log_size;		/* size and mtime of the indexed log, */
+	__u64 log_mtime;	/* a mismatch means the index is stale */
+	__u64 n_entries;
+	__u64 n_snap;
+};
+
+struct logindex_entry {
+	__u64 ts_ns;		/* timestamp of the frame at offset */
+	__u64 offset;		/* logreader_tell() before that frame */
+	__u64 snap;		/* first snapshot offset of this entry */
+	__u64 n_snap;		/* number of snapshot offsets */
+};
+
+struct logindex {
+	struct logindex_header hdr;
+	struct logindex_entry *ent;
+	__u64 *snap;
+};
+
+/* last frame per (interface, CAN ID) */
+struct logstate_ent {
+	__u64 key;		/* 0 = free slot */
+	__u64 offset;		/* where the frame is in the log */
+	union {
+		struct canlog_rec rec;
+		__u8 buf[CANLOG_REC_CANFD];
+	} u;
+};
+
+struct logstate {
+	struct idtable tab;	/* of struct logstate_ent */
+};
+
+int logindex_open(struct logindex *idx, struct logreader *lr,
+		  const char *logpath, int save);
+/*
+ * Loads <logpath>.idx when it exists and matches the log, otherwise builds
+ * the index with LOGINDEX_INTERVAL and, with save != 0, writes the
+ * sidecar.  The reader is left at an undefined position.
+ *
+ * Return values: 0 = loaded, 1 = built, -1 = error (errno set)
+ */
+
+int logindex_build(struct logindex *idx, struct logreader *lr, int interval);
+int logindex_save(struct logindex *idx, const char *path);
+int logindex_load(struct logindex *idx, const char *path);
+void logindex_free(struct logindex *idx);
+
+int logindex_seek(struct logindex *idx, struct logreader *lr, __u64 ts_ns,
+		  struct logstate *state);
+/*
+ * Positions lr at the first frame with a timestamp >= ts_ns.  When state
+ * is given it receives the last frame of every (interface, CAN ID) before
+ * that point.  Returns 0, or -1 when the log could not be read.
+ */
+
+void logstate_init(struct logstate *st);
+void logstate_free(struct logstate *st);
+int logstate_update(struct logstate *st, const struct canlog_rec *rec,
+		    __u64 offset);
+
+const struct canlog_rec **logstate_list(struct logstate *st);
+/*
+ * Returns a malloc()ed array of the st->tab.count stored frames in timestamp
+ * order, or NULL.  The frames stay owned by st.
+ */
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * logmerge.c - time ordered merge of several CAN logs
+ *
+ * See logmerge.h for the interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logreader.h"
+#include "logmerge.h"
+
+void logmerge_init(struct logmerge *m)
+{
+	memset(m, 0, sizeof(*m));
+	m->last = -1;
+}
+
+int logmerge_add(struct logmerge *m, const char *path)
+{
+	struct logmerge_src *s, **src;
+	int *heap;
+
+	if (m->started) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	/* readers point into themselves, so every source has its own block */
+	s = malloc(sizeof(*s));
+	src = realloc(m->src, (m->n + 1) * sizeof(*src));
+	if (src)
+		m->src = src;
+	heap = src ? realloc(m->heap, (m->n + 1) * sizeof(*heap)) : NULL;
+	if (heap)
+		m->heap = heap;
+	if (!s || !heap) {
+		free(s);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (logreader_open(&s->lr, path)) {
+		free(s);
+		return -1;
+	}
+	memset(s->ifmap, -1, sizeof(s->ifmap));
+	s->rec = NULL;
+	m->src[m->n++] = s;
+
+	return 0;
+}
+
+struct logreader *logmerge_reader(struct logmerge *m, int src)
+{
+	return &m->src[src]->lr;
+}
+
+/* true when source a comes before source b */
+static inline int before(struct logmerge *m, int a, int b)
+{
+	__u64 ta = m->src[a]->rec->ts_ns, tb = m->src[b]->rec->ts_ns;
+
+	return ta < tb || (ta == tb && a < b);
+}
+
+static void sift_down(struct logmerge *m, int i)
+{
+	int c, tmp;
+
+	for (;;) {
+		c = 2 * i + 1;
+		if (c >= m->heap_len)
+			break;
+		if (c + 1 < m->heap_len && before(m, m->heap[c + 1], m->heap[c]))
+			c++;
+		if (!before(m, m->heap[c], m->heap[i]))
+			break;
+		tmp = m->heap[i];
+		m->heap[i] = m->heap[c];
+		m->heap[c] = tmp;
+		i = c;
+	}
+}
+
+int logmerge_ifindex(struct logmerge *m, int src, int ifindex)
+{
+	struct logmerge_src *s = m->src[src];
+
+	if (ifindex >= CANLOG_MAX_IFACES)
+		return -1;
+	if (s->ifmap[ifindex] < 0)
+		s->ifmap[ifindex] = canlog_ifindex(&m->hdr, logreader_ifname(&s->lr, ifindex));
+
+	return s->ifmap[ifindex];
+}
+
+const struct canlog_rec *logmerge_next(struct logmerge *m)
+{
+	struct logmerge_src *s;
+	int i, idx;
+
+	if (!m->started) {
+		m->started = 1;
+		for (i = 0; i < m->n; i++) {
+			m->src[i]->rec = logreader_next(&m->src[i]->lr);
+			if (m->src[i]->rec)
+				m->heap[m->heap_len++] = i;
+		}
+		for (i = m->heap_len / 2 - 1; i >= 0; i--)
+			sift_down(m, i);
+	} else if (m->last >= 0) {
+		/* advance the input the previous frame came from */
+		s = m->src[m->last];
+		s->rec = logreader_next(&s->lr);
+		if (!s->rec)
+			m->heap[0] = m->heap[--m->heap_len];
+		sift_down(m, 0);
+	}
+
+	m->last = -1;
+	while (m->heap_len) {
+		m->last = m->heap[0];
+		s = m->src[m->last];
+
+		idx = logmerge_ifindex(m, m->last, s->rec->ifindex);
+		if (idx >= 0) {
+			memcpy(&m->cur.rec, s->rec, sizeof(*s->rec) + s->rec->len);
+			m->cur.rec.ifindex = idx;
+			return &m->cur.rec;
+		}
+
+		/* more interfaces than a log can name, drop the frame */
+		s->rec = logreader_next(&s->lr);
+		if (!s->rec)
+			m->heap[0] = m->heap[--m->heap_len];
+		sift_down(m, 0);
+		m->last = -1;
+	}
+
+	return NULL;
+}
+
+const char *logmerge_ifname(struct logmerge *m, int ifindex)
+{
+	if (ifindex < 0 || ifindex >= m->hdr.n_ifaces)
+		return "?";
+
+	return m->hdr.ifname[ifindex];
+}
+
+unsigned long logmerge_bad_lines(struct logmerge *m)
+{
+	unsigned long n = 0;
+	int i;
+
+	for (i = 0; i < m->n; i++)
+		n += m->src[i]->lr.bad_lines;
+
+	return n;
+}
+
+void logmerge_close(struct logmerge *m)
+{
+	int i;
+
+	for (i = 0; i < m->n; i++) {
+		logreader_close(&m->src[i]->lr);
+		free(m->src[i]);
+	}
+	free(m->src);
+	free(m->heap);
+	logmerge_init(m);
+}
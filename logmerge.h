@@ -0,0 +1,83 @@
+/*
+ * logmerge.h - time ordered merge of several CAN logs
+ *
+ * Combines any number of candump text and binary logs (see logreader.h),
+ * e.g. one capture per interface, into a single stream in timestamp order.
+ * A binary min-heap holds the next frame of every input, so each frame
+ * costs O(log k) and memory does not depend on the size of the inputs:
+ * the logs are mapped and only one frame per input is held at a time.
+ *
+ * Interface names are kept, the records handed out carry indexes into a
+ * merged interface table.
+ *
+ *	struct logmerge m;
+ *
+ *	logmerge_init(&m);
+ *	if (logmerge_add(&m, "vcan0.log") || logmerge_add(&m, "vcan1.log"))
+ *		...
+ *	while ((rec = logmerge_next(&m)))
+ *		...
+ *	logmerge_close(&m);
+ */
+
+#ifndef LOGMERGE_H
+#define LOGMERGE_H
+
+#include <linux/types.h>
+
+#include "canlog.h"
+#include "logreader.h"
+
+struct logmerge_src {
+	struct logreader lr;
+	const struct canlog_rec *rec;	/* next frame, NULL when done */
+	int ifmap[CANLOG_MAX_IFACES];	/* reader ifindex -> merged, -1 unknown */
+};
+
+struct logmerge {
+	struct logmerge_src **src;
+	int n;
+	int *heap;		/* source numbers, earliest frame first */
+	int heap_len;
+	int started;
+	int last;		/* source of the frame returned last */
+
+	struct canlog_header hdr;	/* merged interface table */
+	union {
+		struct canlog_rec rec;
+		__u8 buf[CANLOG_REC_CANFD];
+	} cur;
+};
+
+void logmerge_init(struct logmerge *m);
+
+int logmerge_add(struct logmerge *m, const char *path);
+/*
+ * Opens another input.  Inputs can only be added before the first call
+ * to logmerge_next().  Return values: 0 = success, -1 = error (errno set)
+ */
+
+struct logreader *logmerge_reader(struct logmerge *m, int src);
+/*
+ * Returns the reader of an input, e.g. to seek it before the merge starts.
+ */
+
+const struct canlog_rec *logmerge_next(struct logmerge *m);
+/*
+ * Returns the earliest pending frame of all inputs, frames with the same
+ * timestamp in the order the inputs were added.  NULL at the end.
+ */
+
+int logmerge_ifindex(struct logmerge *m, int src, int ifindex);
+/*
+ * Maps an interface index of an input's reader to the merged table.
+ * Returns -1 when the merged table is full.
+ */
+
+const char *logmerge_ifname(struct logmerge *m, int ifindex);
+
+unsigned long logmerge_bad_lines(struct logmerge *m);
+
+void logmerge_close(struct logmerge *m);
+
+#endif
@@ -0,0 +1,417 @@
+/*
+ * logpack.c - block compressed CAN logs
+ *
+ * See logpack.h for the encoding and the file layout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logpack.h"
+
+#define STDIO_BUFSZ	(1 << 20)
+#define PAYLOAD_SAME	0xFF	/* payload control byte: repeat the last one */
+#define NO_PAYLOAD	0xFF	/* logpack_id.len before the first payload */
+
+static inline __u8 *put_uvar(__u8 *p, __u64 v)
+{
+	while (v >= 0x80) {
+		*p++ = v | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+
+	return p;
+}
+
+static inline int get_uvar(const __u8 **pp, const __u8 *end, __u64 *v)
+{
+	const __u8 *p = *pp;
+	int shift = 0;
+
+	*v = 0;
+	do {
+		if (p == end || shift > 63)
+			return -1;
+		*v |= (__u64)(*p & 0x7F) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+	*pp = p;
+
+	return 0;
+}
+
+static inline __u64 zigzag(__s64 v)
+{
+	return ((__u64)v << 1) ^ (__u64)(v >> 63);
+}
+
+static inline __s64 unzigzag(__u64 v)
+{
+	return (__s64)(v >> 1) ^ -(__s64)(v & 1);
+}
+
+static inline unsigned int id_hash(const struct canlog_rec *rec)
+{
+	__u32 h = rec->can_id ^ (__u32)rec->ifindex << 24 ^ (__u32)rec->flags << 16;
+
+	return (h * 0x9E3779B1u) >> 16;
+}
+
+/* index of the frame's ID in the block dictionary, -1 when full */
+static int lookup(struct logpack *pk, const struct canlog_rec *rec, int *is_new)
+{
+	unsigned int i = id_hash(rec) & (2 * LOGPACK_BLOCK_IDS - 1);
+	struct logpack_id *id;
+
+	*is_new = 0;
+	while (pk->slot[i]) {
+		id = &pk->ids[pk->slot[i] - 1];
+		if (id->can_id == rec->can_id && id->ifindex == rec->ifindex &&
+		    id->flags == rec->flags)
+			return pk->slot[i] - 1;
+		i = (i + 1) & (2 * LOGPACK_BLOCK_IDS - 1);
+	}
+
+	if (pk->n_ids == LOGPACK_BLOCK_IDS)
+		return -1;
+
+	id = &pk->ids[pk->n_ids];
+	id->can_id = rec->can_id;
+	id->ifindex = rec->ifindex;
+	id->flags = rec->flags;
+	id->len = NO_PAYLOAD;
+	id->last_delta = 0;
+	pk->slot[i] = ++pk->n_ids;
+	*is_new = 1;
+
+	return pk->n_ids - 1;
+}
+
+static void reset_ids(struct logpack *pk)
+{
+	memset(pk->slot, 0, sizeof(pk->slot));
+	pk->n_ids = 0;
+}
+
+static __u8 *encode(struct logpack *pk, __u8 *p, const struct canlog_rec *rec,
+		    __u64 *prev_ts, __u32 unit)
+{
+	struct logpack_id *id;
+	__u8 *mask;
+	__u64 pred;
+	int i, n, is_new;
+
+	n = lookup(pk, rec, &is_new);
+	id = &pk->ids[n];
+	p = put_uvar(p, n);
+	if (is_new) {
+		p = put_uvar(p, rec->can_id);
+		*p++ = rec->ifindex;
+		*p++ = rec->flags;
+		pred = *prev_ts;
+	} else {
+		pred = id->last_ts + id->last_delta;
+	}
+
+	p = put_uvar(p, zigzag((__s64)(rec->ts_ns - pred) / (__s64)unit));
+	if (!is_new)
+		id->last_delta = rec->ts_ns - id->last_ts;
+	id->last_ts = rec->ts_ns;
+	*prev_ts = rec->ts_ns;
+
+	if (id->len == rec->len && !memcmp(id->data, rec->data, rec->len)) {
+		*p++ = PAYLOAD_SAME;
+		return p;
+	}
+
+	*p++ = rec->len;
+	if (id->len == rec->len) {
+		/* bitmap of the changed bytes, then those bytes */
+		mask = p;
+		memset(mask, 0, (rec->len + 7) / 8);
+		p += (rec->len + 7) / 8;
+		for (i = 0; i < rec->len; i++) {
+			if (id->data[i] != rec->data[i]) {
+				mask[i / 8] |= 1 << (i % 8);
+				*p++ = rec->data[i];
+			}
+		}
+	} else {
+		memcpy(p, rec->data, rec->len);
+		p += rec->len;
+	}
+	id->len = rec->len;
+	memcpy(id->data, rec->data, rec->len);
+
+	return p;
+}
+
+static int flush_block(struct logpack *pk)
+{
+	struct logpack_block *blk = (struct logpack_block *)pk->enc;
+	const struct canlog_rec *rec;
+	struct logpack_entry *e;
+	__u8 *p = pk->enc + sizeof(*blk);
+	__u64 prev_ts;
+	__u32 unit = 1000;
+	unsigned int i;
+	void *tmp;
+
+	if (!pk->n_raw)
+		return 0;
+
+	/* candump logs only have microseconds */
+	for (i = 0; i < pk->n_raw && unit > 1; i++)
+		if (((struct canlog_rec *)(pk->raw + i * CANLOG_REC_CANFD))->ts_ns % 1000)
+			unit = 1;
+
+	rec = (struct canlog_rec *)pk->raw;
+	prev_ts = rec->ts_ns;
+	reset_ids(pk);
+	for (i = 0; i < pk->n_raw; i++) {
+		rec = (struct canlog_rec *)(pk->raw + i * CANLOG_REC_CANFD);
+		p = encode(pk, p, rec, &prev_ts, unit);
+	}
+	reset_ids(pk);
+
+	memset(blk, 0, sizeof(*blk));
+	blk->size = p - pk->enc - sizeof(*blk);
+	blk->n_frames = pk->n_raw;
+	blk->first_ts = ((struct canlog_rec *)pk->raw)->ts_ns;
+	blk->ts_unit = unit;
+
+	if (fwrite(pk->enc, p - pk->enc, 1, pk->fp) != 1)
+		return -1;
+
+	if (pk->hdr.n_blocks == pk->index_alloc) {
+		pk->index_alloc = pk->index_alloc ? 2 * pk->index_alloc : 256;
+		tmp = realloc(pk->index, pk->index_alloc * sizeof(*pk->index));
+		if (!tmp)
+			return -1;
+		pk->index = tmp;
+	}
+	e = &pk->index[pk->hdr.n_blocks++];
+	e->offset = pk->offset;
+	e->first_ts = blk->first_ts;
+	e->last_ts = prev_ts;
+	e->n_frames = blk->n_frames;
+	e->size = p - pk->enc;
+
+	pk->offset += p - pk->enc;
+	pk->n_raw = 0;
+
+	return 0;
+}
+
+int logpack_create(struct logpack *pk, const char *path)
+{
+	memset(pk, 0, sizeof(*pk));
+	memcpy(pk->hdr.magic, LOGPACK_MAGIC, sizeof(pk->hdr.magic));
+	pk->hdr.version = LOGPACK_VERSION;
+	pk->hdr.block_frames = LOGPACK_BLOCK_FRAMES;
+
+	pk->raw = malloc(LOGPACK_BLOCK_FRAMES * CANLOG_REC_CANFD);
+	pk->enc = malloc(sizeof(struct logpack_block) +
+			 LOGPACK_BLOCK_FRAMES * LOGPACK_FRAME_MAX);
+	if (!pk->raw || !pk->enc)
+		goto err;
+
+	pk->fp = fopen(path, "wb");
+	if (!pk->fp)
+		goto err;
+	setvbuf(pk->fp, NULL, _IOFBF, STDIO_BUFSZ);
+
+	/* placeholder, rewritten by logpack_close() */
+	if (fwrite(&pk->hdr, sizeof(pk->hdr), 1, pk->fp) != 1) {
+		fclose(pk->fp);
+		goto err;
+	}
+	pk->offset = sizeof(pk->hdr);
+
+	return 0;
+
+err:
+	free(pk->raw);
+	free(pk->enc);
+	return -1;
+}
+
+static int pack_ifindex(struct logpack_header *hdr, const char *ifname)
+{
+	int i;
+
+	for (i = 0; i < hdr->n_ifaces; i++)
+		if (!strncmp(hdr->ifname[i], ifname, IFNAMSIZ))
+			return i;
+
+	if (hdr->n_ifaces == CANLOG_MAX_IFACES)
+		return -1;
+
+	strncpy(hdr->ifname[i], ifname, IFNAMSIZ - 1);
+	return hdr->n_ifaces++;
+}
+
+int logpack_write(struct logpack *pk, const struct canlog_rec *rec,
+		  const char *ifname)
+{
+	struct canlog_rec *raw;
+	int idx, is_new;
+
+	idx = pack_ifindex(&pk->hdr, ifname);
+	if (idx < 0) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	raw = (struct canlog_rec *)(pk->raw + pk->n_raw * CANLOG_REC_CANFD);
+	memcpy(raw, rec, sizeof(*rec));
+	raw->ifindex = idx;
+	raw->len = rec->len > CANFD_MAX_DLEN ? CANFD_MAX_DLEN : rec->len;
+	raw->__res = 0;
+	memcpy(raw->data, rec->data, raw->len);
+
+	/* only counts the IDs here, encoding happens per block */
+	if (lookup(pk, raw, &is_new) < 0) {
+		if (flush_block(pk))
+			return -1;
+		raw = memcpy(pk->raw, raw, CANLOG_REC_CANFD);
+		lookup(pk, raw, &is_new);
+	}
+
+	pk->hdr.n_frames++;
+	if (++pk->n_raw == LOGPACK_BLOCK_FRAMES) {
+		reset_ids(pk);
+		return flush_block(pk);
+	}
+
+	return 0;
+}
+
+int logpack_close(struct logpack *pk)
+{
+	int ret = 0;
+
+	if (flush_block(pk))
+		ret = -1;
+
+	pk->hdr.index_off = pk->offset;
+	if (pk->hdr.n_blocks &&
+	    fwrite(pk->index, sizeof(*pk->index), pk->hdr.n_blocks, pk->fp) != pk->hdr.n_blocks)
+		ret = -1;
+
+	if (fseek(pk->fp, 0, SEEK_SET) ||
+	    fwrite(&pk->hdr, sizeof(pk->hdr), 1, pk->fp) != 1)
+		ret = -1;
+	if (fclose(pk->fp))
+		ret = -1;
+
+	free(pk->raw);
+	free(pk->enc);
+	free(pk->index);
+
+	return ret;
+}
+
+int logpack_dec_start(struct logpack_dec *dec, const void *blk, size_t avail)
+{
+	const struct logpack_block *b = blk;
+
+	if (avail < sizeof(*b) || b->size > avail - sizeof(*b) ||
+	    (b->ts_unit != 1 && b->ts_unit != 1000))
+		return -1;
+
+	dec->p = (const __u8 *)blk + sizeof(*b);
+	dec->end = dec->p + b->size;
+	dec->frame = 0;
+	dec->n_frames = b->n_frames;
+	dec->ts_unit = b->ts_unit;
+	dec->prev_ts = b->first_ts;
+	dec->n_ids = 0;
+
+	return 0;
+}
+
+int logpack_dec_next(struct logpack_dec *dec, struct canlog_rec *rec)
+{
+	struct logpack_id *id;
+	const __u8 *mask;
+	__u64 n, v, pred;
+	int i, len, is_new;
+
+	if (dec->frame == dec->n_frames)
+		return 0;
+
+	if (get_uvar(&dec->p, dec->end, &n) || n > dec->n_ids)
+		return -1;
+
+	is_new = n == dec->n_ids;
+	if (is_new) {
+		if (n == LOGPACK_BLOCK_IDS || get_uvar(&dec->p, dec->end, &v) ||
+		    dec->end - dec->p < 2)
+			return -1;
+		id = &dec->ids[dec->n_ids++];
+		id->can_id = v;
+		id->ifindex = *dec->p++;
+		id->flags = *dec->p++;
+		id->len = NO_PAYLOAD;
+		id->last_delta = 0;
+		pred = dec->prev_ts;
+	} else {
+		id = &dec->ids[n];
+		pred = id->last_ts + id->last_delta;
+	}
+
+	if (get_uvar(&dec->p, dec->end, &v))
+		return -1;
+	rec->ts_ns = pred + unzigzag(v) * (__s64)dec->ts_unit;
+	if (!is_new)
+		id->last_delta = rec->ts_ns - id->last_ts;
+	id->last_ts = rec->ts_ns;
+	dec->prev_ts = rec->ts_ns;
+
+	if (dec->p == dec->end)
+		return -1;
+	len = *dec->p++;
+	if (len == PAYLOAD_SAME) {
+		if (id->len == NO_PAYLOAD)
+			return -1;
+	} else if (len > CANFD_MAX_DLEN) {
+		return -1;
+	} else if (id->len == len) {
+		mask = dec->p;
+		if (dec->end - dec->p < (len + 7) / 8)
+			return -1;
+		dec->p += (len + 7) / 8;
+		for (i = 0; i < len; i++) {
+			if (!(mask[i / 8] & (1 << (i % 8))))
+				continue;
+			if (dec->p == dec->end)
+				return -1;
+			id->data[i] = *dec->p++;
+		}
+	} else {
+		if (dec->end - dec->p < len)
+			return -1;
+		memcpy(id->data, dec->p, len);
+		dec->p += len;
+		id->len = len;
+	}
+
+	rec->can_id = id->can_id;
+	rec->ifindex = id->ifindex;
+	rec->flags = id->flags;
+	rec->len = id->len;
+	rec->__res = 0;
+	memcpy(rec->data, id->data, id->len);
+	memset(rec->data + id->len, 0, CANFD_MAX_DLEN - id->len);
+	dec->frame++;
+
+	return 1;
+}
@@ -0,0 +1,148 @@
+/*
+ * logpack.h - block compressed CAN logs
+ *
+ * Captures of cluster traffic are mostly periodic frames with payloads
+ * that rarely change.  A packed log groups frames into blocks of up to
+ * LOGPACK_BLOCK_FRAMES and encodes every block on its own:
+ *
+ *  - CAN IDs become small dictionary indexes, the ID itself is only
+ *    stored at its first use in the block
+ *  - timestamps are stored as the difference to the prediction "last
+ *    timestamp of this ID plus its last period", in microseconds when the
+ *    whole block allows it, as zigzag varints
+ *  - a payload equal to the ID's previous one costs a single byte, other
+ *    payloads of the same length store a bitmap of the changed bytes and
+ *    only those bytes
+ *
+ * File layout:
+ *
+ *	struct logpack_header
+ *	struct logpack_block + encoded frames	(n_blocks times)
+ *	struct logpack_entry[n_blocks]		(at index_off)
+ *
+ * Every block can be decoded without the ones before it, so the index
+ * gives random access to any point of the log.  Readers use logreader.h,
+ * which handles packed logs like any other format.  All fields are in
+ * host byte order.
+ */
+
+#ifndef LOGPACK_H
+#define LOGPACK_H
+
+#include <stdio.h>
+#include <linux/types.h>
+#include <linux/can.h>
+#include <net/if.h>
+
+#include "canlog.h"
+
+#define LOGPACK_MAGIC		"ICSIMPAK"
+#define LOGPACK_VERSION		1
+#define LOGPACK_BLOCK_FRAMES	4096	/* frames per block */
+#define LOGPACK_BLOCK_IDS	256	/* IDs per block, a block ends early beyond */
+
+/* largest encoding of one frame: index, new ID, timestamp, payload */
+#define LOGPACK_FRAME_MAX	(5 + 5 + 2 + 10 + 1 + CANFD_MAX_DLEN / 8 + CANFD_MAX_DLEN)
+
+struct logpack_header {
+	char magic[8];		/* LOGPACK_MAGIC, not terminated */
+	__u16 version;		/* LOGPACK_VERSION */
+	__u16 block_frames;
+	__u16 n_ifaces;
+	__u16 __res0;
+	__u64 n_frames;
+	__u64 n_blocks;
+	__u64 index_off;	/* 0 while the log is being written */
+	__u64 reserved[3];	/* zero */
+	char ifname[CANLOG_MAX_IFACES][IFNAMSIZ];
+};
+
+struct logpack_block {
+	__u32 size;		/* bytes of encoded frames following */
+	__u32 n_frames;
+	__u64 first_ts;		/* ns, timestamp of the first frame */
+	__u32 ts_unit;		/* ns per timestamp tick, 1 or 1000 */
+	__u32 __res;
+};
+
+struct logpack_entry {
+	__u64 offset;		/* of the struct logpack_block */
+	__u64 first_ts;
+	__u64 last_ts;
+	__u32 n_frames;
+	__u32 size;		/* of the block including its header */
+};
+
+/* per ID state, the same on both sides */
+struct logpack_id {
+	__u64 last_ts;
+	__s64 last_delta;
+	canid_t can_id;
+	__u8 ifindex;
+	__u8 flags;
+	__u8 len;
+	__u8 __res;
+	__u8 data[CANFD_MAX_DLEN];
+};
+
+struct logpack_dec {
+	const __u8 *p, *end;	/* encoded frames left */
+	__u32 frame, n_frames;
+	__u32 ts_unit;
+	__u64 prev_ts;
+	unsigned int n_ids;
+	struct logpack_id ids[LOGPACK_BLOCK_IDS];
+};
+
+struct logpack {
+	FILE *fp;
+	struct logpack_header hdr;
+	__u64 offset;			/* where the next block goes */
+
+	__u8 *raw;			/* frames of the current block */
+	unsigned int n_raw;
+	__u16 slot[2 * LOGPACK_BLOCK_IDS]; /* ID hash, index + 1, 0 = free */
+	unsigned int n_ids;
+	struct logpack_id ids[LOGPACK_BLOCK_IDS];
+	__u8 *enc;
+
+	struct logpack_entry *index;
+	__u64 index_alloc;
+};
+
+int logpack_create(struct logpack *pk, const char *path);
+/*
+ * Return values: 0 = success, -1 = error (errno set)
+ */
+
+int logpack_write(struct logpack *pk, const struct canlog_rec *rec,
+		  const char *ifname);
+/*
+ * Appends a frame received on ifname.  Frames should be in timestamp
+ * order, anything else still works but packs worse.
+ *
+ * Return values: 0 = success, -1 = error (errno set, ENOSPC when there
+ * are more than CANLOG_MAX_IFACES interfaces)
+ */
+
+int logpack_close(struct logpack *pk);
+/*
+ * Writes the last block and the index.  Return values: 0 = success,
+ * -1 = error
+ */
+
+int logpack_dec_start(struct logpack_dec *dec, const void *blk, size_t avail);
+/*
+ * Prepares decoding the block at blk, of which avail bytes are readable.
+ * Return values: 0 = success, -1 = the block does not fit
+ */
+
+int logpack_dec_next(struct logpack_dec *dec, struct canlog_rec *rec);
+/*
+ * Decodes the next frame of the block into rec, which must have room for
+ * CANLOG_REC_CANFD bytes.
+ *
+ * Return values: 1 = frame decoded, 0 = end of block, -1 = corrupt block
+ */
+
+#endif
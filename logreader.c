@@ -0,0 +1,332 @@
+/*
+ * logreader.c - memory-mapped CAN log reader
+ *
+ * See logreader.h for the interface.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "logpack.h"
+#include "logreader.h"
+
+static int check_header(struct logreader *lr)
+{
+	const struct canlog_header *hdr = (const struct canlog_header *)lr->map;
+	__u64 n;
+
+	if (lr->size < sizeof(*hdr) ||
+	    hdr->version != CANLOG_VERSION ||
+	    (hdr->rec_size != CANLOG_REC_CAN &&
+	     hdr->rec_size != CANLOG_REC_CANFD) ||
+	    hdr->n_ifaces > CANLOG_MAX_IFACES)
+		return -1;
+
+	/* a log that was not closed cleanly still has n_recs == 0 */
+	n = (lr->size - sizeof(*hdr)) / hdr->rec_size;
+	if (hdr->n_recs && hdr->n_recs < n)
+		n = hdr->n_recs;
+
+	lr->hdr = hdr;
+	lr->data = sizeof(*hdr);
+	lr->n_recs = n;
+	lr->end = lr->data + n * hdr->rec_size;
+
+	return 0;
+}
+
+static int check_pack(struct logreader *lr)
+{
+	const struct logpack_header *hdr = (const struct logpack_header *)lr->map;
+	const struct logpack_entry *index;
+	__u64 b, off;
+	int i;
+
+	if (lr->size < sizeof(*hdr) ||
+	    hdr->version != LOGPACK_VERSION ||
+	    hdr->n_ifaces > CANLOG_MAX_IFACES)
+		return -1;
+
+	/* an unfinished log has no index yet and can not be read */
+	if (hdr->index_off < sizeof(*hdr) || hdr->index_off > lr->size ||
+	    hdr->n_blocks > (lr->size - hdr->index_off) / sizeof(struct logpack_entry))
+		return -1;
+
+	/* blocks must follow each other, next_packed() relies on it */
+	index = (const struct logpack_entry *)(lr->map + hdr->index_off);
+	for (b = 0, off = sizeof(*hdr); b < hdr->n_blocks; b++) {
+		if (index[b].offset != off ||
+		    index[b].size < sizeof(struct logpack_block) ||
+		    index[b].size > hdr->index_off - off)
+			return -1;
+		off += index[b].size;
+	}
+
+	lr->text_hdr.n_ifaces = hdr->n_ifaces;
+	for (i = 0; i < hdr->n_ifaces; i++)
+		memcpy(lr->text_hdr.ifname[i], hdr->ifname[i], IFNAMSIZ);
+
+	lr->pk_index = index;
+	lr->pk_blocks = hdr->n_blocks;
+	lr->pk_block = hdr->n_blocks;
+	lr->data = sizeof(*hdr);
+	lr->end = hdr->index_off;
+	lr->n_recs = hdr->n_frames;
+
+	return 0;
+}
+
+int logreader_open(struct logreader *lr, const char *path)
+{
+	struct stat st;
+	int fd;
+
+	memset(lr, 0, sizeof(*lr));
+	lr->hdr = &lr->text_hdr;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	lr->size = st.st_size;
+
+	if (lr->size) {
+		lr->map = mmap(NULL, lr->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (lr->map == MAP_FAILED) {
+			lr->map = NULL;
+			close(fd);
+			return -1;
+		}
+		madvise((void *)lr->map, lr->size, MADV_SEQUENTIAL);
+	}
+	close(fd); /* the mapping keeps the file referenced */
+	lr->end = lr->size;
+
+	if (lr->size >= sizeof(lr->hdr->magic) &&
+	    !memcmp(lr->map, CANLOG_MAGIC, sizeof(lr->hdr->magic))) {
+		lr->binary = 1;
+		if (check_header(lr)) {
+			logreader_close(lr);
+			errno = EINVAL;
+			return -1;
+		}
+	} else if (lr->size >= sizeof(lr->hdr->magic) &&
+		   !memcmp(lr->map, LOGPACK_MAGIC, sizeof(lr->hdr->magic))) {
+		lr->packed = 1;
+		if (check_pack(lr)) {
+			logreader_close(lr);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	lr->pos = lr->data;
+
+	return 0;
+}
+
+static const struct canlog_rec *next_text(struct logreader *lr)
+{
+	char ifname[IFNAMSIZ];
+	struct canfd_frame cf;
+	const char *start, *end;
+	__u64 ts;
+	int mtu, idx;
+
+	while (lr->pos < lr->end) {
+		start = lr->map + lr->pos;
+		end = memchr(start, '\n', lr->end - lr->pos);
+		if (!end)
+			end = lr->map + lr->end;
+		lr->pos = end - lr->map + 1;
+
+		if (start == end || *start == '#')
+			continue;
+
+		mtu = canlog_parse_line(start, end - start, &ts, ifname, &cf);
+		idx = mtu ? canlog_ifindex(&lr->text_hdr, ifname) : -1;
+		if (idx < 0) {
+			lr->bad_lines++;
+			continue;
+		}
+
+		canlog_frame2rec(&lr->cur.rec, &cf, mtu, ts, idx);
+		return &lr->cur.rec;
+	}
+
+	return NULL;
+}
+
+/* the last block starting at or before offset */
+static __u64 find_block(struct logreader *lr, size_t offset)
+{
+	__u64 lo = 0, hi = lr->pk_blocks, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (lr->pk_index[mid].offset <= offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo ? lo - 1 : 0;
+}
+
+static const struct canlog_rec *next_packed(struct logreader *lr)
+{
+	const struct logpack_entry *e;
+	__u64 b;
+	int ret;
+
+	while (lr->pos < lr->end && lr->pk_blocks) {
+		/* after a seek or rewind, move the decoder to pos first */
+		e = lr->pk_block < lr->pk_blocks ? &lr->pk_index[lr->pk_block] : NULL;
+		if (!e || lr->pos != e->offset + lr->dec.frame) {
+			b = find_block(lr, lr->pos);
+			e = &lr->pk_index[b];
+			lr->pk_block = b;
+			if (logpack_dec_start(&lr->dec, lr->map + e->offset, e->size)) {
+				lr->bad_lines++;
+				lr->pk_block = lr->pk_blocks;
+				lr->pos = e->offset + e->size;
+				continue;
+			}
+			while (lr->dec.frame < lr->pos - e->offset &&
+			       logpack_dec_next(&lr->dec, &lr->cur.rec) > 0)
+				;
+		}
+
+		ret = logpack_dec_next(&lr->dec, &lr->cur.rec);
+		if (ret > 0 && lr->cur.rec.ifindex < lr->text_hdr.n_ifaces) {
+			if (lr->dec.frame < lr->dec.n_frames)
+				lr->pos = e->offset + lr->dec.frame;
+			else
+				lr->pos = e->offset + e->size;
+			return &lr->cur.rec;
+		}
+
+		/* end of the block, or the rest of a corrupt one is skipped */
+		if (ret)
+			lr->bad_lines++;
+		lr->pk_block = lr->pk_blocks;
+		lr->pos = e->offset + e->size;
+	}
+
+	return NULL;
+}
+
+const struct canlog_rec *logreader_next(struct logreader *lr)
+{
+	const struct canlog_rec *rec;
+
+	if (lr->packed)
+		return next_packed(lr);
+	if (!lr->binary)
+		return next_text(lr);
+
+	while (lr->pos + lr->hdr->rec_size <= lr->end) {
+		rec = (const struct canlog_rec *)(lr->map + lr->pos);
+		lr->pos += lr->hdr->rec_size;
+
+		/* users copy len bytes of payload, it must fit the record */
+		if (rec->len <= lr->hdr->rec_size - sizeof(*rec))
+			return rec;
+		lr->bad_lines++;
+	}
+
+	return NULL;
+}
+
+void logreader_rewind(struct logreader *lr)
+{
+	lr->pos = lr->data;
+	lr->bad_lines = 0;
+}
+
+size_t logreader_tell(struct logreader *lr)
+{
+	return lr->pos;
+}
+
+int logreader_seek(struct logreader *lr, size_t offset)
+{
+	if (offset < lr->data || offset > lr->end)
+		return -1;
+
+	lr->pos = offset;
+	return 0;
+}
+
+int logreader_split(struct logreader *lr, struct logreader *part, int n)
+{
+	size_t start = lr->data, end, step;
+	const char *nl;
+	__u64 b;
+	int i;
+
+	if (n < 1)
+		return 0;
+
+	step = (lr->end - lr->data) / n;
+	if (lr->binary)
+		step -= step % lr->hdr->rec_size;
+
+	for (i = 0; i < n && start < lr->end; i++) {
+		end = (i == n - 1) ? lr->end : start + step;
+		if (lr->packed && end < lr->end) {
+			/* move the cut to the next block */
+			b = find_block(lr, end) + 1;
+			end = b < lr->pk_blocks ? lr->pk_index[b].offset : lr->end;
+		} else if (!lr->binary && end < lr->end) {
+			/* move the cut behind the next newline */
+			nl = memchr(lr->map + end, '\n', lr->end - end);
+			end = nl ? (size_t)(nl - lr->map) + 1 : lr->end;
+		}
+		if (end <= start)
+			end = lr->end;
+
+		part[i] = *lr;
+		if (!lr->binary)
+			part[i].hdr = &part[i].text_hdr;
+		if (!lr->binary && !lr->packed)
+			memset(&part[i].text_hdr, 0, sizeof(part[i].text_hdr));
+		part[i].pk_block = lr->pk_blocks;
+		part[i].data = part[i].pos = start;
+		part[i].end = end;
+		part[i].bad_lines = 0;
+
+		start = end;
+	}
+
+	return i;
+}
+
+const char *logreader_ifname(struct logreader *lr, int ifindex)
+{
+	if (ifindex >= lr->hdr->n_ifaces)
+		return "?";
+
+	return lr->hdr->ifname[ifindex];
+}
+
+void logreader_close(struct logreader *lr)
+{
+	if (lr->map)
+		munmap((void *)lr->map, lr->size);
+	lr->map = NULL;
+	lr->size = 0;
+}
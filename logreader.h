@@ -0,0 +1,118 @@
+/*
+ * logreader.h - memory-mapped CAN log reader
+ *
+ * Maps a candump text log, a binary log (see canlog.h) or a packed log
+ * (see logpack.h) and iterates its frames.  Binary records are handed out
+ * in place, straight from the mapping; text lines and packed blocks are
+ * decoded into a single record owned by the reader.  Either way the caller
+ * sees a struct canlog_rec that stays valid until the next call to
+ * logreader_next(), with no more than CANFD_MAX_DLEN bytes of payload that
+ * all lie within the record.
+ *
+ * Typical use:
+ *
+ *	struct logreader lr;
+ *	const struct canlog_rec *rec;
+ *
+ *	if (logreader_open(&lr, "data/sample-can.log"))
+ *		...
+ *	while ((rec = logreader_next(&lr)))
+ *		printf("%s %03X\n", logreader_ifname(&lr, rec->ifindex), rec->can_id);
+ *	logreader_close(&lr);
+ */
+
+#ifndef LOGREADER_H
+#define LOGREADER_H
+
+#include <stddef.h>
+#include <linux/types.h>
+
+#include "canlog.h"
+#include "logpack.h"
+
+struct logreader {
+	const char *map;	/* whole file, NULL for empty files */
+	size_t size;
+	int binary;
+	int packed;
+
+	const struct canlog_header *hdr; /* interface table for both formats */
+	size_t pos;		/* offset of the next line or record */
+	size_t data;		/* offset of the first line or record */
+	size_t end;		/* offset after the last line or record */
+	__u64 n_recs;		/* binary: records in the file */
+	unsigned long bad_lines; /* lines, records or blocks skipped as corrupt */
+
+	/* packed logs: block index and the decoder of the current block */
+	const struct logpack_entry *pk_index;
+	__u64 pk_blocks;
+	__u64 pk_block;		/* block dec belongs to, pk_blocks = none */
+	struct logpack_dec dec;
+
+	/*
+	 * text logs: decoded record and interface table built while reading,
+	 * packed logs: decoded record and the interface table of the file
+	 */
+	struct canlog_header text_hdr;
+	union {
+		struct canlog_rec rec;
+		__u8 buf[CANLOG_REC_CANFD];
+	} cur;
+};
+
+int logreader_open(struct logreader *lr, const char *path);
+/*
+ * Maps path read-only and detects its format.  The kernel is told the
+ * mapping is read sequentially, so read-ahead is aggressive and pages
+ * already consumed are dropped first under memory pressure.
+ *
+ * Return values: 0 = success, -1 = error (errno set, EINVAL on a bad
+ * binary header)
+ */
+
+const struct canlog_rec *logreader_next(struct logreader *lr);
+/*
+ * Returns the next frame or NULL at the end of the log.  Malformed text
+ * lines, binary records whose length does not fit the record size and
+ * corrupt packed blocks are skipped and counted in bad_lines.
+ */
+
+void logreader_rewind(struct logreader *lr);
+/*
+ * Restarts iteration at the first frame.
+ */
+
+size_t logreader_tell(struct logreader *lr);
+/*
+ * Returns the file offset of the next line or record.  For packed logs it
+ * is the offset of the frame's block plus its number within the block.
+ */
+
+int logreader_seek(struct logreader *lr, size_t offset);
+/*
+ * Continues iteration at offset, which must be a value returned by
+ * logreader_tell() on a reader of the same file.
+ *
+ * Return values: 0 = success, -1 = offset outside the log
+ */
+
+int logreader_split(struct logreader *lr, struct logreader *part, int n);
+/*
+ * Divides the frames of lr into at most n consecutive slices of about the
+ * same size, each iterated by its own reader in part[], e.g. by a thread.
+ * Text slices start at line boundaries, packed slices at blocks.  The
+ * parts share the mapping of lr: they must not be closed, copied or used
+ * after lr is closed.  Interface indexes of text parts are local to each
+ * part, compare them by name.
+ *
+ * Returns the number of parts filled in.
+ */
+
+const char *logreader_ifname(struct logreader *lr, int ifindex);
+/*
+ * Returns the interface name of a record's ifindex.
+ */
+
+void logreader_close(struct logreader *lr);
+
+#endif
@@ -0,0 +1,160 @@
+/*
+ * trigring.c - pre-trigger capture ring
+ *
+ * See trigring.h for the interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+
+#include "lib.h"
+#include "canlog.h"
+#include "trigring.h"
+
+#define TRIGRING_BATCH	1024	/* lines per write() */
+
+struct trigring_slot {
+	__u64 ts_ns;
+	int mtu;
+	struct canfd_frame cf;
+};
+
+struct trigring {
+	char prefix[PATH_MAX];
+	char ifname[IFNAMSIZ];
+	__u64 window_ns;
+	int dumps;
+
+	struct trigring_slot *slot;
+	unsigned long size;		/* slots, power of two */
+	unsigned long head;		/* frames pushed so far */
+	char *buf;
+};
+
+struct trigring *trigring_open(const char *prefix, const char *ifname,
+			       int seconds)
+{
+	struct trigring *tr;
+	unsigned long want = (unsigned long)seconds * TRIGRING_RATE;
+
+	if (seconds <= 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	tr = calloc(1, sizeof(*tr));
+	if (!tr)
+		return NULL;
+
+	strncpy(tr->prefix, prefix, sizeof(tr->prefix) - 1);
+	strncpy(tr->ifname, ifname, sizeof(tr->ifname) - 1);
+	tr->window_ns = seconds * 1000000000ULL;
+
+	for (tr->size = 1024; tr->size < want && tr->size < TRIGRING_MAX_SLOTS; )
+		tr->size *= 2;
+
+	/* touch every slot now, not on the receive path */
+	tr->slot = calloc(tr->size, sizeof(*tr->slot));
+	tr->buf = malloc(TRIGRING_BATCH * CANLOG_LINESZ);
+	if (!tr->slot || !tr->buf) {
+		free(tr->slot);
+		free(tr->buf);
+		free(tr);
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(tr->slot, 0, tr->size * sizeof(*tr->slot));
+
+	return tr;
+}
+
+void trigring_push(struct trigring *tr, const struct canfd_frame *cf, int mtu,
+		   __u64 ts_ns)
+{
+	struct trigring_slot *s = &tr->slot[tr->head++ & (tr->size - 1)];
+
+	s->ts_ns = ts_ns;
+	s->mtu = mtu;
+	memcpy(&s->cf, cf, mtu);
+	if (mtu == CAN_MTU)
+		s->cf.flags = 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int trigring_dump(struct trigring *tr, const char *reason)
+{
+	char path[PATH_MAX + 64];
+	struct trigring_slot *s;
+	struct timespec ts;
+	unsigned long first, i;
+	__u64 since;
+	size_t len = 0;
+	int fd, n = 0, err;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	since = ts.tv_sec * 1000000000ULL + ts.tv_nsec - tr->window_ns;
+
+	first = tr->head > tr->size ? tr->head - tr->size : 0;
+	while (first < tr->head && tr->slot[first & (tr->size - 1)].ts_ns < since)
+		first++;
+
+	snprintf(path, sizeof(path), "%s-%d-%s.log", tr->prefix, ++tr->dumps, reason);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return -1;
+
+	for (i = first; i < tr->head; i++) {
+		s = &tr->slot[i & (tr->size - 1)];
+		len += canlog_sprint_line(tr->buf + len, s->ts_ns, tr->ifname,
+					  &s->cf, s->mtu);
+		if (++n % TRIGRING_BATCH == 0 || i + 1 == tr->head) {
+			if (write_all(fd, tr->buf, len))
+				goto err;
+			len = 0;
+		}
+	}
+
+	if (close(fd))
+		return -1;
+	printf("[Ring] %s: %d frames before %s\n", path, n, reason);
+
+	return n;
+
+err:
+	err = errno;
+	close(fd);
+	errno = err;
+	return -1;
+}
+
+void trigring_close(struct trigring *tr)
+{
+	free(tr->slot);
+	free(tr->buf);
+	free(tr);
+}
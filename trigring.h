@@ -0,0 +1,52 @@
+/*
+ * trigring.h - pre-trigger capture ring
+ *
+ * Keeps the frames of the last few seconds in a ring of preallocated
+ * slots, overwriting the oldest, so the traffic that led up to an event
+ * can be written out after the fact.  Pushing a frame is a copy into the
+ * next slot, there is no allocation, locking or I/O on the receive path.
+ *
+ * The ring is owned by one thread: push and dump must not run
+ * concurrently.  A dump formats the frames with the lib.c formatters and
+ * writes them as a candump log in one go.
+ */
+
+#ifndef TRIGRING_H
+#define TRIGRING_H
+
+#include <linux/types.h>
+#include <linux/can.h>
+
+#define TRIGRING_RATE		10000	/* frames/s the ring is sized for */
+#define TRIGRING_MAX_SLOTS	(1 << 22)
+
+struct trigring;
+
+struct trigring *trigring_open(const char *prefix, const char *ifname,
+			       int seconds);
+/*
+ * Creates a ring holding the last seconds of traffic, sized for
+ * TRIGRING_RATE frames per second.  Dumps are written to
+ * "<prefix>-<n>-<reason>.log" with ifname as interface name.
+ *
+ * Returns NULL on error (errno set).
+ */
+
+void trigring_push(struct trigring *tr, const struct canfd_frame *cf, int mtu,
+		   __u64 ts_ns);
+/*
+ * Stores a frame received with the given MTU and timestamp (ns since the
+ * epoch), replacing the oldest one when the ring is full.
+ */
+
+int trigring_dump(struct trigring *tr, const char *reason);
+/*
+ * Writes the frames received within the last seconds before now to a new
+ * log.  The ring keeps its contents.
+ *
+ * Return values: number of frames written, -1 = error (errno set)
+ */
+
+void trigring_close(struct trigring *tr);
+
+#endif